@@ -14,9 +14,14 @@
 #define __LPICPC_H
 
 #include "lpicp_device.h"
+#include "lpicp_transport.h"
+#include "lpicp_timing.h"
+#include "lpicp_stats.h"
 
 /* forward declare */
 struct lpp_image_t;
+struct lpp_icsp_xfer_t;
+struct lpp_capture_t;
 
 /* PIC registers */
 #define LPP_REG_TBLPTRU (0xF8)
@@ -27,6 +32,10 @@ struct lpp_image_t;
 #define LPP_REG_EEADR   (0xA9)
 #define LPP_REG_EEADRH  (0xAA)
 #define LPP_REG_EECON2  (0xA7)
+#define LPP_REG_EECON1  (0xA6)
+
+/* implemented TBLPTR bits */
+#define LPP_TBLPTR_MASK (0x3FFFFF)
 
 /* PIC opcodes */
 #define LPP_OP_MOVLW(value)                 ((0x0E << 8) | (value))
@@ -39,6 +48,8 @@ struct lpp_image_t;
 #define LPP_SET_WREN                        (0x86A6)
 #define LPP_SET_FREE                        (0x88A6)
 #define LPP_INC_TBLPTRL                     (0x2AF6)
+#define LPP_INC_EEADR                       (0x2AA9)
+#define LPP_INC_EEADRH                      (0x2AAA)
 #define LPP_SET_PC_100K_0                   (0xEF00)
 #define LPP_SET_PC_100K_1                   (0xF800)
 #define LPP_MOVF_EEDATA_W                   (0x50A8)
@@ -47,6 +58,7 @@ struct lpp_image_t;
 #define LPP_SET_EECON1_WREN                 (0x84A6)
 #define LPP_CLR_EECON1_WREN                 (0x94A6)
 #define LPP_SET_EECON1_WR                   (0x82A6)
+#define LPP_OP_MOVF_W(register_address)     ((0x50 << 8) | (register_address))
 
 /* ICSP commands */
 #define LPP_ICSP_CMD_CORE_INST              (0x0) // 0000
@@ -63,15 +75,35 @@ struct lpp_image_t;
 /* notification callback types */
 typedef int (*ntfy_progress_t)(struct lpp_context_t *, const unsigned int, const unsigned int);
 
+/* called with each chunk read into an image (address, size), returns 0 to stop */
+struct lpp_image_t;
+typedef int (*lpp_read_chunk_t)(struct lpp_context_t *, struct lpp_image_t *, 
+                                const unsigned int, const unsigned int, void *);
+
 /* lpp context */
 struct lpp_context_t
 {
     struct lpp_log_record_t     *log_records;
     unsigned int                log_record_count;
-    unsigned int                log_current_idx;
+    unsigned int                log_head;               /* records ever logged, the ring holds the last */
+    struct lpp_capture_t        *capture;               /* every transfer is captured to file, if set */
     char                        *icsp_dev_name;
     int                         icsp_dev_file;
+    struct lpp_transport_t      *transport;
+    void                        *transport_data;
+    struct lpp_icsp_xfer_t      *xfer_queue;
+    unsigned int                xfer_queue_count;
+    int                         xfer_batch_supported;
+    int                         rx_block_supported;
+    unsigned int                tblptr_shadow;
+    int                         tblptr_shadow_valid;
+    int                         tblptr_shadow_check;
+    int                         row_verify;             /* read back each row right after programming it */
+    unsigned int                row_verify_count;       /* rows read back and found good */
+    unsigned int                row_verify_retries;     /* rows programmed again after failing */
     struct lpp_device_t         device;
+    struct lpp_timing_t         timing;
+    struct lpp_stats_t          stats;
 
     /* notifications */
     ntfy_progress_t             ntfy_progress;
@@ -80,9 +112,22 @@ struct lpp_context_t
 /* initialize a context */
 int lpp_context_init(struct lpp_context_t *context, 
                      const enum lpp_device_family_type_t family,
+                     const enum lpp_transport_type_t transport_type,
                      char *icsp_dev_name,
                      ntfy_progress_t ntfy_progress);
 
+/* 
+ * initialize a context, capturing every transfer from the very first to a file and 
+ * logging them to a ring of log_record_count records. either is skipped if NULL/0
+ */
+int lpp_context_init_session(struct lpp_context_t *context, 
+                             const enum lpp_device_family_type_t family,
+                             const enum lpp_transport_type_t transport_type,
+                             char *icsp_dev_name,
+                             ntfy_progress_t ntfy_progress,
+                             const char *capture_file_name,
+                             const unsigned int log_record_count);
+
 /* destroy a context */
 int lpp_context_destroy(struct lpp_context_t *context);
 
@@ -92,18 +137,123 @@ int lpp_bulk_erase(struct lpp_context_t *context);
 /* perform non-bulk erase */
 int lpp_non_bulk_erase(struct lpp_context_t *context);
 
+/* range of addresses, [start, end) */
+struct lpp_address_range_t
+{
+    unsigned int    start;
+    unsigned int    end;
+};
+
+/* result of a footprint erase */
+struct lpp_erase_stats_t
+{
+    unsigned int    page_count;                 /* pages on the device */
+    unsigned int    pages_erased;               /* pages the image populates */
+    unsigned int    pages_protected;            /* populated, but left alone for being protected */
+};
+
+/* 
+ * erase only the pages an image populates, except those touching a protected range.
+ * whole blocks are erased by block erase
+ */
+int lpp_footprint_erase(struct lpp_context_t *context, 
+                        struct lpp_image_t *image,
+                        const struct lpp_address_range_t *protect,
+                        const unsigned int protect_count,
+                        struct lpp_erase_stats_t *stats);
+
+/* what a verify covers */
+#define LPP_VERIFY_PROGRAM      (1 << 0)
+#define LPP_VERIFY_CONFIG       (1 << 1)
+#define LPP_VERIFY_EEPROM       (1 << 2)
+#define LPP_VERIFY_ALL          (LPP_VERIFY_PROGRAM | LPP_VERIFY_CONFIG | LPP_VERIFY_EEPROM)
+#define LPP_VERIFY_EEPROM_DEFINED (1 << 3)      /* only the eeprom bytes the image source defined */
+
+/* how many mismatches a verify keeps, and stops after */
+#define LPP_VERIFY_MAX_MISMATCHES (16)
+
+/* a byte that didn't verify */
+struct lpp_verify_mismatch_t
+{
+    unsigned int    address;                    /* device address */
+    unsigned char   expected;
+    unsigned char   actual;
+};
+
+/* result of a verify */
+struct lpp_verify_result_t
+{
+    unsigned int    program_bytes;              /* compared */
+    unsigned int    config_bytes;
+    unsigned int    eeprom_bytes;
+    unsigned int    mismatch_count;
+    struct lpp_verify_mismatch_t mismatches[LPP_VERIFY_MAX_MISMATCHES];
+};
+
+/* 
+ * verify the populated program, the valid config bytes and/or the eeprom of an image against 
+ * the device (LPP_VERIFY_*). the device is read a chunk at a time and compared as it's read, 
+ * stopping once max_mismatches are found (at most LPP_VERIFY_MAX_MISMATCHES). returns 0 only 
+ * if the device couldn't be read - check mismatch_count for the result
+ */
+int lpp_verify_image(struct lpp_context_t *context, 
+                     struct lpp_image_t *image,
+                     const unsigned int flags,
+                     const unsigned int max_mismatches,
+                     struct lpp_verify_result_t *result);
+
 /* read device id */
 int lpp_device_id_read(struct lpp_context_t *context, unsigned short *device_id);
 
 /* write an image to the device program */
 int lpp_write_image_to_device_program(struct lpp_context_t *context, struct lpp_image_t *image);
 
+/* result of an incremental write */
+struct lpp_incremental_stats_t
+{
+    unsigned int    page_count;                 /* pages the image populates */
+    unsigned int    pages_written;              /* those that differed, and were erased and rewritten */
+    unsigned int    saved_us;                   /* erase and programming holds skipped, not counting the readback */
+};
+
+/* read back every erase page an image populates */
+int lpp_read_device_program_pages_to_image(struct lpp_context_t *context, 
+                                           struct lpp_image_t *pattern,
+                                           struct lpp_image_t *image);
+
+/* 
+ * write an image to the device program, erasing and rewriting only the erase 
+ * pages where it differs from what the device currently holds
+ */
+int lpp_write_image_to_device_program_incremental(struct lpp_context_t *context, 
+                                                  struct lpp_image_t *image,
+                                                  struct lpp_image_t *current_image,
+                                                  struct lpp_incremental_stats_t *stats);
+
 /* write an image to the device config */
 int lpp_write_image_to_device_config(struct lpp_context_t *context, struct lpp_image_t *image);
 
 /* write an image to device eeprom */ 
 int lpp_read_image_to_device_eeprom(struct lpp_context_t *context, struct lpp_image_t *image);
 
+/* eeprom write modes */
+#define LPP_EEPROM_WRITE_CHANGED    (1 << 0)    /* read the device first, write only the bytes that differ */
+#define LPP_EEPROM_WRITE_DEFINED    (1 << 1)    /* write only the bytes the image source defined */
+
+/* result of a selective eeprom write */
+struct lpp_eeprom_write_stats_t
+{
+    unsigned int    bytes_written;
+    unsigned int    bytes_unchanged;            /* already held by the device */
+    unsigned int    bytes_undefined;            /* not defined by the image source */
+};
+
+/* write an image to device eeprom, skipping bytes according to the write mode (LPP_EEPROM_WRITE_*) */
+int lpp_write_image_to_device_eeprom_selective(struct lpp_context_t *context, 
+                                               struct lpp_image_t *image,
+                                               const unsigned int flags,
+                                               struct lpp_eeprom_write_stats_t *stats);
+
 /* read the image from the device eeprom */
 int lpp_read_device_eeprom_to_image(struct lpp_context_t *context, struct lpp_image_t *image);
 
@@ -113,6 +263,14 @@ int lpp_read_device_program_to_image(struct lpp_context_t *context,
                                      const unsigned int size_in_bytes,
                                      struct lpp_image_t *image);
 
+/* read the image from the device, handing off each chunk as soon as it's read */
+int lpp_read_device_program_stream(struct lpp_context_t *context, 
+                                   const unsigned int offset,
+                                   const unsigned int size_in_bytes,
+                                   struct lpp_image_t *image,
+                                   lpp_read_chunk_t chunk_read,
+                                   void *chunk_read_arg);
+
 /* read the image program from the device */
 int lpp_read_device_config_to_image(struct lpp_context_t *context,
                                     struct lpp_image_t *image);
@@ -131,6 +289,12 @@ int lpp_read_16(struct lpp_context_t *context,
                  const unsigned int address,
                  unsigned short *data);
 
+/* read a block of data from a specified address */
+int lpp_read_block(struct lpp_context_t *context,
+                   const unsigned int address,
+                   unsigned char *data,
+                   const unsigned int size);
+
 /* set tbpltr register */
 int lpp_tblptr_set(struct lpp_context_t *context,
                    const unsigned int value);
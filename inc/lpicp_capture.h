@@ -0,0 +1,82 @@
+/*
+ * Linux PIC Programmer (lpicp)
+ * Capture of ICSP sessions, for replay
+ *
+ * Author: Eran Duchan <pavius@gmail.com>
+ *
+ * This program is free software; you can redistribute  it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ */
+
+#ifndef __LPICPC_CAPTURE_H
+#define __LPICPC_CAPTURE_H
+
+#include <stdio.h>
+#include "lpicp.h"
+
+/* capture file identification */
+#define LPP_CAPTURE_FILE_MAGIC      "LPCP"
+#define LPP_CAPTURE_FILE_VERSION    (2)
+
+/*
+ * capture file header, followed by the records in the order they were issued. each
+ * record is a byte holding its kind (bits 4-6), command (low nibble) and whether the
+ * transport failed it (bit 7), followed by its value, little endian: 2 bytes of data for tx, 1 byte read for rx, 4 bytes of
+ * data for data only, 4 bytes of us for delays and a byte of PGC/PGD levels (bit 0/1)
+ * followed by 4 bytes of hold us for command only
+ */
+struct lpp_capture_file_header_t
+{
+    char                magic[4];               /* LPP_CAPTURE_FILE_MAGIC */
+    unsigned int        version;
+};
+
+/* longest encoded record */
+#define LPP_CAPTURE_RECORD_MAX_SIZE (6)
+
+/* a captured transfer */
+struct lpp_capture_record_t
+{
+    unsigned char       kind;                   /* lpp_log_kind_t */
+    unsigned char       command;
+    unsigned char       pgc_value;              /* held at, for command only */
+    unsigned char       pgd_value;
+    unsigned char       result;                 /* as returned by the transport, 0 on failure */
+    unsigned int        value;                  /* sent or read, or delay/hold in us */
+};
+
+/* capture in progress */
+struct lpp_capture_t
+{
+    FILE                *file;
+    unsigned long long  record_count;
+    int                 failed;                 /* a write failed, the capture is incomplete */
+};
+
+/* start capturing every transfer to a file */
+int lpp_capture_start(struct lpp_context_t *context, const char *file_name);
+
+/* finish the capture, returns 0 if it is incomplete */
+int lpp_capture_stop(struct lpp_context_t *context);
+
+/* capture a transfer, a no-op unless capturing */
+void lpp_capture_xfer(struct lpp_context_t *context,
+                      const unsigned char kind,
+                      const unsigned char command,
+                      const unsigned int value,
+                      const unsigned char pgc_value,
+                      const unsigned char pgd_value,
+                      const int result);
+
+/* encode a record, returns its size */
+unsigned int lpp_capture_record_encode(const struct lpp_capture_record_t *record,
+                                       unsigned char *buffer);
+
+/* decode a record, returns its size or 0 if it's truncated or unknown */
+unsigned int lpp_capture_record_decode(const unsigned char *buffer,
+                                       const unsigned int size,
+                                       struct lpp_capture_record_t *record);
+
+#endif /* __LPICPC_CAPTURE_H */
@@ -26,11 +26,41 @@ struct lpp_device_group_t
     int (*bulk_erase)(struct lpp_context_t *);
     int (*non_bulk_erase)(struct lpp_context_t *);
     int (*image_to_device_program)(struct lpp_context_t *, struct lpp_image_t *);
+    int (*image_pages_to_device_program)(struct lpp_context_t *, struct lpp_image_t *, const unsigned char *);
+    int (*erase_pages)(struct lpp_context_t *, const unsigned char *);
     int (*image_to_device_config)(struct lpp_context_t *, struct lpp_image_t *);
     int (*code_write_start)(struct lpp_context_t *);
     int (*config_write_start)(struct lpp_context_t *);
     int (*device_eeprom_to_image)(struct lpp_context_t *, struct lpp_image_t *);
     int (*image_to_device_eeprom)(struct lpp_context_t *, struct lpp_image_t *);
+    int (*image_bytes_to_device_eeprom)(struct lpp_context_t *, struct lpp_image_t *, const unsigned char *);
+};
+
+/* programming timing, in us */
+struct lpp_device_timing_t
+{
+    unsigned int        p9_us;                  /* programming hold (P9) */
+    unsigned int        p10_us;                 /* high voltage discharge (P10) */
+    unsigned int        p11_us;                 /* bulk erase hold (P11) */
+    unsigned int        erase_p10_us;           /* high voltage discharge after a bulk erase */
+    unsigned int        eeprom_poll_us;         /* between polls of an EEPROM write, until its time is learnt */
+    unsigned int        eeprom_write_max_us;    /* an EEPROM write that takes longer has failed */
+};
+
+/* learns how long EEPROM writes take, to sleep through most of one before polling */
+struct lpp_device_eeprom_predictor_t
+{
+    unsigned int        samples;                /* writes timed so far */
+    unsigned int        total_us;               /* their total time */
+    unsigned int        predicted_us;           /* time to sleep before polling, 0 until enough writes are timed */
+};
+
+/* how much margin to take over datasheet minimums */
+enum lpp_device_timing_policy_t
+{
+    LPP_DEVICE_TIMING_DEFAULT,                  /* the holds lpicp has always used on the device */
+    LPP_DEVICE_TIMING_DATASHEET,                /* datasheet minimums */
+    LPP_DEVICE_TIMING_SAFE,                     /* twice the datasheet minimums, never less than default */
 };
 
 /* operations */
@@ -41,11 +71,23 @@ struct lpp_device_t
     unsigned int        code_memory_size;
     unsigned int        code_words_per_write;
     unsigned int        code_erase_page_size;
+    unsigned int        code_boot_block_size;   /* erased on its own by block erase, 0 if none */
+    unsigned int        code_panel_size;
+    unsigned int        code_panel_count;       /* panels written at once, 1 for single panel */
     unsigned int        config_address;
     unsigned int        config_bytes;
+    const unsigned char *config_mask;           /* implemented bits of each config byte, NULL if all */
     unsigned int        eeprom_address;
     unsigned int        eeprom_bytes;
 
+    /* datasheet and default timing, set on open, and the timing actually used */
+    struct lpp_device_timing_t  timing_datasheet;
+    struct lpp_device_timing_t  timing_default;
+    struct lpp_device_timing_t  timing;
+
+    /* EEPROM write time, as learnt this session */
+    struct lpp_device_eeprom_predictor_t eeprom_predictor;
+
     /* pointer to anything common to the group */
     struct lpp_device_group_t *group;
 };
@@ -60,5 +102,40 @@ enum lpp_device_family_type_t
 int lpp_device_init_by_family(struct lpp_context_t *context, 
                               const enum lpp_device_family_type_t family);
 
+/* derive the timing used from the datasheet timing */
+int lpp_device_timing_policy_set(struct lpp_context_t *context, 
+                                 const enum lpp_device_timing_policy_t policy);
+
+/* hold for P9 after a programming command, then wait P10 */
+int lpp_device_program_hold(struct lpp_context_t *context);
+
+/* hold for P11 after a bulk erase command, then wait P10 */
+int lpp_device_bulk_erase_hold(struct lpp_context_t *context);
+
+/* 
+ * wait for an EEPROM write to complete by polling EECON1.WR. the first few writes are 
+ * polled finely to time them, later ones sleep through about that time before polling, 
+ * adjusting it as they go.
+ * returns 0 if the write doesn't complete within the device's maximum write time
+ */
+int lpp_device_eeprom_write_wait(struct lpp_context_t *context);
+
+/* largest write buffer a row verify can read back */
+#define LPP_DEVICE_MAX_ROW_SIZE (64)
+
+/* times a row is programmed before it fails row verify */
+#define LPP_DEVICE_ROW_ATTEMPTS (2)
+
+/* 
+ * read back a just programmed row and compare it to the image. prints where it 
+ * differs and returns 0 on a mismatch or read failure. mismatch, if given, is set
+ * only when the row was read and differs - worth programming again, unlike a failed read
+ */
+int lpp_device_row_verify(struct lpp_context_t *context, 
+                          struct lpp_image_t *image,
+                          const unsigned int address,
+                          const unsigned int size,
+                          int *mismatch);
+
 #endif /* __LPICPC_DEVICE_H */
 
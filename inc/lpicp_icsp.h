@@ -14,13 +14,50 @@
 #define __LPICPC_ICSP_H
 
 #include "lpicp.h"
+#include "lpicp_transport.h"
+
+#ifdef LPP_HAVE_MC_ICSP_H
 #include <linux/mc_icsp.h>
+#else
+/* command only transaction, as defined by the mc_icsp driver */
+struct mc_icsp_cmd_only_t
+{
+    unsigned char   command;
+    unsigned char   pgc_value_after_cmd;
+    unsigned char   pgd_value_after_cmd;
+    unsigned int    mdelay;
+    unsigned int    udelay;
+};
+#endif
 
 /* number of bits in command */
 #define LPP_COMMAND_BIT_COUNT (4)
 
+/* number of transactions queued before they are implicitly flushed */
+#define LPP_ICSP_QUEUE_SIZE (1024)
+
+/* queued transaction types */
+enum lpp_icsp_xfer_type_t
+{
+    LPP_ICSP_XFER_TX,
+    LPP_ICSP_XFER_CMD_ONLY,
+    LPP_ICSP_XFER_DATA_ONLY,
+    LPP_ICSP_XFER_DELAY
+};
+
+/* queued transaction */
+struct lpp_icsp_xfer_t
+{
+    unsigned int                type;           /* lpp_icsp_xfer_type_t */
+    unsigned char               command;        /* command (tx) */
+    unsigned int                value;          /* data or delay in us */
+    struct mc_icsp_cmd_only_t   cmd_config;     /* command only configuration */
+};
+
 /* open access to driver */
-int lpp_icsp_init(struct lpp_context_t *context, char *icsp_dev_name);
+int lpp_icsp_init(struct lpp_context_t *context, 
+                  const enum lpp_transport_type_t transport_type,
+                  char *icsp_dev_name);
 
 /* close access to driver */
 int lpp_icsp_destroy(struct lpp_context_t *context);
@@ -35,6 +72,12 @@ int lpp_icsp_read_8(struct lpp_context_t *context,
                     const unsigned char command, 
                     unsigned char *data);
 
+/* Read a number of 8 bit values, issuing the same command for each */
+int lpp_icsp_read_block(struct lpp_context_t *context, 
+                        const unsigned char command, 
+                        unsigned char *data, 
+                        const unsigned int size);
+
 /* send only command */
 int lpp_icsp_command_only(struct lpp_context_t *context, 
                           const struct mc_icsp_cmd_only_t *cmd_config);
@@ -46,5 +89,8 @@ int lpp_icsp_data_only(struct lpp_context_t *context,
 /* delay and return success */
 int lpp_icsp_delay_us(struct lpp_context_t *context, const unsigned int delay_us);
 
+/* push all queued transactions to the driver */
+int lpp_icsp_flush(struct lpp_context_t *context);
+
 #endif /* __LPICPC_ICSP_H */
 
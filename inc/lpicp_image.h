@@ -13,21 +13,39 @@
 #ifndef __LPICPC_IMAGE_H
 #define __LPICPC_IMAGE_H
 
+#include <stdio.h>
 #include "lpicp.h"
 
 /* max number of config bytes */
 #define LPP_MAX_EEPROM_BYTES (512)
 #define LPP_MAX_CONFIG_BYTES (32)
 
+/* contents are allocated as they're populated, in chunks of this size */
+#define LPP_IMAGE_ALLOC_GRANULARITY (4096)
+
+/* range of populated contents, [start, end) */
+struct lpp_image_extent_t
+{
+    unsigned int    start;
+    unsigned int    end;
+};
+
 /* image structure */
 struct lpp_image_t
 {
     unsigned char    *contents;
     unsigned int    contents_size;                      /* used, in bytes */
-    unsigned int    max_contents_size;                  /* allocated, in bytes */
+    unsigned int    max_contents_size;                  /* limit, in bytes */
+    unsigned int    allocated_size;                     /* allocated, in bytes */
+    struct lpp_image_extent_t *extents;                 /* populated ranges, sorted by address */
+    unsigned int    extent_count;
+    unsigned int    max_extent_count;
+    void            *map;                               /* contents are mapped read only from here, if set */
+    unsigned long   map_size;
     unsigned char   config[LPP_MAX_CONFIG_BYTES];       /* configuration bytes */
     unsigned int    config_valid;                       /* which config bytes are valid */
     unsigned char   eeprom[LPP_MAX_EEPROM_BYTES];       /* eeprom */  
+    unsigned char   eeprom_valid[LPP_MAX_EEPROM_BYTES / 8]; /* which eeprom bytes have been read from source */
     unsigned int    eeprom_size;                        /* used, in bytes */
 };
 
@@ -40,15 +58,127 @@ int lpp_image_init(struct lpp_context_t *context,
 int lpp_image_destroy(struct lpp_context_t *context, 
                       struct lpp_image_t *image);
 
+/* make sure contents up to some size are allocated (unpopulated contents are erased) */
+int lpp_image_reserve(struct lpp_context_t *context, 
+                      struct lpp_image_t *image, 
+                      const unsigned int size);
+
+/* mark a range of the contents as populated */
+int lpp_image_extent_add(struct lpp_context_t *context, 
+                         struct lpp_image_t *image, 
+                         const unsigned int start, 
+                         const unsigned int size);
+
+/* 
+ * get the first block (aligned to block_size) at or after an address which holds 
+ * populated contents, returns 0 if there is none
+ */
+int lpp_image_block_next(struct lpp_context_t *context, 
+                         struct lpp_image_t *image, 
+                         const unsigned int block_size, 
+                         unsigned int *address);
+
+/* iterate over the populated ranges, by address */
+#define lpp_image_for_each_extent(image, extent)                               \
+        for ((extent) = (image)->extents; (extent) < (image)->extents + (image)->extent_count; ++(extent))
+
+/* check if a range of the image holds only erased (0xFF) bytes */
+int lpp_image_is_blank(struct lpp_context_t *context, 
+                       struct lpp_image_t *image, 
+                       const unsigned int offset, 
+                       const unsigned int size);
+
 /* read a file into an image */
 int lpp_image_read_from_file(struct lpp_context_t *context, 
                              struct lpp_image_t *image, 
                              const char *file_name);
 
+/* size of the output buffer of the hex writer */
+#define LPP_IMAGE_HEX_WRITER_BUFFER_SIZE (16 * 1024)
+
+/* buffered intel hex output */
+struct lpp_image_hex_writer_t
+{
+    FILE            *file;
+    char            buffer[LPP_IMAGE_HEX_WRITER_BUFFER_SIZE];
+    unsigned int    buffer_used;
+    unsigned int    address_ext;                        /* upper address of the last record */
+    int             address_ext_valid;
+};
+
+/* start writing a hex file ("-" for stdout) */
+int lpp_image_hex_writer_open(struct lpp_context_t *context, 
+                              struct lpp_image_hex_writer_t *writer, 
+                              const char *file_name);
+
+/* write data records, with extended address records as required. data is in device order */
+int lpp_image_hex_writer_data(struct lpp_context_t *context, 
+                              struct lpp_image_hex_writer_t *writer, 
+                              const unsigned int address, 
+                              const unsigned char *data, 
+                              const unsigned int size);
+
+/* write data records for a range of image contents */
+int lpp_image_hex_writer_program(struct lpp_context_t *context, 
+                                 struct lpp_image_hex_writer_t *writer, 
+                                 struct lpp_image_t *image, 
+                                 const unsigned int address, 
+                                 const unsigned int size);
+
+/* write data records for the valid config bytes and the eeprom of an image */
+int lpp_image_hex_writer_config_eeprom(struct lpp_context_t *context, 
+                                       struct lpp_image_hex_writer_t *writer, 
+                                       struct lpp_image_t *image);
+
+/* write the end record and close the file */
+int lpp_image_hex_writer_close(struct lpp_context_t *context, 
+                               struct lpp_image_hex_writer_t *writer);
+
+/* write an image to a hex file */
+int lpp_image_write_to_file(struct lpp_context_t *context, 
+                            struct lpp_image_t *image, 
+                            const char *file_name);
+
 /* print an image to stdout */
 int lpp_image_print(struct lpp_context_t *context, 
                     struct lpp_image_t *image);
 
+/* image words are kept msb first (see lpp_image_read_program_record), whatever the host */
+#define lpp_image_word_get(contents, byte_offset)                       \
+        (((contents)[byte_offset] << 8) | (contents)[(byte_offset) + 1])
+
+/* set an image word */
+#define lpp_image_word_set(contents, byte_offset, word)                 \
+        (contents)[byte_offset] = (((word) >> 8) & 0xFF);               \
+        (contents)[(byte_offset) + 1] = ((word) & 0xFF);
+
+/* check if an eeprom byte has been read from source */
+#define lpp_image_eeprom_valid(image, byte_idx)                         \
+        ((image)->eeprom_valid[(byte_idx) >> 3] & (1 << ((byte_idx) & 0x7)))
+
+/* 
+ * contents in whole words. words are swapped in place, so contents ending on an odd
+ * address keep their last byte just past contents_size
+ */
+#define lpp_image_contents_word_size(image)                             \
+        (((image)->contents_size + 1) & ~1U)
+
+/* 
+ * get an image word, erased past the contents. the byte kept past contents_size is 
+ * only taken if it's allocated, never from whatever follows
+ */
+#define lpp_image_word(image, byte_offset)                              \
+        (((byte_offset) < (image)->contents_size) ?                     \
+            (((image)->contents[byte_offset] << 8) |                    \
+             (((byte_offset) + 1 < (image)->allocated_size) ?           \
+                (image)->contents[(byte_offset) + 1] : 0xFF)) : 0xFFFF)
+
+/* get the image byte at a device address (lsb of its word first), erased past the contents */
+#define lpp_image_byte(image, address)                                  \
+        (((address) & 0x1) ?                                            \
+            (lpp_image_word(image, (address) & ~1U) >> 8) :             \
+            (lpp_image_word(image, address) & 0xFF))
+
 /* get image size in words */
 #define lpp_image_get_content_size_in_words(image, size_in_words)    \
         *size_in_words = (image->contents_size >> 1);                \
@@ -0,0 +1,35 @@
+/* 
+ * Linux PIC Programmer (lpicp)
+ * Compiled image cache
+ *
+ * Author: Eran Duchan <pavius@gmail.com>
+ *
+ * This program is free software; you can redistribute  it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ */
+
+#ifndef __LPICPC_IMAGE_CACHE_H
+#define __LPICPC_IMAGE_CACHE_H
+
+#include "lpicp_image.h"
+
+/* compiled images are kept next to their HEX file, with this suffix */
+#define LPP_IMAGE_CACHE_SUFFIX ".lpimg"
+
+/* 
+ * read a HEX file into an image through its compiled image. if the compiled
+ * image is missing or stale, the HEX file is parsed and the compiled image
+ * written for next time. contents of a compiled image are mapped, not read
+ */
+int lpp_image_cache_load(struct lpp_context_t *context, 
+                         struct lpp_image_t *image, 
+                         const char *file_name);
+
+/* write the compiled image of a HEX file */
+int lpp_image_cache_store(struct lpp_context_t *context, 
+                          struct lpp_image_t *image, 
+                          const char *file_name);
+
+#endif /* __LPICPC_IMAGE_CACHE_H */
@@ -15,15 +15,80 @@
 
 #include "lpicp.h"
 
+/* kinds of logged transfers */
+enum lpp_log_kind_t
+{
+    LPP_LOG_KIND_TX,
+    LPP_LOG_KIND_RX,
+    LPP_LOG_KIND_CMD_ONLY,
+    LPP_LOG_KIND_DATA_ONLY,
+    LPP_LOG_KIND_DELAY
+};
+
+/* transfer log record, as kept in the ring and dumped to file */
+struct lpp_log_record_t
+{
+    unsigned long long  timestamp_ns;           /* monotonic, when the transfer was done */
+    unsigned int        data;                   /* sent or read, or delay/hold in us */
+    unsigned char       kind;                   /* lpp_log_kind_t */
+    unsigned char       command;
+    unsigned char       result;                 /* nonzero if the transfer succeeded */
+    unsigned char       pgc_value;              /* PGC held at, for command only */
+};
+
+/* log dump file header, followed by the records oldest first */
+struct lpp_log_file_header_t
+{
+    char                magic[4];               /* LPP_LOG_FILE_MAGIC */
+    unsigned int        version;
+    unsigned int        record_size;
+    unsigned int        record_count;           /* in file */
+    unsigned long long  total_record_count;     /* logged, including those overwritten */
+};
+
+/* log dump file identification */
+#define LPP_LOG_FILE_MAGIC      "LPTR"
+#define LPP_LOG_FILE_VERSION    (1)
+
+/* 
+ * state of a decoder, following the core registers the logged instructions 
+ * touch so that table and eeprom accesses can be annotated with their address
+ */
+struct lpp_log_decoder_t
+{
+    unsigned long long  first_timestamp_ns;
+    unsigned long long  previous_timestamp_ns;
+    unsigned int        record_idx;
+    unsigned char       w;
+    unsigned char       regs[256];
+    unsigned char       regs_valid[256];
+    int                 w_valid;
+};
+
 /* print the log */
 void lpp_log_print(struct lpp_context_t *context);
 
-/* log a command */
-int lpp_log_command(struct lpp_context_t *context, 
-                    const unsigned char command, 
-                    const unsigned short data);
+/* dump the log to a file */
+int lpp_log_dump(struct lpp_context_t *context, const char *file_name);
+
+/* log a transfer, a no-op unless a log was initialized */
+void lpp_log_xfer(struct lpp_context_t *context, 
+                  const unsigned char kind,
+                  const unsigned char command, 
+                  const unsigned int data,
+                  const unsigned char result,
+                  const unsigned char pgc_value);
+
+/* initialize a decoder */
+void lpp_log_decoder_init(struct lpp_log_decoder_t *decoder);
+
+/* disassemble and annotate a record into a line of text, following state */
+void lpp_log_decode(struct lpp_log_decoder_t *decoder, 
+                    const struct lpp_log_record_t *record,
+                    char *line,
+                    const unsigned int line_size);
 
-/* initialize a context */
+/* initialize the log, as a ring keeping the last records (rounded up to a power of two) */
 int lpp_log_init(struct lpp_context_t *context,
                  const unsigned int cmd_log_record_count);
 
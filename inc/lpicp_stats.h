@@ -0,0 +1,88 @@
+/* 
+ * Linux PIC Programmer (lpicp)
+ * Performance counters header
+ *
+ * Author: Eran Duchan <pavius@gmail.com>
+ *
+ * This program is free software; you can redistribute  it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ */
+
+#ifndef __LPICPC_STATS_H
+#define __LPICPC_STATS_H
+
+#include <stdio.h>
+
+/* forward declare */
+struct lpp_context_t;
+
+/* phases of a run, each counted on its own */
+enum lpp_stats_phase_t
+{
+    LPP_STATS_PHASE_DETECT,                     /* opening the transport and identifying the device */
+    LPP_STATS_PHASE_LOAD,                       /* loading images from file, no device access */
+    LPP_STATS_PHASE_ERASE,
+    LPP_STATS_PHASE_PROGRAM,
+    LPP_STATS_PHASE_CONFIG,
+    LPP_STATS_PHASE_EEPROM,
+    LPP_STATS_PHASE_VERIFY,
+    LPP_STATS_PHASE_READ,
+    LPP_STATS_PHASE_COUNT
+};
+
+/* counters of a phase */
+struct lpp_stats_counters_t
+{
+    unsigned int        transfers;              /* ICSP transfers issued, delays excluded */
+    unsigned int        syscalls;               /* made by the transport to issue them */
+    unsigned long long  bytes_tx;               /* payload sent */
+    unsigned long long  bytes_rx;               /* payload read */
+    unsigned int        retries;                /* operations done again after failing */
+    unsigned long long  wall_ns;                /* time in the phase */
+    unsigned long long  transport_ns;           /* of which in the transport, deliberate delays included */
+    unsigned long long  delay_ns;               /* of which in deliberate delays */
+    unsigned long long  cpu_ns;                 /* host CPU time, user and system, transport included */
+};
+
+/* counters of a run */
+struct lpp_stats_t
+{
+    enum lpp_stats_phase_t      phase;          /* being counted */
+    unsigned long long          phase_start_ns;
+    unsigned long long          phase_start_cpu_ns;
+    unsigned long long          phase_start_delay_ns;
+    struct lpp_stats_counters_t phases[LPP_STATS_PHASE_COUNT];
+};
+
+/* get the counters of the current phase */
+#define lpp_stats_current(context) (&(context)->stats.phases[(context)->stats.phase])
+
+/* count a syscall made by a transport */
+#define lpp_stats_syscall(context) (lpp_stats_current(context)->syscalls++)
+
+/* count an operation done again */
+#define lpp_stats_retry(context) (lpp_stats_current(context)->retries++)
+
+/* start counting, in the detect phase */
+void lpp_stats_init(struct lpp_context_t *context);
+
+/* 
+ * start counting a phase. transfers queued so far are issued first, so that they're 
+ * counted in the phase that queued them. always succeeds, to be chained with operations
+ */
+int lpp_stats_phase_set(struct lpp_context_t *context, const enum lpp_stats_phase_t phase);
+
+/* get the up to date counters of a phase, or the total of all of them if phase is LPP_STATS_PHASE_COUNT */
+void lpp_stats_get(struct lpp_context_t *context, 
+                   const enum lpp_stats_phase_t phase,
+                   struct lpp_stats_counters_t *counters);
+
+/* get the name of a phase */
+const char *lpp_stats_phase_name(const enum lpp_stats_phase_t phase);
+
+/* print the counters of each phase that was entered, and the total, as text or as json */
+void lpp_stats_print(struct lpp_context_t *context, FILE *file, const int json);
+
+#endif /* __LPICPC_STATS_H */
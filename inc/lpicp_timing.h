@@ -0,0 +1,44 @@
+/* 
+ * Linux PIC Programmer (lpicp)
+ * Timing engine header
+ *
+ * Author: Eran Duchan <pavius@gmail.com>
+ *
+ * This program is free software; you can redistribute  it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ */
+
+#ifndef __LPICPC_TIMING_H
+#define __LPICPC_TIMING_H
+
+/* timing engine state and achieved delay statistics */
+struct lpp_timing_t
+{
+    unsigned int        sleep_overshoot_ns;     /* calibrated wake up latency of a sleep */
+    unsigned int        delay_count;
+    unsigned long long  requested_ns;
+    unsigned long long  achieved_ns;
+    unsigned int        max_overshoot_ns;
+};
+
+/* calibrate */
+int lpp_timing_init(struct lpp_timing_t *timing);
+
+/* get monotonic time, in ns */
+unsigned long long lpp_timing_now_ns(void);
+
+/* busy wait, for short delays that aren't accounted for (e.g. clock half periods) */
+void lpp_timing_spin_ns(const unsigned int delay_ns);
+
+/* wait at least the given time, as close to it as possible */
+int lpp_timing_delay_ns(struct lpp_timing_t *timing, const unsigned long long delay_ns);
+
+/* wait at least the given time, in us */
+int lpp_timing_delay_us(struct lpp_timing_t *timing, const unsigned int delay_us);
+
+/* print achieved delay statistics */
+void lpp_timing_print(struct lpp_timing_t *timing);
+
+#endif /* __LPICPC_TIMING_H */
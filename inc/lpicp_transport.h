@@ -0,0 +1,81 @@
+/* 
+ * Linux PIC Programmer (lpicp)
+ * Transport base header
+ *
+ * Author: Eran Duchan <pavius@gmail.com>
+ *
+ * This program is free software; you can redistribute  it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ */
+
+#ifndef __LPICPC_TRANSPORT_H
+#define __LPICPC_TRANSPORT_H
+
+/* forward declare */
+struct lpp_context_t;
+struct lpp_icsp_xfer_t;
+struct mc_icsp_cmd_only_t;
+
+/* max length of the path part of a device name */
+#define LPP_TRANSPORT_MAX_PATH (256)
+
+/* transport operations */
+struct lpp_transport_t
+{
+    const char *name;
+
+    /* callbacks */
+    int (*open)(struct lpp_context_t *, const char *);
+    int (*close)(struct lpp_context_t *);
+    int (*tx)(struct lpp_context_t *, const unsigned char, const unsigned short);
+    int (*rx)(struct lpp_context_t *, const unsigned char, unsigned char *);
+    int (*cmd_only)(struct lpp_context_t *, const struct mc_icsp_cmd_only_t *);
+    int (*data_only)(struct lpp_context_t *, const unsigned int);
+    int (*delay)(struct lpp_context_t *, const unsigned int);
+
+    /* 
+     * optional. issue a number of queued transactions at once - returns 1 on 
+     * success, 0 on failure and -1 if batching turns out to be unsupported
+     */
+    int (*batch)(struct lpp_context_t *, struct lpp_icsp_xfer_t *, const unsigned int);
+
+    /* 
+     * optional. issue the same rx command a number of times, filling a buffer - returns 
+     * 1 on success, 0 on failure and -1 if block reads turn out to be unsupported
+     */
+    int (*rx_block)(struct lpp_context_t *, const unsigned char, unsigned char *, const unsigned int);
+
+    /* 
+     * optional. get the time the target has spent clocking transfers and holding delays 
+     * so far, in ns, for transports that model it rather than take it
+     */
+    int (*bus_time)(struct lpp_context_t *, unsigned long long *);
+};
+
+/* types of transports */
+enum lpp_transport_type_t
+{
+    LPP_TRANSPORT_ICSP_DRIVER,
+    LPP_TRANSPORT_GPIO,
+    LPP_TRANSPORT_SIM,
+    LPP_TRANSPORT_MMIO,
+    LPP_TRANSPORT_REPLAY,
+};
+
+/* get transport structure by type */
+int lpp_transport_init_by_type(struct lpp_context_t *context, 
+                               const enum lpp_transport_type_t type);
+
+/* get the path part of a device name ("<path>[:<option>=<value>,...]") */
+int lpp_transport_get_path(const char *dev_name, 
+                           char *path, 
+                           const unsigned int path_size);
+
+/* get a numeric option from a device name, returns 0 if not present */
+int lpp_transport_get_option(const char *dev_name, 
+                             const char *option_name, 
+                             unsigned int *value);
+
+#endif /* __LPICPC_TRANSPORT_H */
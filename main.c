@@ -20,13 +20,23 @@
 #include "lpicp_log.h"
 #include "lpicp_icsp.h"
 #include "lpicp_image.h"
+#include "lpicp_timing.h"
+#include "lpicp_image_cache.h"
 
 /* current version */
 const char *version_string = "0.0.2";
 
+/* how many ranges can be protected from erase */
+#define LPICP_MAX_PROTECT_RANGES (8)
+
+/* transfers kept for printing when verbose, and for dumping when tracing */
+#define LPICP_VERBOSE_LOG_RECORDS (4096)
+#define LPICP_TRACE_LOG_RECORDS (1 << 20)
+
 /* to show progress */
 static unsigned int lpicp_progress_current_bytes = 0;
 static const char *lpicp_progress_current_operation = NULL;
+static struct timeval lpicp_progress_start_time;
 
 /* whether to read or write */
 enum lpicp_opmode_t
@@ -38,26 +48,59 @@ enum lpicp_opmode_t
     LPICP_OPMODE_ERASE_DEVICE
 };
 
+/* how to print performance counters */
+enum lpicp_stats_format_t
+{
+    LPICP_STATS_NONE,
+    LPICP_STATS_TEXT,
+    LPICP_STATS_JSON
+};
+
 /* running configuration */
 struct lpp_config_t
 {
     int verbose;
+    int single_panel;
+    int incremental;
+    int no_cache;
+    int row_verify;
+    unsigned int eeprom_write_flags;
     char *dev_name;
     char *file_name;
+    char *previous_file_name;
+    char *trace_file_name;
+    char *capture_file_name;
+    enum lpp_transport_type_t transport;
+    enum lpp_device_timing_policy_t timing_policy;
     enum lpicp_opmode_t opmode;
+    enum lpicp_stats_format_t stats_format;
     unsigned int offset;
     unsigned int size;
+    struct lpp_address_range_t protect[LPICP_MAX_PROTECT_RANGES];
+    unsigned int protect_count;
 };
 
 /* initialize default configuration */
 void lpicp_main_init_default_config(struct lpp_config_t *config)
 {
     config->verbose = 0;
+    config->single_panel = 0;
+    config->incremental = 0;
+    config->no_cache = 0;
+    config->row_verify = 0;
+    config->eeprom_write_flags = 0;
     config->dev_name = NULL;
     config->file_name = NULL;
+    config->previous_file_name = NULL;
+    config->trace_file_name = NULL;
+    config->capture_file_name = NULL;
+    config->transport = LPP_TRANSPORT_ICSP_DRIVER;
+    config->timing_policy = LPP_DEVICE_TIMING_DEFAULT;
     config->opmode = LPICP_OPMODE_UNDEFINED;
+    config->stats_format = LPICP_STATS_NONE;
     config->offset = 0;
     config->size = 0;
+    config->protect_count = 0;
 }
 
 /* before each operation */
@@ -69,6 +112,9 @@ int lpicp_progress_init(const char *current_operation)
     /* save opname */
     lpicp_progress_current_operation = current_operation;
 
+    /* time the operation */
+    gettimeofday(&lpicp_progress_start_time, NULL);
+
     /* success */
     return 1;
 }
@@ -80,9 +126,29 @@ void lpicp_main_usage(void)
     printf("Usage: lpicp [options]\n");
     printf("  -x, --exec            r, read | w, write | e, erase | devid\n");
     printf("  -d, --dev             ICSP device name (e.g. /dev/icsp0)\n");
-    printf("  -f, --file            Path to Intel HEX file\n");
+    printf("  -t, --transport       icsp (kernel driver, default) | gpio (e.g. -d /dev/gpiochip0:pgc=3,pgd=4) |\n");
+    printf("                        sim (simulated target, -d [<backing file>][:devid=<id>,...]) |\n");
+    printf("                        mmio (GPIO registers, e.g. -d /dev/mem:base=0x48000000,data=0x14,pgc=3,pgd=4) |\n");
+    printf("                        replay (a session captured with -c, -d <capture file>)\n");
+    printf("  -m, --margin          default (the holds and EEPROM timeout lpicp has always used) |\n");
+    printf("                        datasheet (the bare minimums) | safe (twice the datasheet minimums, never\n");
+    printf("                        less than default, with twice the datasheet EEPROM timeout)\n");
+    printf("  -P, --single-panel    Don't program multiple panels at once, on devices that support it\n");
+    printf("  -f, --file            Path to Intel HEX file (with read, written as the device is read.\n");
+    printf("                        with erase, only the pages it populates are erased)\n");
+    printf("  -C, --no-cache        Always parse HEX files, don't use or write their compiled (" LPP_IMAGE_CACHE_SUFFIX ") images\n");
+    printf("  -V, --row-verify      Write: read back each row right after programming it, failing on the first\n");
+    printf("                        bad one (after programming it once more). Replaces the program verify pass\n");
+    printf("  -I, --incremental     Write: erase and rewrite only the pages that differ from the device\n");
+    printf("  -e, --eeprom-changed  Write: read the EEPROM first, write only the bytes that differ\n");
+    printf("  -D, --eeprom-defined  Write: write (and verify) only the EEPROM bytes the HEX file defines\n");
+    printf("  -k, --protect         Erase: keep an address range, [start, end) (e.g. 0x0-0x800). May repeat\n");
+    printf("  -p, --previous        Write: incremental, against this HEX file instead of reading the device\n");
     printf("  -o, --offset          Read from offset, Write to offset\n");
     printf("  -s, --size            Size for operation, in bytes\n");
+    printf("  -T, --trace           Dump the last transfers to this file when done, for lpicp-trace to decode\n");
+    printf("  -c, --capture         Capture every transfer and read to this file, for -t replay\n");
+    printf("  -S, --stats[=json]    Print transfers, syscalls, bytes, retries and where the time went, per phase\n");
     printf("  -v, --verbose         Verbose operation\n");
     printf("  -h, --help            Prints this usage\n");
     printf("\n");
@@ -118,7 +184,20 @@ int lpicp_main_parse_args_to_config(int argc, char *argv[], struct lpp_config_t
             {"exec",        0,              0,                'x'},
             {"help",        0,              0,                'h'},
             {"dev",         1,              0,                'd'},
+            {"transport",   1,              0,                't'},
+            {"margin",      1,              0,                'm'},
+            {"single-panel",0,              0,                'P'},
             {"file",        1,              0,                'f'},
+            {"incremental", 0,              0,                'I'},
+            {"no-cache",    0,              0,                'C'},
+            {"row-verify",  0,              0,                'V'},
+            {"eeprom-changed", 0,           0,                'e'},
+            {"eeprom-defined", 0,           0,                'D'},
+            {"previous",    1,              0,                'p'},
+            {"trace",       1,              0,                'T'},
+            {"capture",     1,              0,                'c'},
+            {"stats",       2,              0,                'S'},
+            {"protect",     1,              0,                'k'},
             {"offset",      1,              0,                'o'},
             {"size",        1,              0,                's'},
             {0, 0, 0, 0}
@@ -128,7 +207,7 @@ int lpicp_main_parse_args_to_config(int argc, char *argv[], struct lpp_config_t
         int option_index = 0;
 
         /* get the options */
-        current_option = getopt_long (argc, argv, "hvs:x:d:f:o:", long_options, &option_index);
+        current_option = getopt_long (argc, argv, "hvPICVeDs:x:d:f:o:t:m:p:k:T:c:S::", long_options, &option_index);
 
         /* Detect the end of the options. */
         if (current_option == -1)
@@ -149,6 +228,117 @@ int lpicp_main_parse_args_to_config(int argc, char *argv[], struct lpp_config_t
             }
             break;
 
+            /* single panel writes */
+            case 'P':
+            {
+                /* save flag */
+                config->single_panel = 1;
+            }
+            break;
+
+            /* don't use compiled images */
+            case 'C':
+            {
+                /* save flag */
+                config->no_cache = 1;
+            }
+            break;
+
+            /* verify rows as they're written */
+            case 'V':
+            {
+                /* save flag */
+                config->row_verify = 1;
+            }
+            break;
+
+            /* write only the eeprom bytes that differ */
+            case 'e':
+            {
+                /* save flag */
+                config->eeprom_write_flags |= LPP_EEPROM_WRITE_CHANGED;
+            }
+            break;
+
+            /* write only the eeprom bytes defined by the file */
+            case 'D':
+            {
+                /* save flag */
+                config->eeprom_write_flags |= LPP_EEPROM_WRITE_DEFINED;
+            }
+            break;
+
+            /* incremental writes */
+            case 'I':
+            {
+                /* save flag */
+                config->incremental = 1;
+            }
+            break;
+
+            /* incremental writes, against a file */
+            case 'p':
+            {
+                /* save file name */
+                config->incremental = 1;
+                config->previous_file_name = optarg;
+            }
+            break;
+
+            /* print counters */
+            case 'S':
+            {
+                /* as text, unless asked for json */
+                if (optarg == NULL || strcmp(optarg, "text") == 0)
+                    config->stats_format = LPICP_STATS_TEXT;
+                else if (strcmp(optarg, "json") == 0)
+                    config->stats_format = LPICP_STATS_JSON;
+                else
+                {
+                    /* bad format */
+                    printf("Invalid stats format: %s\n", optarg);
+                    return 0;
+                }
+            }
+            break;
+
+            /* dump the transfer log */
+            case 'T':
+            {
+                /* save file name */
+                config->trace_file_name = optarg;
+            }
+            break;
+
+            /* capture the session */
+            case 'c':
+            {
+                /* save file name */
+                config->capture_file_name = optarg;
+            }
+            break;
+
+            /* protected range */
+            case 'k':
+            {
+                struct lpp_address_range_t *range = &config->protect[config->protect_count];
+                char *range_end;
+
+                /* parse start-end */
+                range->start = strtoul(optarg, &range_end, 0);
+                if (*range_end != '-' || config->protect_count == LPICP_MAX_PROTECT_RANGES)
+                {
+                    /* bad range */
+                    printf("Invalid protected range: %s\n", optarg);
+                    return 0;
+                }
+                range->end = strtoul(range_end + 1, NULL, 0);
+
+                /* save it */
+                config->protect_count++;
+            }
+            break;
+
             /* execute */
             case 'x':
             {
@@ -187,6 +377,73 @@ int lpicp_main_parse_args_to_config(int argc, char *argv[], struct lpp_config_t
             }
             break;
 
+            /* transport */
+            case 't':
+            {
+                /* kernel driver? */
+                if (strcmp(optarg, "icsp") == 0)
+                {
+                    /* set transport */
+                    config->transport = LPP_TRANSPORT_ICSP_DRIVER;
+                }
+                /* gpio character device? */
+                else if (strcmp(optarg, "gpio") == 0)
+                {
+                    /* set transport */
+                    config->transport = LPP_TRANSPORT_GPIO;
+                }
+                /* simulated target? */
+                else if (strcmp(optarg, "sim") == 0)
+                {
+                    /* set transport */
+                    config->transport = LPP_TRANSPORT_SIM;
+                }
+                /* memory mapped GPIO registers? */
+                else if (strcmp(optarg, "mmio") == 0)
+                {
+                    /* set transport */
+                    config->transport = LPP_TRANSPORT_MMIO;
+                }
+                /* captured session? */
+                else if (strcmp(optarg, "replay") == 0)
+                {
+                    /* set transport */
+                    config->transport = LPP_TRANSPORT_REPLAY;
+                }
+            }
+            break;
+
+            /* timing margin */
+            case 'm':
+            {
+                /* proven holds? */
+                if (strcmp(optarg, "default") == 0)
+                {
+                    /* set policy */
+                    config->timing_policy = LPP_DEVICE_TIMING_DEFAULT;
+                }
+                /* datasheet minimums? */
+                else if (strcmp(optarg, "datasheet") == 0)
+                {
+                    /* set policy */
+                    config->timing_policy = LPP_DEVICE_TIMING_DATASHEET;
+                }
+                /* twice the minimums? */
+                else if (strcmp(optarg, "safe") == 0)
+                {
+                    /* set policy */
+                    config->timing_policy = LPP_DEVICE_TIMING_SAFE;
+                }
+                /* unknown */
+                else
+                {
+                    /* bad policy */
+                    printf("Invalid margin: %s\n", optarg);
+                    return 0;
+                }
+            }
+            break;
+
             /* file */
             case 'f':
             {
@@ -225,6 +482,10 @@ int lpicp_main_parse_args_to_config(int argc, char *argv[], struct lpp_config_t
         return 0;
     }
 
+    /* the simulated target doesn't need a device, by default it's volatile */
+    if (config->dev_name == NULL && config->transport == LPP_TRANSPORT_SIM)
+        config->dev_name = "";
+
     /* check that all args have been passed */
     if (config->dev_name == NULL)
     {
@@ -261,12 +522,65 @@ int lpicp_main_execute_read_devid(struct lpp_context_t *context,
     }
 }
 
+/* read a HEX file to an image, through its compiled image unless asked not to */
+int lpicp_main_image_load(struct lpp_context_t *context, 
+                          struct lpp_config_t *config,
+                          struct lpp_image_t *image,
+                          const char *file_name)
+{
+    /* parse it or go through the cache */
+    return lpp_stats_phase_set(context, LPP_STATS_PHASE_LOAD) && 
+           (config->no_cache ? 
+            lpp_image_read_from_file(context, image, file_name) : 
+            lpp_image_cache_load(context, image, file_name));
+}
+
+/* erase only what an image populates */
+int lpicp_main_execute_erase_footprint(struct lpp_context_t *context, 
+                                       struct lpp_config_t *config)
+{
+    struct lpp_image_t image;
+    struct lpp_erase_stats_t stats;
+    int ret;
+
+    /* initialize image */
+    if (!lpp_image_init(context, &image, context->device.code_memory_size))
+    {
+        /* log */
+        printf("Error allocating image\n");
+        return 0;
+    }
+
+    /* read the file and erase its footprint */
+    ret = lpicp_main_image_load(context, config, &image, config->file_name)                    &&
+          lpp_stats_phase_set(context, LPP_STATS_PHASE_ERASE)                                 &&
+          lpicp_progress_init("Erasing")                                                      &&
+          lpp_footprint_erase(context, &image, config->protect, config->protect_count, &stats);
+
+    /* print result */
+    if (ret)
+        printf("\nErased %d of %d pages (%d protected)\n", 
+               stats.pages_erased, stats.page_count, stats.pages_protected);
+    else
+        printf("Error erasing device\n");
+
+    /* free image */
+    lpp_image_destroy(context, &image);
+
+    /* done */
+    return ret;
+}
+
 /* do erase device */
 int lpicp_main_execute_erase_device(struct lpp_context_t *context, 
                                     struct lpp_config_t *config)
 {
+    /* only what the image populates, if we were given one */
+    if (config->file_name) return lpicp_main_execute_erase_footprint(context, config);
+
     /* do non bulk erase */
-    if (lpicp_progress_init("Erasing") && 
+    if (lpp_stats_phase_set(context, LPP_STATS_PHASE_ERASE) && 
+        lpicp_progress_init("Erasing") && 
         lpp_non_bulk_erase(context))
     {
         /* space out */
@@ -285,11 +599,92 @@ int lpicp_main_execute_erase_device(struct lpp_context_t *context,
     }
 }
 
+/* write only the pages that changed */
+int lpicp_main_write_program_incremental(struct lpp_context_t *context, 
+                                         struct lpp_config_t *config,
+                                         struct lpp_image_t *image)
+{
+    struct lpp_image_t current_image;
+    struct lpp_incremental_stats_t stats;
+    unsigned long long readback_ns = 0;
+    int ret;
+
+    /* initialize the image of what's on the device */
+    if (!lpp_image_init(context, &current_image, context->device.code_memory_size))
+    {
+        /* set error */
+        goto err_init_image;
+    }
+
+    /* the previous release if we were given one, otherwise whatever the device holds */
+    if (config->previous_file_name)
+        ret = lpicp_main_image_load(context, config, &current_image, config->previous_file_name);
+    else
+    {
+        /* reading the device back is what skipping pages costs */
+        readback_ns = lpp_timing_now_ns();
+        ret = lpicp_progress_init("Reading")    &&
+              lpp_read_device_program_pages_to_image(context, image, &current_image);
+        readback_ns = lpp_timing_now_ns() - readback_ns;
+    }
+
+    /* write what changed */
+    ret = ret                                                                               && 
+          lpp_stats_phase_set(context, LPP_STATS_PHASE_PROGRAM)                             &&
+          lpicp_progress_init("Writing")                                                    &&
+          lpp_write_image_to_device_program_incremental(context, image, &current_image, &stats);
+
+    /* print result */
+    if (ret)
+    {
+        printf("\nIncremental write: %d of %d pages unchanged and skipped, ~%lld ms saved "
+               "(%d ms of erase/program holds skipped, less %llu ms reading the device back)\n",
+               stats.page_count - stats.pages_written, stats.page_count, 
+               ((long long)stats.saved_us * 1000 - (long long)readback_ns) / 1000000,
+               stats.saved_us / 1000, readback_ns / 1000000);
+    }
+
+    /* free image */
+    lpp_image_destroy(context, &current_image);
+
+    /* return result */
+    return ret;
+
+err_init_image:
+    return 0;
+}
+
+/* write the eeprom, skipping bytes if asked to */
+int lpicp_main_write_eeprom(struct lpp_context_t *context, 
+                            struct lpp_config_t *config,
+                            struct lpp_image_t *image)
+{
+    struct lpp_eeprom_write_stats_t stats;
+
+    /* all of it, unless asked otherwise */
+    if (!config->eeprom_write_flags) return lpp_read_image_to_device_eeprom(context, image);
+
+    /* write what needs writing */
+    if (!lpp_write_image_to_device_eeprom_selective(context, image, config->eeprom_write_flags, &stats))
+    {
+        /* error */
+        return 0;
+    }
+
+    /* print result */
+    printf("\nEEPROM write: %d bytes written, %d unchanged, %d undefined\n",
+           stats.bytes_written, stats.bytes_unchanged, stats.bytes_undefined);
+
+    /* success */
+    return 1;
+}
+
 /* do write */
 int lpicp_main_execute_image_write(struct lpp_context_t *context, 
                                    struct lpp_config_t *config)
 {
-    struct lpp_image_t image, verify_image;
+    struct lpp_image_t image;
+    struct lpp_verify_result_t verify_result;
     int ret;
 
     /* return error, by default */
@@ -303,11 +698,15 @@ int lpicp_main_execute_image_write(struct lpp_context_t *context,
     if (lpp_image_init(context, &image, context->device.code_memory_size))
     {
         /* read the file and write to device */
-        if (!(lpp_image_read_from_file(context, &image, config->file_name)  &&
-              lpicp_progress_init("Writing")                                &&
-              lpp_write_image_to_device_program(context, &image)            &&
-              lpp_write_image_to_device_config(context, &image)             &&
-              lpp_read_image_to_device_eeprom(context, &image)))
+        if (!(lpicp_main_image_load(context, config, &image, config->file_name)  &&
+              lpp_stats_phase_set(context, LPP_STATS_PHASE_PROGRAM)             &&
+              (config->incremental ? 
+                lpicp_main_write_program_incremental(context, config, &image) : 
+                (lpicp_progress_init("Writing") && lpp_write_image_to_device_program(context, &image))) &&
+              lpp_stats_phase_set(context, LPP_STATS_PHASE_CONFIG)              &&
+              lpp_write_image_to_device_config(context, &image)                 &&
+              lpp_stats_phase_set(context, LPP_STATS_PHASE_EEPROM)              &&
+              lpicp_main_write_eeprom(context, config, &image)))
         {
             /* error writing file */
             printf("Error writing file\n");
@@ -329,46 +728,48 @@ int lpicp_main_execute_image_write(struct lpp_context_t *context,
      * Verify image
      */
      
-    /* initialize verification image */
-    if (lpp_image_init(context, &verify_image, image.contents_size))
+    /* compare the device to the image as it's read */
+    if (lpp_stats_phase_set(context, LPP_STATS_PHASE_VERIFY) && 
+        lpicp_progress_init("Verifying") && 
+        lpp_verify_image(context, &image, 
+                         (config->row_verify ? (LPP_VERIFY_CONFIG | LPP_VERIFY_EEPROM) : LPP_VERIFY_ALL) | 
+                            ((config->eeprom_write_flags & LPP_EEPROM_WRITE_DEFINED) ? LPP_VERIFY_EEPROM_DEFINED : 0),
+                         LPP_VERIFY_MAX_MISMATCHES, &verify_result))
     {
-        /* try to read */
-        if (lpicp_progress_init("Reading")                                                      && 
-            lpp_read_device_program_to_image(context, 0, image.contents_size, &verify_image)    &&
-            lpp_read_device_eeprom_to_image(context, &verify_image))
+        unsigned int mismatch_idx;
+
+        /* print result */
+        printf("\nVerification %s (%d program + %d config + %d EEPROM bytes compared)\n", 
+               verify_result.mismatch_count ? "failed" : "success",
+               verify_result.program_bytes, verify_result.config_bytes, verify_result.eeprom_bytes);
+
+        /* print where */
+        for (mismatch_idx = 0; mismatch_idx < verify_result.mismatch_count; ++mismatch_idx)
         {
-            /* compare them */
-            int cmp_result = memcmp(image.contents, verify_image.contents, image.contents_size) == 0 &&
-                             memcmp(image.eeprom, verify_image.eeprom, context->device.eeprom_bytes) == 0;
-    
-            /* print result */
-            printf("\nVerification %s (%d program + %d EEPROM bytes compared)\n", 
-                   cmp_result ? "success" : "failed",
-                   image.contents_size, context->device.eeprom_bytes);
-    
-#if 0
-            /* print image */
-            printf("File (%d bytes):\n", image.contents_size);
-            lpp_image_print(context, &image);
-    
-            /* print image */
-            printf("Device (%d bytes):\n", verify_image.contents_size);
-            lpp_image_print(context, &verify_image);
-#endif    
-            /* return compare result */
-            ret = (cmp_result);
+            printf("  [%06X] expected %02X, read %02X\n", 
+                   verify_result.mismatches[mismatch_idx].address, 
+                   verify_result.mismatches[mismatch_idx].expected, 
+                   verify_result.mismatches[mismatch_idx].actual);
         }
+
+        /* program memory was read back as it was written */
+        if (config->row_verify)
+            printf("Program verified row by row while writing (%d rows, %d programmed again)\n", 
+                   context->row_verify_count, context->row_verify_retries);
+
+        /* stopped early? */
+        if (verify_result.mismatch_count == LPP_VERIFY_MAX_MISMATCHES)
+            printf("  (stopped after %d mismatches)\n", LPP_VERIFY_MAX_MISMATCHES);
+
+        /* return compare result */
+        ret = (verify_result.mismatch_count == 0);
     }
     else
     {
-        /* set error */
-        goto err_init_verify_image;
+        /* couldn't read */
+        printf("\nError reading device for verification\n");
     }
 
-    /* free verification image*/
-    lpp_image_destroy(context, &verify_image);
-
-err_init_verify_image:
 err_writing_file:
     lpp_image_destroy(context, &image);
 err_init_image:
@@ -377,6 +778,53 @@ err_init_image:
     return ret;
 }
 
+/* write a chunk of program read from the device */
+int lpicp_main_read_chunk_to_file(struct lpp_context_t *context, 
+                                  struct lpp_image_t *image,
+                                  const unsigned int address,
+                                  const unsigned int size,
+                                  void *writer)
+{
+    /* write its records */
+    return lpp_image_hex_writer_program(context, writer, image, address, size);
+}
+
+/* read the device to a HEX file */
+int lpicp_main_read_to_file(struct lpp_context_t *context, 
+                            struct lpp_config_t *config,
+                            struct lpp_image_t *image,
+                            const unsigned int size)
+{
+    struct lpp_image_hex_writer_t *writer;
+    int ret;
+
+    /* the writer holds its buffer */
+    writer = malloc(sizeof(*writer));
+    if (writer == NULL || !lpp_image_hex_writer_open(context, writer, config->file_name)) 
+    {
+        /* error */
+        free(writer);
+        return 0;
+    }
+
+    /* read the program to file as it comes, then config and eeprom */
+    ret = lpicp_progress_init("Reading")                                                                   && 
+          lpp_read_device_program_stream(context, 0, size, image, lpicp_main_read_chunk_to_file, writer)   &&
+          lpp_read_device_config_to_image(context, image)                                                  &&
+          lpp_read_device_eeprom_to_image(context, image)                                                  &&
+          lpp_image_hex_writer_config_eeprom(context, writer, image);
+
+    /* end the file */
+    ret = lpp_image_hex_writer_close(context, writer) && ret;
+    free(writer);
+
+    /* space out */
+    if (ret) printf("\n");
+
+    /* return result */
+    return ret;
+}
+
 /* do read */
 int lpicp_main_execute_image_read(struct lpp_context_t *context, 
                                   struct lpp_config_t *config)
@@ -393,10 +841,16 @@ int lpicp_main_execute_image_read(struct lpp_context_t *context,
     unsigned int size = (config->size == 0 ? context->device.code_memory_size : config->size);
 
     /* initialize image */
-    if (lpp_image_init(context, &image, size))
+    if (lpp_image_init(context, &image, size) && lpp_stats_phase_set(context, LPP_STATS_PHASE_READ))
     {
+        /* to a file? */
+        if (config->file_name)
+        {
+            /* records are written as the program comes off the device */
+            ret = lpicp_main_read_to_file(context, config, &image, size);
+        }
         /* try to read the image */
-        if (lpicp_progress_init("Reading")                              && 
+        else if (lpicp_progress_init("Reading")                         && 
             lpp_read_device_program_to_image(context, 0, size, &image)  &&
             lpp_read_device_config_to_image(context, &image)            &&
             lpp_read_device_eeprom_to_image(context, &image))
@@ -441,6 +895,23 @@ int lpicp_progress_show(struct lpp_context_t *context,
         /* do the print */
         printf("\r%s: %d of %d (%d%%)", lpicp_progress_current_operation, 
                current_bytes, total_bytes, current_bytes * 100 / total_bytes);
+
+        /* done? show throughput */
+        if (current_bytes >= total_bytes)
+        {
+            struct timeval current_time, diff_time;
+            unsigned int elapsed_ms;
+
+            /* get time since operation started */
+            gettimeofday(&current_time, NULL);
+            timersub(&current_time, &lpicp_progress_start_time, &diff_time);
+            elapsed_ms = diff_time.tv_sec * 1000 + diff_time.tv_usec / 1000;
+
+            /* print it */
+            printf(" in %d.%03ds", elapsed_ms / 1000, elapsed_ms % 1000);
+            if (elapsed_ms) printf(" (%d bytes/s)", (int)(total_bytes * 1000ULL / elapsed_ms));
+        }
+
         fflush(stdout);
 
         /* save printed bytes mark */
@@ -460,27 +931,28 @@ int lpicp_main_execute_config(struct lpp_config_t *config)
     /* assume no error */
     ret = 1;
 
-    /* try to init context */
-    if (lpp_context_init(&context, LPP_DEVICE_FAMILY_18F, config->dev_name, lpicp_progress_show))
+    /* try to init context, logging from detection on if verbose or tracing */
+    if (lpp_context_init_session(&context, LPP_DEVICE_FAMILY_18F, config->transport, 
+                                 config->dev_name, lpicp_progress_show, config->capture_file_name,
+                                 config->trace_file_name ? LPICP_TRACE_LOG_RECORDS : 
+                                    (config->verbose ? LPICP_VERBOSE_LOG_RECORDS : 0)))
     {
         struct timeval start_time, end_time, diff_time;
 
         /* print device */
         printf("Found device (%s)\n", context.device.name);
 
-        /* init log if verbose */
-        if (config->verbose)
-        {
-            /* try to init log */
-            if (!lpp_log_init(&context, 4096))
-            {
-                /* set err */
-                ret = 0;
+        /* apply timing margin */
+        lpp_device_timing_policy_set(&context, config->timing_policy);
 
-                /* error */
-                goto err_log_init;
-            }
-        }
+        /* one panel at a time, if asked to */
+        if (config->single_panel) context.device.code_panel_count = 1;
+
+        /* read back rows as they're written */
+        context.row_verify = config->row_verify;
+
+        /* read TBLPTR back before relying on the shadow if verbose */
+        if (config->verbose) context.tblptr_shadow_check = 1;
 
         /* get start time */
         gettimeofday(&start_time, NULL);
@@ -523,15 +995,25 @@ int lpicp_main_execute_config(struct lpp_config_t *config)
         /* print time */
         if (ret) printf("Done successfully in %d.%03ds\n", (int)diff_time.tv_sec, (int)(diff_time.tv_usec / 1000));
 
-        /* print log if verbose */
-        if (config->verbose)
-        {
-            /* print the log on success */
-            if (ret) lpp_log_print(&context);
+        /* show how close waits came to what was asked for, if asked for details */
+        if (config->verbose || config->stats_format != LPICP_STATS_NONE) 
+            lpp_timing_print(&context.timing);
 
-            /* and release it */
-            lpp_log_destroy(&context);
-        }
+        /* and where the time went */
+        if (config->stats_format != LPICP_STATS_NONE)
+            lpp_stats_print(&context, stdout, (config->stats_format == LPICP_STATS_JSON));
+
+        /* print the log on success if verbose */
+        if (config->verbose && ret) lpp_log_print(&context);
+
+        /* dump it, whether we succeeded or not */
+        if (config->trace_file_name) lpp_log_dump(&context, config->trace_file_name);
+
+        /* and release it */
+        lpp_log_destroy(&context);
+
+        /* done with the device */
+        lpp_context_destroy(&context);
     }
     else
     {
@@ -545,8 +1027,6 @@ int lpicp_main_execute_config(struct lpp_config_t *config)
         goto err_init_context;
     }
 
-err_log_init:
-    lpp_context_destroy(&context);
 err_init_context:
     return ret;
 }
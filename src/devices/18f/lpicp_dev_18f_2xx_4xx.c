@@ -10,7 +10,8 @@
  *
  */
 
-#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
 #include "lpicp.h"
 #include "lpicp_device.h"
 #include "lpicp_icsp.h"
@@ -19,6 +20,16 @@
 /* forward declarations */
 int lpp_device_18f2xxx_4xxx_image_to_device_program(struct lpp_context_t *context, 
                                                     struct lpp_image_t *image);
+int lpp_device_18f2xxx_4xxx_image_range_to_device_program(struct lpp_context_t *context, 
+                                                          struct lpp_image_t *image,
+                                                          const unsigned int start_address,
+                                                          const unsigned int end_address);
+
+/* implemented config bits, the rest read as 0 (DS39564, table 19-1) */
+static const unsigned char lpp_device_18f2xx_4xx_config_mask[] = 
+{
+    0x00, 0x27, 0x0F, 0x0F, 0x00, 0x01, 0x85, 0x00, 0x0F, 0xC0, 0x0F, 0xE0, 0x0F, 0x40
+};
 
 /* initialize the device by id */
 int lpp_device_18f2xx_4xx_open(struct lpp_context_t *context)
@@ -32,9 +43,13 @@ int lpp_device_18f2xx_4xx_open(struct lpp_context_t *context)
         case 0x1: 
             context->device.code_words_per_write   = 4;
             context->device.code_erase_page_size   = 64;
+            context->device.code_boot_block_size   = 512;
             context->device.code_memory_size       = 32 * 1024;
+            context->device.code_panel_size        = 8 * 1024;
+            context->device.code_panel_count       = 4;
             context->device.config_address         = 0x300000;
             context->device.config_bytes           = 14;
+            context->device.config_mask            = lpp_device_18f2xx_4xx_config_mask;
             context->device.eeprom_address         = 0xF00000;
             context->device.eeprom_bytes           = 256;
             context->device.name                   = "PIC18F452";
@@ -44,6 +59,22 @@ int lpp_device_18f2xx_4xx_open(struct lpp_context_t *context)
         default: return 0;
     }
 
+    /* programming timing (DS39576) */
+    context->device.timing_datasheet.p9_us             = 1000;
+    context->device.timing_datasheet.p10_us            = 5;
+    context->device.timing_datasheet.p11_us            = 5000;
+    context->device.timing_datasheet.erase_p10_us      = 5;
+    context->device.timing_datasheet.eeprom_poll_us    = 1000;
+
+    /* EEPROM write cycle is 4ms typical with no maximum given, allow twice that (DS39564) */
+    context->device.timing_datasheet.eeprom_write_max_us = 8000;
+
+    /* what lpicp has always used: a 10ms erase hold, then 50us and a 20us settle, and 100 EEPROM polls */
+    context->device.timing_default                     = context->device.timing_datasheet;
+    context->device.timing_default.p11_us              = 10000;
+    context->device.timing_default.erase_p10_us        = 70;
+    context->device.timing_default.eeprom_write_max_us = 100000;
+
     /* found */
     return 1;
 }
@@ -51,33 +82,10 @@ int lpp_device_18f2xx_4xx_open(struct lpp_context_t *context)
 /* perform bulk erase */
 int lpp_device_18f2xx_4xx_bulk_erase(struct lpp_context_t *context)
 {
-    /* start the transaction */
-    if (lpp_write_16(context, 0x3C0004, 0x0080) && 
-        lpp_exec_instruction(context, LPP_OP_NOP))
-    {
-        /* set up the transaction */
-        struct mc_icsp_cmd_only_t cmd_config = 
-        {
-            .command = 0x0,
-            .pgc_value_after_cmd = 0,
-            .pgd_value_after_cmd = 0,
-            .mdelay = 10, /* P11 */
-            .udelay = 0 
-        };
-
-        /* do the command only transaction */
-        if (lpp_icsp_command_only(context, &cmd_config))
-        {
-            /* wait P10 */
-            usleep(50);
-
-            /* success */
-            return 1;
-        }
-    }
-
-    /* failed for some reason */
-    return 0;
+    /* start the transaction, then hold P11 and wait P10 */
+    return lpp_write_16(context, 0x3C0004, 0x0080)     && 
+           lpp_exec_instruction(context, LPP_OP_NOP)   &&
+           lpp_device_bulk_erase_hold(context);
 }
 
 /* start writing to config memory */
@@ -89,6 +97,19 @@ int lpp_device_18f2xx_4xx_config_write_start(struct lpp_context_t *context)
             lpp_exec_instruction(context, LPP_SET_WREN);
 }
 
+/* erase a single page, multipanel writes must be disabled */
+static int lpp_device_18f2xx_4xx_page_erase(struct lpp_context_t *context, 
+                                            const unsigned int address)
+{
+    /* enter erase mode, set the current address and do the programming */
+    return lpp_exec_instruction(context, LPP_SET_EEPGD)                  &&
+            lpp_exec_instruction(context, LPP_CLR_CFGS)                 &&
+            lpp_exec_instruction(context, LPP_SET_FREE)                 &&        
+            lpp_tblptr_set(context, address)                            && 
+            lpp_icsp_write_16(context, LPP_ICSP_CMD_TBL_WR_PROG, 0x0)   &&
+            lpp_device_program_hold(context);
+}
+
 /* perform erase chip without using bulk */
 int lpp_device_18f2xx_4xx_non_bulk_erase(struct lpp_context_t *context)
 {
@@ -107,31 +128,8 @@ int lpp_device_18f2xx_4xx_non_bulk_erase(struct lpp_context_t *context)
               current_address < context->device.code_memory_size && ret; 
               current_address += context->device.code_erase_page_size)
         {
-            /* enter erase mode, set the current address and do the programming */
-            ret = lpp_exec_instruction(context, LPP_SET_EEPGD)                  &&
-                    lpp_exec_instruction(context, LPP_CLR_CFGS)                 &&
-                    lpp_exec_instruction(context, LPP_SET_FREE)                 &&        
-                    lpp_tblptr_set(context, current_address)                    && 
-                    lpp_icsp_write_16(context, LPP_ICSP_CMD_TBL_WR_PROG, 0x0);
-
-            /* perform the special nop procedure after programming */
-            if (ret)
-            {
-                /* set up the transaction */
-                struct mc_icsp_cmd_only_t cmd_config = 
-                {
-                    .command = 0x0,
-                    .pgc_value_after_cmd = 1,
-                    .pgd_value_after_cmd = 0,
-                    .mdelay = 1, /* P9 */
-                    .udelay = 0
-                };
-
-                /* send special command only, then wait P10, then 16 0s of data */
-                ret = lpp_icsp_command_only(context, &cmd_config) && 
-                        lpp_icsp_delay_us(context, 5) && 
-                        lpp_icsp_data_only(context, 0x0);
-            }
+            /* erase it */
+            ret = lpp_device_18f2xx_4xx_page_erase(context, current_address);
 
             /* progress notification */
             if (context->ntfy_progress)
@@ -196,23 +194,7 @@ int lpp_device_18f2xx_4xx_image_to_device_config(struct lpp_context_t *context,
                                     value);
 
             /* perform the special nop procedure after programming */
-            if (ret)
-            {
-                /* set up the transaction */
-                struct mc_icsp_cmd_only_t cmd_config = 
-                {
-                    .command = 0x0,
-                    .pgc_value_after_cmd = 1,
-                    .pgd_value_after_cmd = 0,
-                    .mdelay = 1, /* P9 */
-                    .udelay = 0
-                };
-
-                /* send special command only, then wait P10, then 16 0s of data */
-                ret = lpp_icsp_command_only(context, &cmd_config) && 
-                        lpp_icsp_delay_us(context, 5) && 
-                        lpp_icsp_data_only(context, 0x0);
-            }
+            if (ret) ret = lpp_device_program_hold(context);
         }
 
         /* increment tblptr by one byte */
@@ -223,10 +205,123 @@ int lpp_device_18f2xx_4xx_image_to_device_config(struct lpp_context_t *context,
     return ret;
 }
 
+/* burn the image to the device, writing all panels at once */
+static int lpp_device_18f2xx_4xx_image_to_device_program_multi_panel(struct lpp_context_t *context, 
+                                                                     struct lpp_image_t *image)
+{
+    const unsigned int panel_size = context->device.code_panel_size;
+    const unsigned int panel_count = context->device.code_panel_count;
+    const unsigned int write_size = context->device.code_words_per_write * 2;
+    unsigned int ret, panel_offset, panel_idx, word_index, blank, attempts_left;
+    int retry;
+
+    /* enable multipanel writes and enter code programming mode */
+    ret = lpp_device_18f2xx_4xx_config_write_start(context) &&
+          lpp_write_16(context, 0x3C0006, 0x0040)           &&
+          lpp_device_18f2xx_4xx_code_write_start(context);
+
+    /* each write programs the same offset in all panels */
+    for (panel_offset = 0; panel_offset < panel_size && ret; panel_offset += write_size)
+    {
+        /* programming erased words changes nothing - skip the write if all panels are erased here */
+        for (panel_idx = 0; 
+             panel_idx < panel_count && 
+                lpp_image_is_blank(context, image, (panel_idx * panel_size) + panel_offset, write_size); 
+             ++panel_idx);
+
+        /* all blank? */
+        blank = (panel_idx == panel_count);
+
+        /* write the rows of all panels, reading them back if asked to */
+        for (retry = 1, attempts_left = LPP_DEVICE_ROW_ATTEMPTS; !blank && retry && attempts_left; --attempts_left)
+        {
+            /* another go? all panels are programmed again together */
+            if (attempts_left != LPP_DEVICE_ROW_ATTEMPTS) 
+            {
+                context->row_verify_retries++;
+                lpp_stats_retry(context);
+            }
+            retry = 0;
+            ret = 1;
+
+            /* fill each panel's write buffer */
+            for (panel_idx = 0; panel_idx < panel_count && ret; ++panel_idx)
+            {
+                unsigned int current_address = (panel_idx * panel_size) + panel_offset;
+
+                /* set the current address */
+                ret = lpp_tblptr_set(context, current_address);
+
+                /* fill it */
+                for (word_index = 0; word_index < (write_size / 2) && ret; ++word_index, current_address += 2)
+                {
+                    /* last word of the buffer is only latched, unless it's the last panel which starts programming */
+                    unsigned char command = LPP_ICSP_CMD_TBL_WR_POST_INC_2;
+                    if (word_index == (write_size / 2) - 1)
+                        command = (panel_idx == panel_count - 1) ? LPP_ICSP_CMD_TBL_WR_PROG : LPP_ICSP_CMD_TBL_WR_POST_INC;
+
+                    /* write data */
+                    ret = lpp_icsp_write_16(context, command, lpp_image_word(image, current_address));
+                }
+            }
+
+            /* perform the special nop procedure after programming */
+            if (ret) ret = lpp_device_program_hold(context);
+
+            /* 
+             * read back the row of each panel, stopping at the first bad one. a bad row has them 
+             * all programmed again and then fails the write, a failed read fails it right away 
+             */
+            for (panel_idx = 0; panel_idx < panel_count && ret && context->row_verify; ++panel_idx)
+                ret = lpp_device_row_verify(context, image, (panel_idx * panel_size) + panel_offset, write_size, &retry);
+        }
+
+        /* progress notification */
+        if (context->ntfy_progress)
+            context->ntfy_progress(context, (panel_offset + write_size) * panel_count, panel_size * panel_count);
+    }
+
+    /* return the result */
+    return ret;
+}
+
+/* check if programming all panels at once takes less programming cycles than one at a time */
+static int lpp_device_18f2xx_4xx_multi_panel_preferred(struct lpp_context_t *context, 
+                                                       struct lpp_image_t *image)
+{
+    const unsigned int panel_size = context->device.code_panel_size;
+    const unsigned int write_size = context->device.code_words_per_write * 2;
+    unsigned int panel_offset, panel_idx, single_panel_writes, multi_panel_writes, blank_panels;
+
+    /* not supported */
+    if (context->device.code_panel_count <= 1) return 0;
+
+    /* count the writes that aren't skipped for being blank, either way */
+    for (panel_offset = 0, single_panel_writes = 0, multi_panel_writes = 0; 
+         panel_offset < panel_size; 
+         panel_offset += write_size)
+    {
+        /* count blank panels at this offset */
+        for (panel_idx = 0, blank_panels = 0; panel_idx < context->device.code_panel_count; ++panel_idx)
+            blank_panels += lpp_image_is_blank(context, image, (panel_idx * panel_size) + panel_offset, write_size);
+
+        /* one write per non blank panel, or one for all of them */
+        single_panel_writes += (context->device.code_panel_count - blank_panels);
+        multi_panel_writes += (blank_panels != context->device.code_panel_count);
+    }
+
+    /* multi panel writes also latch blank panels, so they must do better than that */
+    return (multi_panel_writes * 2 < single_panel_writes);
+}
+
 /* burn the image to the device */
 int lpp_device_18f2xx_4xx_image_to_device_program(struct lpp_context_t *context, 
                                                   struct lpp_image_t *image)
 {
+    /* all panels are programmed for the price of one, if there's enough to program in them */
+    if (lpp_device_18f2xx_4xx_multi_panel_preferred(context, image))
+        return lpp_device_18f2xx_4xx_image_to_device_program_multi_panel(context, image);
+
     /* start by disabling multipanel writes */
     if (lpp_device_18f2xx_4xx_config_write_start(context) &&
         lpp_write_16(context, 0x3C0006, 0x0000))
@@ -237,39 +332,165 @@ int lpp_device_18f2xx_4xx_image_to_device_program(struct lpp_context_t *context,
     else return 0;
 }
 
-/* read the device eeprom to the image */
-int lpp_device_18f2xx_4xx_device_eeprom_to_image(struct lpp_context_t *context, 
-                                                 struct lpp_image_t *image)
+/* block erase keys, by block. the first block is less the boot block */
+#define LPP_DEVICE_18F2XX_4XX_BOOT_BLOCK_ERASE_KEY  (0x0083)
+#define LPP_DEVICE_18F2XX_4XX_BLOCK_ERASE_KEY(idx)  (0x0088 + (idx))
+
+/* check if all pages of a range are marked */
+static int lpp_device_18f2xx_4xx_pages_marked(struct lpp_context_t *context, 
+                                              const unsigned char *page_erase,
+                                              const unsigned int start_address,
+                                              const unsigned int end_address)
 {
-    unsigned int eeprom_byte_idx, ret;
+    const unsigned int page_size = context->device.code_erase_page_size;
+    unsigned int current_address;
 
-    /* enter EEPROM */
-    ret = lpp_exec_instruction(context, LPP_CLR_EEPGD) &&
-          lpp_exec_instruction(context, LPP_CLR_CFGS);
+    /* any page not marked? */
+    for (current_address = start_address; current_address < end_address; current_address += page_size)
+        if (!page_erase[current_address / page_size]) return 0;
 
-    /* success? */
-    if (ret)
+    /* all marked */
+    return 1;
+}
+
+/* erase only the marked pages, using block erase where a whole block is marked */
+int lpp_device_18f2xx_4xx_erase_pages(struct lpp_context_t *context, 
+                                      const unsigned char *page_erase)
+{
+    const unsigned int page_size = context->device.code_erase_page_size;
+    const unsigned int block_size = context->device.code_panel_size;
+    const unsigned int boot_block_size = context->device.code_boot_block_size;
+    unsigned int current_address, block_idx, block_start, ret;
+    unsigned char *page_left;
+
+    /* pages not taken care of by block erase */
+    page_left = malloc(context->device.code_memory_size / page_size);
+    if (page_left == NULL) return 0;
+    memcpy(page_left, page_erase, context->device.code_memory_size / page_size);
+
+    /* block erase the boot block and every panel whose pages are all marked */
+    for (ret = 1, block_idx = 0; block_idx * block_size < context->device.code_memory_size && ret; ++block_idx)
     {
-        /* start reading, one byte at a time */
-        for (eeprom_byte_idx = 0; 
-              eeprom_byte_idx < context->device.eeprom_bytes && ret; 
-              ++eeprom_byte_idx)
+        /* the boot block has its own key and the first panel starts after it */
+        block_start = (block_idx == 0) ? boot_block_size : (block_idx * block_size);
+
+        /* boot block first */
+        if (block_idx == 0 && boot_block_size && 
+            lpp_device_18f2xx_4xx_pages_marked(context, page_erase, 0, boot_block_size))
         {
-            /* set the EEPROM address pointer (lowest first) */
-            ret = lpp_exec_instruction(context, LPP_OP_MOVLW((eeprom_byte_idx >> 0) & 0xFF))    && 
-                  lpp_exec_instruction(context, LPP_OP_MOVWF(LPP_REG_EEADR))                    && 
-                  lpp_exec_instruction(context, LPP_OP_MOVLW((eeprom_byte_idx >> 8) & 0xFF))    &&
-                  lpp_exec_instruction(context, LPP_OP_MOVWF(LPP_REG_EEADRH));
-
-            /* check if we succeeded */
-            if (ret)
-            {
-                /* do the read into EEDATA, move that into TABLAT and read that */
-                ret = lpp_exec_instruction(context, LPP_SET_EECON1_RD)                      &&
-                      lpp_exec_instruction(context, LPP_MOVF_EEDATA_W)                      &&
-                      lpp_exec_instruction(context, LPP_OP_MOVWF(LPP_REG_TABLAT))           &&
-                      lpp_icsp_read_8(context, LPP_ICSP_CMD_SHIFT_TABLAT_REG, &image->eeprom[eeprom_byte_idx]);
-            }
+            /* erase it and unmark its pages */
+            ret = lpp_write_16(context, 0x3C0004, LPP_DEVICE_18F2XX_4XX_BOOT_BLOCK_ERASE_KEY) && 
+                  lpp_exec_instruction(context, LPP_OP_NOP)                                    &&
+                  lpp_device_bulk_erase_hold(context);
+            memset(page_left, 0, boot_block_size / page_size);
+        }
+
+        /* the rest of the block */
+        if (ret && lpp_device_18f2xx_4xx_pages_marked(context, page_erase, block_start, (block_idx + 1) * block_size))
+        {
+            /* erase it and unmark its pages */
+            ret = lpp_write_16(context, 0x3C0004, LPP_DEVICE_18F2XX_4XX_BLOCK_ERASE_KEY(block_idx)) && 
+                  lpp_exec_instruction(context, LPP_OP_NOP)                                       &&
+                  lpp_device_bulk_erase_hold(context);
+            memset(page_left + (block_start / page_size), 0, ((block_idx + 1) * block_size - block_start) / page_size);
+        }
+    }
+
+    /* pages are erased one at a time, so disable multipanel writes */
+    ret = ret                                                   &&
+          lpp_device_18f2xx_4xx_config_write_start(context)     &&
+          lpp_write_16(context, 0x3C0006, 0x0000);
+
+    /* erase the rest page by page */
+    for (current_address = 0; 
+          current_address < context->device.code_memory_size && ret; 
+          current_address += page_size)
+    {
+        /* erase it, if required */
+        if (page_left[current_address / page_size])
+            ret = lpp_device_18f2xx_4xx_page_erase(context, current_address);
+
+        /* progress notification */
+        if (context->ntfy_progress)
+            context->ntfy_progress(context, current_address + page_size, context->device.code_memory_size);
+    }
+
+    /* free page flags */
+    free(page_left);
+
+    /* return the result */
+    return ret;
+}
+
+/* erase and rewrite only the marked pages */
+int lpp_device_18f2xx_4xx_image_pages_to_device_program(struct lpp_context_t *context, 
+                                                        struct lpp_image_t *image,
+                                                        const unsigned char *page_dirty)
+{
+    const unsigned int page_size = context->device.code_erase_page_size;
+    unsigned int current_address, ret;
+
+    /* pages are erased and written one at a time, so disable multipanel writes */
+    ret = lpp_device_18f2xx_4xx_config_write_start(context) &&
+          lpp_write_16(context, 0x3C0006, 0x0000);
+
+    /* iterate through the pages */
+    for (current_address = 0; 
+          current_address < context->device.code_memory_size && ret; 
+          current_address += page_size)
+    {
+        /* unchanged pages are left alone */
+        if (!page_dirty[current_address / page_size]) continue;
+
+        /* erase the page and write the image into it */
+        ret = lpp_device_18f2xx_4xx_page_erase(context, current_address) &&
+              lpp_device_18f2xxx_4xxx_image_range_to_device_program(context, image, 
+                                                                    current_address, 
+                                                                    current_address + page_size);
+    }
+
+    /* return the result */
+    return ret;
+}
+
+/* set the EEPROM address pointer (lowest first) */
+static int lpp_device_18f2xx_4xx_eeadr_set(struct lpp_context_t *context, 
+                                           const unsigned int address)
+{
+    return lpp_exec_instruction(context, LPP_OP_MOVLW((address >> 0) & 0xFF))    && 
+           lpp_exec_instruction(context, LPP_OP_MOVWF(LPP_REG_EEADR))            && 
+           lpp_exec_instruction(context, LPP_OP_MOVLW((address >> 8) & 0xFF))    &&
+           lpp_exec_instruction(context, LPP_OP_MOVWF(LPP_REG_EEADRH));
+}
+
+/* read a range of the device eeprom, setting the address once and advancing it on chip */
+static int lpp_device_18f2xx_4xx_eeprom_read_stream(struct lpp_context_t *context, 
+                                                    const unsigned int address,
+                                                    unsigned char *data,
+                                                    const unsigned int size)
+{
+    unsigned int byte_idx, ret;
+
+    /* enter EEPROM and point to the first byte */
+    ret = lpp_exec_instruction(context, LPP_CLR_EEPGD)  &&
+          lpp_exec_instruction(context, LPP_CLR_CFGS)   &&
+          lpp_device_18f2xx_4xx_eeadr_set(context, address);
+
+    /* start reading, one byte at a time */
+    for (byte_idx = 0; byte_idx < size && ret; ++byte_idx)
+    {
+        /* do the read into EEDATA, move that into TABLAT and read that */
+        ret = lpp_exec_instruction(context, LPP_SET_EECON1_RD)                      &&
+              lpp_exec_instruction(context, LPP_MOVF_EEDATA_W)                      &&
+              lpp_exec_instruction(context, LPP_OP_MOVWF(LPP_REG_TABLAT))           &&
+              lpp_icsp_read_8(context, LPP_ICSP_CMD_SHIFT_TABLAT_REG, &data[byte_idx]);
+
+        /* advance the address, carrying into the high byte when the low one wraps */
+        if (ret && byte_idx != (size - 1))
+        {
+            ret = lpp_exec_instruction(context, LPP_INC_EEADR);
+            if (ret && ((address + byte_idx + 1) & 0xFF) == 0) 
+                ret = lpp_exec_instruction(context, LPP_INC_EEADRH);
         }
     }
 
@@ -277,13 +498,20 @@ int lpp_device_18f2xx_4xx_device_eeprom_to_image(struct lpp_context_t *context,
     return ret;
 }
 
-/* read the image to device  */
-int lpp_device_18f2xx_4xx_image_to_device_eeprom(struct lpp_context_t *context, 
+/* read the device eeprom to the image */
+int lpp_device_18f2xx_4xx_device_eeprom_to_image(struct lpp_context_t *context, 
                                                  struct lpp_image_t *image)
+{
+    /* all of it, in one stream */
+    return lpp_device_18f2xx_4xx_eeprom_read_stream(context, 0, image->eeprom, context->device.eeprom_bytes);
+}
+
+/* write the image eeprom bytes marked dirty (all if no marks) to the device */
+int lpp_device_18f2xx_4xx_image_bytes_to_device_eeprom(struct lpp_context_t *context, 
+                                                       struct lpp_image_t *image,
+                                                       const unsigned char *byte_dirty)
 {
     unsigned int eeprom_byte_idx, ret;
-    unsigned char eecon1, write_complete;
-    unsigned int eeprom_wait_time_ticks;
 
     /* enter EEPROM */
     ret = lpp_exec_instruction(context, LPP_CLR_EEPGD) &&
@@ -297,12 +525,11 @@ int lpp_device_18f2xx_4xx_image_to_device_eeprom(struct lpp_context_t *context,
               eeprom_byte_idx < context->device.eeprom_bytes && ret; 
               ++eeprom_byte_idx)
         {
-            
-            /* set the EEPROM address pointer (lowest first) */
-            if (lpp_exec_instruction(context, LPP_OP_MOVLW((eeprom_byte_idx >> 0) & 0xFF))    && 
-                lpp_exec_instruction(context, LPP_OP_MOVWF(LPP_REG_EEADR))                    && 
-                lpp_exec_instruction(context, LPP_OP_MOVLW((eeprom_byte_idx >> 8) & 0xFF))    &&
-                lpp_exec_instruction(context, LPP_OP_MOVWF(LPP_REG_EEADRH)))
+            /* skip bytes that needn't be written */
+            if (byte_dirty && !byte_dirty[eeprom_byte_idx]) continue;
+
+            /* set the EEPROM address pointer */
+            if (lpp_device_18f2xx_4xx_eeadr_set(context, eeprom_byte_idx))
             {
                 /* write the byte */
                 ret = lpp_exec_instruction(context, LPP_OP_MOVLW(image->eeprom[eeprom_byte_idx])) &&
@@ -312,34 +539,13 @@ int lpp_device_18f2xx_4xx_image_to_device_eeprom(struct lpp_context_t *context,
                       lpp_exec_instruction(context, LPP_OP_MOVWF(LPP_REG_EECON2))                 && 
                       lpp_exec_instruction(context, LPP_OP_MOVLW(0xAA))                           &&
                       lpp_exec_instruction(context, LPP_OP_MOVWF(LPP_REG_EECON2))                 &&
-                      lpp_exec_instruction(context, LPP_SET_EECON1_WR);
-                
-                /* init write compelte */
-                write_complete = 0;
-
-                /* while WR bit is set to 1 and not timed out */
-                for (eeprom_wait_time_ticks = 100;
-                     ret && !write_complete && eeprom_wait_time_ticks;
-                     eeprom_wait_time_ticks--)
-                {
-                    /* get WR bit */
-                    ret = (lpp_exec_instruction(context, LPP_MOVF_EECON1_W)                      &&
-                           lpp_exec_instruction(context, LPP_OP_MOVWF(LPP_REG_TABLAT))           &&
-                           lpp_icsp_read_8(context, LPP_ICSP_CMD_SHIFT_TABLAT_REG, &eecon1));
-
-                    /* if we read OK, check if write complete */
-                    if (ret) 
-                    {
-                        /* check if WR clear */
-                        write_complete = ((eecon1 & 0x2) == 0);
-
-                        /* wait a bit */
-                        if (!write_complete) usleep(1000);
-                    }
-                }
-
-                /* if timed out, return error */
-                ret = (ret && (eeprom_wait_time_ticks == 0) ? 0 : 1);
+                      lpp_exec_instruction(context, LPP_SET_EECON1_WR)                            &&
+                      lpp_device_eeprom_write_wait(context);
+            }
+            else
+            {
+                /* failed to set the address */
+                ret = 0;
             }
         }
 
@@ -351,17 +557,28 @@ int lpp_device_18f2xx_4xx_image_to_device_eeprom(struct lpp_context_t *context,
     return ret;
 }
 
+/* write the image eeprom to the device */
+int lpp_device_18f2xx_4xx_image_to_device_eeprom(struct lpp_context_t *context, 
+                                                 struct lpp_image_t *image)
+{
+    /* every byte */
+    return lpp_device_18f2xx_4xx_image_bytes_to_device_eeprom(context, image, NULL);
+}
+
 /* operations */
 struct lpp_device_group_t lpp_device_18f2xx_4xx = 
 {
     .open                       = lpp_device_18f2xx_4xx_open,
     .bulk_erase                 = lpp_device_18f2xx_4xx_bulk_erase,
     .non_bulk_erase             = lpp_device_18f2xx_4xx_non_bulk_erase,
+    .image_pages_to_device_program = lpp_device_18f2xx_4xx_image_pages_to_device_program,
+    .erase_pages                = lpp_device_18f2xx_4xx_erase_pages,
     .image_to_device_program    = lpp_device_18f2xx_4xx_image_to_device_program,
     .image_to_device_config     = lpp_device_18f2xx_4xx_image_to_device_config,
     .code_write_start           = lpp_device_18f2xx_4xx_code_write_start,
     .config_write_start         = lpp_device_18f2xx_4xx_config_write_start,
     .device_eeprom_to_image     = lpp_device_18f2xx_4xx_device_eeprom_to_image,
-    .image_to_device_eeprom     = lpp_device_18f2xx_4xx_image_to_device_eeprom
+    .image_to_device_eeprom     = lpp_device_18f2xx_4xx_image_to_device_eeprom,
+    .image_bytes_to_device_eeprom = lpp_device_18f2xx_4xx_image_bytes_to_device_eeprom
 };
 
@@ -10,7 +10,6 @@
  *
  */
 
-#include <unistd.h>
 #include "lpicp.h"
 #include "lpicp_device.h"
 #include "lpicp_icsp.h"
@@ -19,6 +18,8 @@
 /* start writing to code memory */
 int lpp_device_18f2xx_4xx_code_write_start(struct lpp_context_t *context);
 
+/* a row that fails to verify is programmed once more before giving up */
+
 /* initialize */
 int lpp_device_18f2xxx_4xxx_open(struct lpp_context_t *context)
 {
@@ -26,6 +27,20 @@ int lpp_device_18f2xxx_4xxx_open(struct lpp_context_t *context)
     context->device.code_words_per_write    = 16;
     context->device.code_memory_size        = 64 * 1024;
 
+    /* programming timing (DS39622) */
+    context->device.timing_datasheet.p9_us             = 1000;
+    context->device.timing_datasheet.p10_us            = 100;
+    context->device.timing_datasheet.p11_us            = 5000;
+    context->device.timing_datasheet.erase_p10_us      = 100;
+    context->device.timing_datasheet.eeprom_poll_us    = 1000;
+    context->device.timing_datasheet.eeprom_write_max_us = 8000;
+
+    /* what lpicp has always used: 5us after programming, 200us and a 20us settle after erasing, 100 EEPROM polls */
+    context->device.timing_default                     = context->device.timing_datasheet;
+    context->device.timing_default.p10_us              = 5;
+    context->device.timing_default.erase_p10_us        = 220;
+    context->device.timing_default.eeprom_write_max_us = 100000;
+
     /* success */ 
     return 0;
 }
@@ -33,33 +48,10 @@ int lpp_device_18f2xxx_4xxx_open(struct lpp_context_t *context)
 /* perform bulk erase */
 int lpp_device_18f2xxx_4xxx_bulk_erase(struct lpp_context_t *context)
 {
-    /* start the transaction */
-    if (lpp_write_16(context, 0x3C0005, 0x3F3F) && 
-        lpp_write_16(context, 0x3C0004, 0x8F8F))
-    {
-        /* set up the transaction */
-        struct mc_icsp_cmd_only_t cmd_config = 
-        {
-            .command = 0x0,
-            .pgc_value_after_cmd = 0,
-            .pgd_value_after_cmd = 0,
-            .mdelay = 5, /* P11 */
-            .udelay = 0 
-        };
-
-        /* do the command only transaction */
-        if (lpp_icsp_command_only(context, &cmd_config))
-        {
-            /* wait P10 */
-            usleep(200);
-
-            /* success */
-            return 1;
-        }
-    }
-
-    /* failed for some reason */
-    return 0;
+    /* start the transaction, then hold P11 and wait P10 */
+    return lpp_write_16(context, 0x3C0005, 0x3F3F)     && 
+           lpp_write_16(context, 0x3C0004, 0x8F8F)     &&
+           lpp_device_bulk_erase_hold(context);
 }
 
 /* start writing to code memory */
@@ -86,68 +78,80 @@ int lpp_device_18f2xxx_4xxx_image_to_device_config(struct lpp_context_t *context
     return 0;
 }
 
-/* burn the image to the device */
-int lpp_device_18f2xxx_4xxx_image_to_device_program(struct lpp_context_t *context, 
-                                                    struct lpp_image_t *image)
+/* burn a range of the image to the device */
+int lpp_device_18f2xxx_4xxx_image_range_to_device_program(struct lpp_context_t *context, 
+                                                          struct lpp_image_t *image,
+                                                          const unsigned int start_address,
+                                                          const unsigned int end_address)
 {
     int ret;
-    unsigned int words_left, words_to_write, word_index;
-    unsigned short current_address, *current_data;
+    unsigned int words_to_write, word_index;
+    unsigned int current_address;
 
-    /* point to start data */
-    current_data = (unsigned short *)image->contents;
-
-    /* the amount of words left to write is (bytes / 2) + 1 if odd number of bytes */
-    lpp_image_get_content_size_in_words(image, &words_left);
+    /* get words per writes */
+    const unsigned int write_buffer_size_in_words = context->device.code_words_per_write;
 
     /* start by entering code programming mode */
     ret = lpp_device_18f2xx_4xx_code_write_start(context);
 
-    /* while there are bytes left to write */
-    for (current_address = 0; words_left && ret; words_left -= words_to_write)
+    /* write each block holding populated contents, skipping the holes between them */
+    for (current_address = start_address; 
+         ret && lpp_image_block_next(context, image, write_buffer_size_in_words * 2, &current_address) && 
+            current_address < end_address && current_address < image->contents_size;
+        )
     {
-        /* get words per writes */
-        unsigned int write_buffer_size_in_words = context->device.code_words_per_write;
-
-        /* do we have enough data to fill a buffer? if not, just write whatever's left */
-        words_to_write = (write_buffer_size_in_words < words_left) ? 
-                            write_buffer_size_in_words : words_left;
-
-        /* set the current address */
-        ret = lpp_tblptr_set(context, current_address);
-
-        /* fill the write buffer and write it */
-        for (word_index = 0; (word_index < words_to_write) && ret; ++word_index, current_address += 2)
-        { 
-            /* we don't increment the tblptr on the last word, so says the progspec */
-            unsigned char command = (word_index != (words_to_write - 1)) ? 
-                                        LPP_ICSP_CMD_TBL_WR_POST_INC_2 : LPP_ICSP_CMD_TBL_WR_PROG;
+        /* always write a full buffer, past the contents is erased */
+        words_to_write = write_buffer_size_in_words;
 
-            /* write data */
-            ret = lpp_icsp_write_16(context, command, *current_data++);
+        /* programming erased words changes nothing - skip the whole write if that's all there is */
+        if (lpp_image_is_blank(context, image, current_address, words_to_write * 2))
+        {
+            /* next block */
+            current_address += words_to_write * 2;
         }
-
-        /* perform the special nop procedure after programming */
-        if (ret)
+        else
         {
-            /* set up the transaction */
-            struct mc_icsp_cmd_only_t cmd_config = 
+            unsigned int attempts_left;
+            int retry;
+            const unsigned int block_address = current_address;
+
+            /* write the block, reading it back if asked to */
+            for (retry = 1, attempts_left = LPP_DEVICE_ROW_ATTEMPTS; retry && attempts_left; --attempts_left)
             {
-                .command = 0x0,
-                .pgc_value_after_cmd = 1,
-                .pgd_value_after_cmd = 0,
-                .mdelay = 1, /* P9 */
-                .udelay = 0
-            };
-
-            /* send special command only, then wait P10, then 16 0s of data */
-            ret = lpp_icsp_command_only(context, &cmd_config)   && 
-                    lpp_icsp_delay_us(context, 5)               && 
-                    lpp_icsp_data_only(context, 0x0);
-
-            /* progress notification */
-            if (context->ntfy_progress)
-                context->ntfy_progress(context, current_address, image->contents_size);
+                /* another go? */
+                if (attempts_left != LPP_DEVICE_ROW_ATTEMPTS) 
+                {
+                    context->row_verify_retries++;
+                    lpp_stats_retry(context);
+                }
+                retry = 0;
+
+                /* set the current address */
+                ret = lpp_tblptr_set(context, block_address);
+
+                /* fill the write buffer and write it */
+                for (word_index = 0, current_address = block_address; 
+                     (word_index < words_to_write) && ret; 
+                     ++word_index, current_address += 2)
+                { 
+                    /* we don't increment the tblptr on the last word, so says the progspec */
+                    unsigned char command = (word_index != (words_to_write - 1)) ? 
+                                                LPP_ICSP_CMD_TBL_WR_POST_INC_2 : LPP_ICSP_CMD_TBL_WR_PROG;
+
+                    /* write data */
+                    ret = lpp_icsp_write_16(context, command, lpp_image_word(image, current_address));
+                }
+
+                /* perform the special nop procedure after programming */
+                if (ret) ret = lpp_device_program_hold(context);
+
+                /* 
+                 * read it back, a bad row is programmed again and then fails the write. 
+                 * a read that failed says nothing about the row, and fails it right away 
+                 */
+                if (ret && context->row_verify) 
+                    ret = lpp_device_row_verify(context, image, block_address, words_to_write * 2, &retry);
+            }
         }
 
         /* progress notification */
@@ -159,6 +163,14 @@ int lpp_device_18f2xxx_4xxx_image_to_device_program(struct lpp_context_t *contex
     return ret;
 }
 
+/* burn the image to the device */
+int lpp_device_18f2xxx_4xxx_image_to_device_program(struct lpp_context_t *context, 
+                                                    struct lpp_image_t *image)
+{
+    /* the whole of it */
+    return lpp_device_18f2xxx_4xxx_image_range_to_device_program(context, image, 0, image->contents_size);
+}
+
 /* operations */
 struct lpp_device_group_t lpp_device_18f2xxx_4xxx = 
 {
@@ -10,7 +10,7 @@
  *
  */
 
-#include <unistd.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include "lpicp.h"
@@ -18,33 +18,78 @@
 #include "lpicp_icsp.h"
 #include "lpicp_image.h"
 #include "lpicp_device.h"
+#include "lpicp_capture.h"
+
+/* number of bytes read between progress notifications */
+#define LPP_READ_CHUNK_SIZE (1024)
 
 /* initialize a context */
 int lpp_context_init(struct lpp_context_t *context,
                      const enum lpp_device_family_type_t family,
+                     const enum lpp_transport_type_t transport_type,
                      char *icsp_dev_name,
                      ntfy_progress_t ntfy_progress)
+{
+    /* nothing to capture to */
+    return lpp_context_init_session(context, family, transport_type, icsp_dev_name, ntfy_progress, NULL, 0);
+}
+
+/* initialize a context, capturing and logging every transfer */
+int lpp_context_init_session(struct lpp_context_t *context, 
+                             const enum lpp_device_family_type_t family,
+                             const enum lpp_transport_type_t transport_type,
+                             char *icsp_dev_name,
+                             ntfy_progress_t ntfy_progress,
+                             const char *capture_file_name,
+                             const unsigned int log_record_count)
 {
     /* init structure */
     memset(context, 0, sizeof(struct lpp_context_t));
 
-    /* try to open the driver */
-    if (lpp_icsp_init(context, icsp_dev_name))
-    {    
-        /* save callbacks and data */
-        context->ntfy_progress = ntfy_progress;
+    /* count from here, detecting the device */
+    lpp_stats_init(context);
 
-        /* try to get the device */
-        return lpp_device_init_by_family(context, family);
+    /* capture and log detection too */
+    if (capture_file_name && !lpp_capture_start(context, capture_file_name)) goto err_capture_start;
+    if (log_record_count && !lpp_log_init(context, log_record_count))
+    {
+        /* failed */
+        printf("Failed to allocate the transfer log\n");
+        goto err_log_init;
     }
-    else return 0;
+
+    /* try to open the driver */
+    if (!lpp_icsp_init(context, transport_type, icsp_dev_name)) goto err_icsp_init;
+
+    /* save callbacks and data */
+    context->ntfy_progress = ntfy_progress;
+
+    /* try to get the device */
+    if (!lpp_device_init_by_family(context, family)) goto err_device_init;
+
+    /* success */
+    return 1;
+
+err_device_init:
+    lpp_icsp_destroy(context);
+err_icsp_init:
+    lpp_log_destroy(context);
+err_log_init:
+    lpp_capture_stop(context);
+err_capture_start:
+    return 0;
 }
 
 /* destroy a context */
 int lpp_context_destroy(struct lpp_context_t *context)
 {
-    /* try to close the driver */
-    return lpp_icsp_destroy(context);
+    int ret;
+
+    /* try to close the driver, pushing anything still queued */
+    ret = lpp_icsp_destroy(context);
+
+    /* only then is the capture complete */
+    return lpp_capture_stop(context) && ret;
 }
 
 /* execute an instruction */
@@ -55,17 +100,69 @@ int lpp_exec_instruction(struct lpp_context_t *context,
     return lpp_icsp_write_16(context, LPP_ICSP_CMD_CORE_INST, instuction);
 }
 
+/* read TBLPTR back from the device and compare it to the shadow */
+static int lpp_tblptr_check(struct lpp_context_t *context)
+{
+    const unsigned char tblptr_regs[] = {LPP_REG_TBLPTRU, LPP_REG_TBLPTRH, LPP_REG_TBLPTRL};
+    unsigned int reg_idx, device_tblptr = 0;
+    unsigned char value;
+
+    /* read each byte through TABLAT */
+    for (reg_idx = 0; reg_idx < sizeof(tblptr_regs); ++reg_idx)
+    {
+        /* move it to TABLAT and shift it out */
+        if (!lpp_exec_instruction(context, LPP_OP_MOVF_W(tblptr_regs[reg_idx]))        ||
+            !lpp_exec_instruction(context, LPP_OP_MOVWF(LPP_REG_TABLAT))               ||
+            !lpp_icsp_read_8(context, LPP_ICSP_CMD_SHIFT_TABLAT_REG, &value)) return 0;
+
+        /* accumulate */
+        device_tblptr = (device_tblptr << 8) | value;
+    }
+
+    /* compare */
+    if (device_tblptr != context->tblptr_shadow)
+    {
+        /* shadow went wrong somewhere */
+        printf("TBLPTR shadow mismatch: expected %06X, device has %06X\n", 
+               context->tblptr_shadow, device_tblptr);
+
+        /* failed */
+        return 0;
+    }
+
+    /* success */
+    return 1;
+}
+
 /* set tbpltr register */
 int lpp_tblptr_set(struct lpp_context_t *context, 
                    const unsigned int value)
 {
-    /* set TBLPTRU, TBLPTRH and TBLPTRL */
-    return lpp_exec_instruction(context, LPP_OP_MOVLW((value >> 16) & 0xFF))    && 
-            lpp_exec_instruction(context, LPP_OP_MOVWF(LPP_REG_TBLPTRU))        && 
-            lpp_exec_instruction(context, LPP_OP_MOVLW((value >> 8) & 0xFF))    &&
-            lpp_exec_instruction(context, LPP_OP_MOVWF(LPP_REG_TBLPTRH))        && 
-            lpp_exec_instruction(context, LPP_OP_MOVLW((value >> 0) & 0xFF))    &&
-            lpp_exec_instruction(context, LPP_OP_MOVWF(LPP_REG_TBLPTRL));
+    const unsigned char tblptr_regs[] = {LPP_REG_TBLPTRU, LPP_REG_TBLPTRH, LPP_REG_TBLPTRL};
+    const unsigned int current_value = context->tblptr_shadow;
+    const int current_valid = context->tblptr_shadow_valid;
+    unsigned int reg_idx, shift;
+
+    /* make sure the shadow is right, if asked to */
+    if (current_valid && context->tblptr_shadow_check && !lpp_tblptr_check(context)) return 0;
+
+    /* set TBLPTRU, TBLPTRH and TBLPTRL - only those that differ from what the device holds */
+    for (reg_idx = 0, shift = 16; reg_idx < sizeof(tblptr_regs); ++reg_idx, shift -= 8)
+    {
+        /* already there? */
+        if (current_valid && ((current_value >> shift) & 0xFF) == (((value & LPP_TBLPTR_MASK) >> shift) & 0xFF)) continue;
+
+        /* load it */
+        if (!lpp_exec_instruction(context, LPP_OP_MOVLW((value >> shift) & 0xFF))   ||
+            !lpp_exec_instruction(context, LPP_OP_MOVWF(tblptr_regs[reg_idx]))) return 0;
+    }
+
+    /* device now holds the value */
+    context->tblptr_shadow = (value & LPP_TBLPTR_MASK);
+    context->tblptr_shadow_valid = 1;
+
+    /* success */
+    return 1;
 }
 
 /* write 16 bits of data to a specified address */
@@ -78,21 +175,30 @@ int lpp_write_16(struct lpp_context_t *context,
             lpp_icsp_write_16(context, LPP_ICSP_CMD_TBL_WR_POST_INC, data);
 }
 
+/* read a block of data from a specified address */
+int lpp_read_block(struct lpp_context_t *context, 
+                   const unsigned int address, 
+                   unsigned char *data, 
+                   const unsigned int size)
+{
+    /* set TBLPTR and then read, auto incrementing */
+    return lpp_tblptr_set(context, address) && 
+            lpp_icsp_read_block(context, LPP_ICSP_CMD_TBL_RD_POST_INC, data, size);
+}
+
 /* read 16 bits of data from a specified address */
 int lpp_read_16(struct lpp_context_t *context, 
                  const unsigned int address, 
                  unsigned short *data)    
 {
-    unsigned char lsb, msb;
+    unsigned char bytes[2];
     int ret = 0;
 
-    /* set TBLPTR and then execute the write */
-    if (lpp_tblptr_set(context, address) && 
-            lpp_icsp_read_8(context, LPP_ICSP_CMD_TBL_RD_POST_INC, &lsb) &&
-            lpp_icsp_read_8(context, LPP_ICSP_CMD_TBL_RD_POST_INC, &msb))
+    /* read both bytes */
+    if (lpp_read_block(context, address, bytes, sizeof(bytes)))
     {
         /* set data */
-        *data = (msb | ((lsb & 0xFF) << 8));
+        *data = (bytes[1] | (bytes[0] << 8));
 
         /* set result code to success */
         ret = 1;
@@ -108,51 +214,77 @@ int lpp_read_device_program_to_image(struct lpp_context_t *context,
                                      const unsigned int size_in_bytes,
                                      struct lpp_image_t *image)
 {
-    unsigned short *current_position;
-    unsigned int words_left, total_words, ret;
+    /* nobody to hand chunks to */
+    return lpp_read_device_program_stream(context, offset, size_in_bytes, image, NULL, NULL);
+}
 
-    /* success by default */
-    ret = 1;
+/* read the image program from the device, handing off each chunk */
+int lpp_read_device_program_stream(struct lpp_context_t *context, 
+                                   const unsigned int offset,
+                                   const unsigned int size_in_bytes,
+                                   struct lpp_image_t *image,
+                                   lpp_read_chunk_t chunk_read,
+                                   void *chunk_read_arg)
+{
+    unsigned int total_bytes, ret, current_position, chunk_size;
 
-    /* point to start of buffer */
-    current_position = (unsigned short *)image->contents;
+    /* contents are kept at their device address. start on a word boundary, end on one */
+    const unsigned int start_address = (offset & ~1);
+    const unsigned int end_address = ((offset + size_in_bytes + 1) & ~1);
 
-    /* save the size */
-    image->contents_size = size_in_bytes;
+    /* success by default */
+    ret = 1;
 
-    /* make sure we have room */
-    if (image->contents_size <= image->max_contents_size)
+    /* make sure we have room, and mark the range as populated */
+    if (end_address <= image->max_contents_size                  && 
+        lpp_image_reserve(context, image, end_address)           &&
+        lpp_image_extent_add(context, image, offset, size_in_bytes))
     {
-        /* the amount of words left to write is (bytes / 2) + 1 if odd number of bytes */
-        lpp_image_get_content_size_in_words(image, &total_words);
+        /* the image now holds at least this much */
+        if (offset + size_in_bytes > image->contents_size) 
+            image->contents_size = offset + size_in_bytes;
+
+        /* whole words are read */
+        total_bytes = end_address - start_address;
     
         /* set the current address (auto increment) */
-        ret = lpp_tblptr_set(context, offset);
+        ret = lpp_tblptr_set(context, start_address);
     
-        /* start reading, two bytes at a time */
-        for (words_left = total_words; words_left && ret; --words_left, ++current_position)
+        /* read straight into the image, a chunk at a time */
+        for (current_position = start_address; current_position < end_address && ret; current_position += chunk_size)
         {
-            unsigned short read_word = 0;
-            unsigned char msb, lsb;
-    
+            unsigned int byte_idx;
+
+            /* read a chunk, or whatever's left */
+            chunk_size = (end_address - current_position < LPP_READ_CHUNK_SIZE) ? 
+                            (end_address - current_position) : LPP_READ_CHUNK_SIZE;
+
             /* read the data */
-            ret = lpp_icsp_read_8(context, LPP_ICSP_CMD_TBL_RD_POST_INC, &lsb) && 
-                  lpp_icsp_read_8(context, LPP_ICSP_CMD_TBL_RD_POST_INC, &msb);
+            ret = lpp_icsp_read_block(context, LPP_ICSP_CMD_TBL_RD_POST_INC, 
+                                      &image->contents[current_position], chunk_size);
     
-            /* make sure its in the correct order */
-            read_word = ((msb << 8) | lsb);
-    
-            /* save */
-            *current_position = read_word;
+            /* device is little endian, make sure words are in the correct order */
+            for (byte_idx = current_position; byte_idx < current_position + chunk_size; byte_idx += 2)
+            {
+                /* lsb was read first */
+                unsigned short read_word = (image->contents[byte_idx + 1] << 8) | image->contents[byte_idx];
+
+                /* save */
+                lpp_image_word_set(image->contents, byte_idx, read_word);
+            }
+
+            /* hand it off */
+            if (ret && chunk_read) 
+                ret = chunk_read(context, image, current_position, chunk_size, chunk_read_arg);
     
             /* progress notification */
             if (ret && context->ntfy_progress)
-                context->ntfy_progress(context, (total_words - words_left) * 2, size_in_bytes);
+                context->ntfy_progress(context, current_position - start_address, total_bytes);
         }
     
         /* progress notification */
         if (ret && context->ntfy_progress)
-            context->ntfy_progress(context, size_in_bytes, size_in_bytes);
+            context->ntfy_progress(context, total_bytes, total_bytes);
     }
     else
     {
@@ -164,25 +296,147 @@ int lpp_read_device_program_to_image(struct lpp_context_t *context,
     return ret;
 }
 
+/* compare bytes read from the device at some address, returns 0 once enough mismatches are found */
+static int lpp_verify_compare(struct lpp_verify_result_t *result, 
+                              const unsigned int max_mismatches,
+                              const unsigned int address, 
+                              const unsigned char expected, 
+                              const unsigned char actual)
+{
+    struct lpp_verify_mismatch_t *mismatch;
+
+    /* same? */
+    if (expected == actual) return 1;
+
+    /* keep it */
+    mismatch = &result->mismatches[result->mismatch_count++];
+    mismatch->address = address;
+    mismatch->expected = expected;
+    mismatch->actual = actual;
+
+    /* enough? */
+    return (result->mismatch_count < max_mismatches);
+}
+
+/* verify an image against the device */
+int lpp_verify_image(struct lpp_context_t *context, 
+                     struct lpp_image_t *image,
+                     const unsigned int flags,
+                     const unsigned int max_mismatches,
+                     struct lpp_verify_result_t *result)
+{
+    const unsigned int mismatch_limit = (max_mismatches && max_mismatches < LPP_VERIFY_MAX_MISMATCHES) ? 
+                                            max_mismatches : LPP_VERIFY_MAX_MISMATCHES;
+    unsigned char chunk[LPP_READ_CHUNK_SIZE], config[LPP_MAX_CONFIG_BYTES];
+    struct lpp_image_t *eeprom_image;
+    struct lpp_image_extent_t *extent;
+    unsigned int address, chunk_start, chunk_end, total_bytes, ret, more, byte_idx;
+
+    /* zero out result */
+    memset(result, 0, sizeof(*result));
+
+    /* for progress */
+    total_bytes = 0;
+    lpp_image_for_each_extent(image, extent) total_bytes += (extent->end - extent->start);
+
+    /* each populated range, whole words at a time */
+    for (ret = more = 1, extent = image->extents; 
+         ret && more && (flags & LPP_VERIFY_PROGRAM) && extent < image->extents + image->extent_count; 
+         ++extent)
+    {
+        /* read it in chunks, comparing each as it comes */
+        for (chunk_start = (extent->start & ~1); ret && more && chunk_start < extent->end; chunk_start = chunk_end)
+        {
+            /* up to a chunk */
+            chunk_end = ((extent->end + 1) & ~1);
+            if (chunk_end - chunk_start > sizeof(chunk)) chunk_end = chunk_start + sizeof(chunk);
+
+            /* read it */
+            ret = lpp_read_block(context, chunk_start, chunk, chunk_end - chunk_start);
+
+            /* compare what's in the range. image words are msb first, the device's lsb first */
+            for (address = (chunk_start > extent->start ? chunk_start : extent->start); 
+                 ret && more && address < chunk_end && address < extent->end; 
+                 ++address, result->program_bytes++)
+            {
+                more = lpp_verify_compare(result, mismatch_limit, address, 
+                                          lpp_image_byte(image, address), chunk[address - chunk_start]);
+            }
+
+            /* progress notification */
+            if (ret && context->ntfy_progress)
+                context->ntfy_progress(context, result->program_bytes, total_bytes);
+        }
+    }
+
+    /* the valid config bytes, only their implemented bits */
+    if (ret && more && (flags & LPP_VERIFY_CONFIG) && image->config_valid)
+    {
+        /* read them all */
+        ret = lpp_read_block(context, context->device.config_address, config, context->device.config_bytes);
+
+        /* compare */
+        for (byte_idx = 0; ret && more && byte_idx < context->device.config_bytes; ++byte_idx)
+        {
+            const unsigned char mask = context->device.config_mask ? context->device.config_mask[byte_idx] : 0xFF;
+
+            /* valid? */
+            if (!(image->config_valid & (1 << byte_idx))) continue;
+
+            /* compare */
+            more = lpp_verify_compare(result, mismatch_limit, context->device.config_address + byte_idx, 
+                                      image->config[byte_idx] & mask, config[byte_idx] & mask);
+            result->config_bytes++;
+        }
+    }
+
+    /* the eeprom is read through an image of its own, with no program contents */
+    if (ret && more && (flags & LPP_VERIFY_EEPROM) && context->device.eeprom_bytes)
+    {
+        /* allocate it */
+        eeprom_image = malloc(sizeof(*eeprom_image));
+        ret = (eeprom_image != NULL)                                            && 
+              lpp_image_init(context, eeprom_image, 0)                          &&
+              lpp_read_device_eeprom_to_image(context, eeprom_image);
+
+        /* compare */
+        for (byte_idx = 0; ret && more && byte_idx < context->device.eeprom_bytes; ++byte_idx)
+        {
+            /* defined? */
+            if ((flags & LPP_VERIFY_EEPROM_DEFINED) && !lpp_image_eeprom_valid(image, byte_idx)) continue;
+
+            /* compare */
+            result->eeprom_bytes++;
+            more = lpp_verify_compare(result, mismatch_limit, context->device.eeprom_address + byte_idx, 
+                                      image->eeprom[byte_idx], eeprom_image->eeprom[byte_idx]);
+        }
+
+        /* free it */
+        if (eeprom_image) lpp_image_destroy(context, eeprom_image);
+        free(eeprom_image);
+    }
+
+    /* return whether the device could be read */
+    return ret;
+}
+
 /* read the image config from the device */
 int lpp_read_device_config_to_image(struct lpp_context_t *context,
                                     struct lpp_image_t *image)
 {
     unsigned int ret, config_byte_idx;
 
-    /* set the config address */
-    ret = lpp_tblptr_set(context, context->device.config_address);
+    /* read all config bytes */
+    ret = lpp_read_block(context, 
+                         context->device.config_address, 
+                         image->config, 
+                         context->device.config_bytes);
 
-    /* start reading, two bytes at a time */
+    /* set the appropriate config bytes */
     for (config_byte_idx = 0; 
           config_byte_idx < context->device.config_bytes && ret; 
           ++config_byte_idx)
     {
-        /* read the data */
-        ret = lpp_icsp_read_8(context, 
-                              LPP_ICSP_CMD_TBL_RD_POST_INC, 
-                              &image->config[config_byte_idx]);
-
         /* set the appropriate config byte */
         image->config_valid |= (1 << config_byte_idx);
     }
@@ -203,52 +457,283 @@ int lpp_read_device_eeprom_to_image(struct lpp_context_t *context,
 int lpp_read_image_to_device_eeprom(struct lpp_context_t *context,
                                     struct lpp_image_t *image)
 {
-    /* delegate to device */
-    return context->device.group->image_to_device_eeprom(context, image);
+    /* delegate to device and make sure everything was sent */
+    return context->device.group->image_to_device_eeprom(context, image) && 
+           lpp_icsp_flush(context);
+}
+
+/* write an image to device eeprom, skipping bytes according to the write mode */
+int lpp_write_image_to_device_eeprom_selective(struct lpp_context_t *context, 
+                                               struct lpp_image_t *image,
+                                               const unsigned int flags,
+                                               struct lpp_eeprom_write_stats_t *stats)
+{
+    struct lpp_image_t *current_image = NULL;
+    unsigned char byte_dirty[LPP_MAX_EEPROM_BYTES];
+    unsigned int byte_idx;
+    int ret;
+
+    /* zero out stats */
+    memset(stats, 0, sizeof(*stats));
+
+    /* nothing to write if there's no eeprom */
+    if (context->device.eeprom_bytes == 0) return 1;
+
+    /* read all of what the device currently holds up front, rather than between writes */
+    if (flags & LPP_EEPROM_WRITE_CHANGED)
+    {
+        /* allocate an image of its own, with no program contents */
+        current_image = malloc(sizeof(*current_image));
+        if (current_image == NULL) goto err_alloc_current_image;
+
+        /* read into it */
+        ret = lpp_image_init(context, current_image, 0) && 
+              lpp_read_device_eeprom_to_image(context, current_image);
+
+        /* check */
+        if (!ret) goto err_read_current_image;
+    }
+
+    /* mark the bytes to write */
+    for (byte_idx = 0; byte_idx < context->device.eeprom_bytes; ++byte_idx)
+    {
+        /* assume it's skipped */
+        byte_dirty[byte_idx] = 0;
+
+        /* skip bytes the source didn't define, or that the device already holds */
+        if ((flags & LPP_EEPROM_WRITE_DEFINED) && !lpp_image_eeprom_valid(image, byte_idx))
+            stats->bytes_undefined++;
+        else if (current_image && current_image->eeprom[byte_idx] == image->eeprom[byte_idx])
+            stats->bytes_unchanged++;
+        else
+        {
+            /* write it */
+            byte_dirty[byte_idx] = 1;
+            stats->bytes_written++;
+        }
+    }
+
+    /* write them, if there's any */
+    ret = (stats->bytes_written == 0) || 
+          (context->device.group->image_bytes_to_device_eeprom(context, image, byte_dirty) && 
+           lpp_icsp_flush(context));
+
+err_read_current_image:
+    if (current_image) lpp_image_destroy(context, current_image);
+    free(current_image);
+    return ret;
+
+err_alloc_current_image:
+    return 0;
 }
 
 /* write an image to the device */
 int lpp_write_image_to_device_program(struct lpp_context_t *context, struct lpp_image_t *image)
 {
-    /* delegate to device */
-    return context->device.group->image_to_device_program(context, image);
+    /* delegate to device and make sure everything was sent */
+    return context->device.group->image_to_device_program(context, image) && 
+           lpp_icsp_flush(context);
+}
+
+/* read back every erase page an image populates */
+int lpp_read_device_program_pages_to_image(struct lpp_context_t *context, 
+                                           struct lpp_image_t *pattern,
+                                           struct lpp_image_t *image)
+{
+    const unsigned int page_size = context->device.code_erase_page_size;
+    unsigned int start_address, end_address, ret;
+
+    /* success by default */
+    ret = 1;
+
+    /* find runs of consecutive populated pages */
+    for (start_address = 0; 
+         ret && lpp_image_block_next(context, pattern, page_size, &start_address) && 
+            start_address < pattern->contents_size; 
+         start_address = end_address)
+    {
+        /* extend the run while the next page is populated too */
+        for (end_address = start_address + page_size; 
+             end_address < pattern->contents_size && end_address < context->device.code_memory_size; 
+             end_address += page_size)
+        {
+            unsigned int next_address = end_address;
+
+            /* stop at a hole */
+            if (!lpp_image_block_next(context, pattern, page_size, &next_address) || 
+                next_address != end_address) break;
+        }
+
+        /* read the run */
+        ret = lpp_read_device_program_to_image(context, start_address, end_address - start_address, image);
+    }
+
+    /* return result */
+    return ret;
+}
+
+/* write an image to the device program, rewriting only the pages that changed */
+int lpp_write_image_to_device_program_incremental(struct lpp_context_t *context, 
+                                                  struct lpp_image_t *image,
+                                                  struct lpp_image_t *current_image,
+                                                  struct lpp_incremental_stats_t *stats)
+{
+    const unsigned int page_size = context->device.code_erase_page_size;
+    const unsigned int buffer_size = context->device.code_words_per_write * 2;
+    const unsigned int hold_us = context->device.timing.p9_us + context->device.timing.p10_us;
+    unsigned int page_address, byte_offset, ret;
+    unsigned char *page_dirty;
+
+    /* zero out stats */
+    memset(stats, 0, sizeof(*stats));
+
+    /* device must be able to erase and write single pages */
+    if (context->device.group->image_pages_to_device_program == NULL || page_size == 0)
+    {
+        /* not supported */
+        printf("Incremental writes aren't supported for %s\n", context->device.name);
+        goto err_not_supported;
+    }
+
+    /* one flag per page */
+    page_dirty = calloc(context->device.code_memory_size / page_size, 1);
+    if (page_dirty == NULL) goto err_alloc_page_dirty;
+
+    /* mark the populated pages that differ from what's on the device */
+    for (page_address = 0; 
+         lpp_image_block_next(context, image, page_size, &page_address) && 
+            page_address < image->contents_size && page_address < context->device.code_memory_size; 
+         page_address += page_size)
+    {
+        /* one more page to consider */
+        stats->page_count++;
+
+        /* compare word by word. both are erased past their contents */
+        for (byte_offset = page_address; byte_offset < page_address + page_size; byte_offset += 2)
+        {
+            /* differs? */
+            if (lpp_image_word(image, byte_offset) != lpp_image_word(current_image, byte_offset))
+            {
+                /* mark and move on to the next page */
+                page_dirty[page_address / page_size] = 1;
+                stats->pages_written++;
+                break;
+            }
+        }
+
+        /* written or not, there's nothing saved on it */
+        if (page_dirty[page_address / page_size]) continue;
+
+        /* 
+         * a skipped page saves its erase and the write of each buffer that isn't blank - 
+         * blank ones aren't written anyway. each is held for P9 and then P10 
+         */
+        stats->saved_us += hold_us;
+        for (byte_offset = page_address; byte_offset < page_address + page_size; byte_offset += buffer_size)
+            if (!lpp_image_is_blank(context, image, byte_offset, buffer_size)) stats->saved_us += hold_us;
+    }
+
+    /* delegate to device and make sure everything was sent */
+    ret = context->device.group->image_pages_to_device_program(context, image, page_dirty) && 
+          lpp_icsp_flush(context);
+
+    /* free the page flags */
+    free(page_dirty);
+
+    /* return result */
+    return ret;
+
+err_alloc_page_dirty:
+err_not_supported:
+    return 0;
 }
 
 /* write an image to the device config */
 int lpp_write_image_to_device_config(struct lpp_context_t *context, struct lpp_image_t *image)
 {
-    /* delegate to device */
-    return context->device.group->image_to_device_config(context, image);
+    /* delegate to device and make sure everything was sent */
+    return context->device.group->image_to_device_config(context, image) && 
+           lpp_icsp_flush(context);
 }
 
 /* perform bulk erase */
 int lpp_bulk_erase(struct lpp_context_t *context)
 {
-    int ret;
-    
-    /* delegate to device */
-    ret = context->device.group->bulk_erase(context);
+    /* delegate to device and make sure everything was sent */
+    return context->device.group->bulk_erase(context) && 
+           lpp_icsp_flush(context);
+}
 
-    /* if success, wait */
-    if (ret) usleep(20);
+/* erase only the pages an image populates */
+int lpp_footprint_erase(struct lpp_context_t *context, 
+                        struct lpp_image_t *image,
+                        const struct lpp_address_range_t *protect,
+                        const unsigned int protect_count,
+                        struct lpp_erase_stats_t *stats)
+{
+    const unsigned int page_size = context->device.code_erase_page_size;
+    unsigned int page_address, populated_address, protect_idx, ret;
+    unsigned char *page_erase;
+
+    /* zero out stats */
+    memset(stats, 0, sizeof(*stats));
+
+    /* device must be able to erase single pages */
+    if (context->device.group->erase_pages == NULL || page_size == 0)
+    {
+        /* not supported */
+        printf("Footprint erase isn't supported for %s\n", context->device.name);
+        goto err_not_supported;
+    }
+
+    /* one flag per page */
+    stats->page_count = context->device.code_memory_size / page_size;
+    page_erase = calloc(stats->page_count, 1);
+    if (page_erase == NULL) goto err_alloc_page_erase;
+
+    /* mark every populated page */
+    for (page_address = 0; page_address < context->device.code_memory_size; page_address += page_size)
+    {
+        /* populated? */
+        populated_address = page_address;
+        if (!lpp_image_block_next(context, image, page_size, &populated_address) || 
+            populated_address != page_address) continue;
+
+        /* leave it be if it touches a protected range */
+        for (protect_idx = 0; protect_idx < protect_count; ++protect_idx)
+            if (protect[protect_idx].start < page_address + page_size && 
+                protect[protect_idx].end > page_address) break;
+
+        /* mark it, or count it as protected */
+        if (protect_idx == protect_count)
+        {
+            page_erase[page_address / page_size] = 1;
+            stats->pages_erased++;
+        }
+        else stats->pages_protected++;
+    }
+
+    /* delegate to device and make sure everything was sent */
+    ret = context->device.group->erase_pages(context, page_erase) && 
+          lpp_icsp_flush(context);
+
+    /* free the page flags */
+    free(page_erase);
 
     /* return result */
     return ret;
+
+err_alloc_page_erase:
+err_not_supported:
+    return 0;
 }
 
 /* perform bulk erase */
 int lpp_non_bulk_erase(struct lpp_context_t *context)
 {
-    int ret;
-    
-    /* delegate to device */
-    ret = context->device.group->non_bulk_erase(context);
-
-    /* if success, wait */
-    if (ret) usleep(20);
-
-    /* return result */
-    return ret;
+    /* delegate to device and make sure everything was sent */
+    return context->device.group->non_bulk_erase(context) && 
+           lpp_icsp_flush(context);
 }
 
 
@@ -0,0 +1,187 @@
+/*
+ * Linux PIC Programmer (lpicp)
+ * Capture of ICSP sessions, for replay
+ *
+ * Author: Eran Duchan <pavius@gmail.com>
+ *
+ * This program is free software; you can redistribute  it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lpicp.h"
+#include "lpicp_log.h"
+#include "lpicp_capture.h"
+
+/* records are buffered this much before hitting the file */
+#define LPP_CAPTURE_FILE_BUFFER_SIZE (64 * 1024)
+
+/* set in the kind/command byte of a transfer the transport failed */
+#define LPP_CAPTURE_RECORD_FAILED (0x80)
+
+/* value bytes following the kind/command byte, by kind */
+static const unsigned char lpp_capture_value_sizes[] =
+{
+    [LPP_LOG_KIND_TX]           = 2,
+    [LPP_LOG_KIND_RX]           = 1,
+    [LPP_LOG_KIND_CMD_ONLY]     = 5,
+    [LPP_LOG_KIND_DATA_ONLY]    = 4,
+    [LPP_LOG_KIND_DELAY]        = 4,
+};
+
+/* number of known kinds */
+#define LPP_CAPTURE_KIND_COUNT (sizeof(lpp_capture_value_sizes) / sizeof(lpp_capture_value_sizes[0]))
+
+/* start capturing */
+int lpp_capture_start(struct lpp_context_t *context, const char *file_name)
+{
+    struct lpp_capture_file_header_t header;
+    struct lpp_capture_t *capture;
+
+    /* allocate state */
+    capture = calloc(1, sizeof(struct lpp_capture_t));
+    if (capture == NULL) goto err_alloc_state;
+
+    /* create the file */
+    capture->file = fopen(file_name, "wb");
+    if (capture->file == NULL) goto err_open_file;
+
+    /* records are small, don't hit the file for each */
+    setvbuf(capture->file, NULL, _IOFBF, LPP_CAPTURE_FILE_BUFFER_SIZE);
+
+    /* write the header */
+    memcpy(header.magic, LPP_CAPTURE_FILE_MAGIC, sizeof(header.magic));
+    header.version = LPP_CAPTURE_FILE_VERSION;
+    if (fwrite(&header, sizeof(header), 1, capture->file) != 1) goto err_write_header;
+
+    /* save state */
+    context->capture = capture;
+
+    /* success */
+    return 1;
+
+err_write_header:
+    fclose(capture->file);
+err_open_file:
+    free(capture);
+err_alloc_state:
+    printf("Failed to start capturing to %s\n", file_name);
+    return 0;
+}
+
+/* finish the capture */
+int lpp_capture_stop(struct lpp_context_t *context)
+{
+    struct lpp_capture_t *capture = context->capture;
+    int ret;
+
+    /* not capturing? */
+    if (capture == NULL) return 1;
+
+    /* close the file, writing out what's buffered */
+    ret = (fclose(capture->file) == 0) && !capture->failed;
+    if (!ret) printf("Capture incomplete, failed to write it\n");
+
+    /* free state */
+    free(capture);
+    context->capture = NULL;
+
+    /* return result */
+    return ret;
+}
+
+/* capture a transfer */
+void lpp_capture_xfer(struct lpp_context_t *context,
+                      const unsigned char kind,
+                      const unsigned char command,
+                      const unsigned int value,
+                      const unsigned char pgc_value,
+                      const unsigned char pgd_value,
+                      const int result)
+{
+    struct lpp_capture_t *capture = context->capture;
+    unsigned char buffer[LPP_CAPTURE_RECORD_MAX_SIZE];
+    struct lpp_capture_record_t record;
+    unsigned int size;
+
+    /* not capturing, or no use going on? */
+    if (capture == NULL || capture->failed) return;
+
+    /* build the record */
+    record.kind = kind;
+    record.command = command;
+    record.value = value;
+    record.pgc_value = pgc_value;
+    record.pgd_value = pgd_value;
+    record.result = result ? 1 : 0;
+
+    /* encode and write it */
+    size = lpp_capture_record_encode(&record, buffer);
+    if (fwrite(buffer, size, 1, capture->file) != 1) capture->failed = 1;
+
+    /* count it */
+    capture->record_count++;
+}
+
+/* encode a record */
+unsigned int lpp_capture_record_encode(const struct lpp_capture_record_t *record,
+                                       unsigned char *buffer)
+{
+    const unsigned int size = 1 + lpp_capture_value_sizes[record->kind];
+    unsigned int byte_idx, value;
+
+    /* kind, command and whether it failed */
+    buffer[0] = (record->kind << 4) | (record->command & 0xF) | (record->result ? 0 : LPP_CAPTURE_RECORD_FAILED);
+    byte_idx = 1;
+
+    /* command only holds its levels before the hold time */
+    if (record->kind == LPP_LOG_KIND_CMD_ONLY)
+        buffer[byte_idx++] = (record->pgc_value ? 0x1 : 0) | (record->pgd_value ? 0x2 : 0);
+
+    /* value, lsb first */
+    for (value = record->value; byte_idx < size; ++byte_idx, value >>= 8)
+        buffer[byte_idx] = (value & 0xFF);
+
+    /* done */
+    return size;
+}
+
+/* decode a record */
+unsigned int lpp_capture_record_decode(const unsigned char *buffer,
+                                       const unsigned int size,
+                                       struct lpp_capture_record_t *record)
+{
+    unsigned int record_size, byte_idx, shift;
+
+    /* get kind, command and result */
+    if (size == 0) return 0;
+    memset(record, 0, sizeof(*record));
+    record->kind = ((buffer[0] & ~LPP_CAPTURE_RECORD_FAILED) >> 4);
+    record->command = (buffer[0] & 0xF);
+    record->result = (buffer[0] & LPP_CAPTURE_RECORD_FAILED) ? 0 : 1;
+
+    /* known, and all there? */
+    if (record->kind >= LPP_CAPTURE_KIND_COUNT) return 0;
+    record_size = 1 + lpp_capture_value_sizes[record->kind];
+    if (size < record_size) return 0;
+    byte_idx = 1;
+
+    /* command only holds its levels before the hold time */
+    if (record->kind == LPP_LOG_KIND_CMD_ONLY)
+    {
+        record->pgc_value = (buffer[byte_idx] & 0x1) ? 1 : 0;
+        record->pgd_value = (buffer[byte_idx] & 0x2) ? 1 : 0;
+        byte_idx++;
+    }
+
+    /* value, lsb first */
+    for (shift = 0; byte_idx < record_size; ++byte_idx, shift += 8)
+        record->value |= (buffer[byte_idx] << shift);
+
+    /* done */
+    return record_size;
+}
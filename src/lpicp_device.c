@@ -10,9 +10,21 @@
  *
  */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include "lpicp.h"
 #include "lpicp_device.h"
+#include "lpicp_icsp.h"
+#include "lpicp_image.h"
+
+/* EEPROM writes are timed by polling at this fraction of the poll interval */
+#define LPP_DEVICE_EEPROM_FINE_POLL_DIVIDER (10)
+
+/* how many EEPROM writes are timed before predicting */
+#define LPP_DEVICE_EEPROM_LEARN_SAMPLES (4)
+
+/* EECON1 write in progress */
+#define LPP_DEVICE_EECON1_WR (0x2)
 
 /* forward declare all structures */
 extern struct lpp_device_group_t lpp_device_18f2xx_4xx;
@@ -55,10 +67,208 @@ int lpp_device_init_by_family(struct lpp_context_t *context,
         }
     }
 
-    /* open the device */
-    if (context->device.group) context->device.group->open(context);
+    /* open the device and apply default timing */
+    if (context->device.group) 
+    {
+        /* open */
+        context->device.group->open(context);
+        lpp_device_timing_policy_set(context, LPP_DEVICE_TIMING_DEFAULT);
+    }
 
     /* success if a group has been assigned */
     return (context->device.group != NULL);
 }
 
+/* take the larger of two */
+#define lpp_device_timing_max(a, b) (((a) > (b)) ? (a) : (b))
+
+/* derive the timing used from the datasheet and default timing */
+int lpp_device_timing_policy_set(struct lpp_context_t *context, 
+                                 const enum lpp_device_timing_policy_t policy)
+{
+    const struct lpp_device_timing_t *datasheet = &context->device.timing_datasheet;
+    const struct lpp_device_timing_t *defaults = &context->device.timing_default;
+    struct lpp_device_timing_t *timing = &context->device.timing;
+
+    /* by policy */
+    switch (policy)
+    {
+        /* as proven on hardware */
+        case LPP_DEVICE_TIMING_DEFAULT:
+            *timing = *defaults;
+            break;
+
+        /* as listed */
+        case LPP_DEVICE_TIMING_DATASHEET:
+            *timing = *datasheet;
+            break;
+
+        /* double the minimums, but never cut into the default. the EEPROM timeout stays tight */
+        case LPP_DEVICE_TIMING_SAFE:
+            *timing = *datasheet;
+            timing->p9_us = lpp_device_timing_max(datasheet->p9_us * 2, defaults->p9_us);
+            timing->p10_us = lpp_device_timing_max(datasheet->p10_us * 2, defaults->p10_us);
+            timing->p11_us = lpp_device_timing_max(datasheet->p11_us * 2, defaults->p11_us);
+            timing->erase_p10_us = lpp_device_timing_max(datasheet->erase_p10_us * 2, defaults->erase_p10_us);
+            timing->eeprom_write_max_us = datasheet->eeprom_write_max_us * 2;
+            break;
+
+        /* unknown */
+        default:
+            return 0;
+    }
+
+    /* success */
+    return 1;
+}
+
+/* hold PGC for some time after a command, then wait P10 */
+static int lpp_device_hold(struct lpp_context_t *context, 
+                           const unsigned char pgc_value, 
+                           const unsigned int hold_us,
+                           const unsigned int p10_us)
+{
+    /* set up the transaction */
+    struct mc_icsp_cmd_only_t cmd_config = 
+    {
+        .command = 0x0,
+        .pgc_value_after_cmd = pgc_value,
+        .pgd_value_after_cmd = 0,
+        .mdelay = hold_us / 1000,
+        .udelay = hold_us % 1000
+    };
+
+    /* do the command only transaction, then wait P10 */
+    return lpp_icsp_command_only(context, &cmd_config) && 
+           lpp_icsp_delay_us(context, p10_us);
+}
+
+/* hold for P9 after a programming command, then wait P10 */
+int lpp_device_program_hold(struct lpp_context_t *context)
+{
+    /* special nop with PGC held high, then 16 0s of data */
+    return lpp_device_hold(context, 1, context->device.timing.p9_us, context->device.timing.p10_us) && 
+           lpp_icsp_data_only(context, 0x0);
+}
+
+/* hold for P11 after a bulk erase command, then wait P10 */
+int lpp_device_bulk_erase_hold(struct lpp_context_t *context)
+{
+    /* nop with PGC held low */
+    return lpp_device_hold(context, 0, context->device.timing.p11_us, context->device.timing.erase_p10_us);
+}
+
+/* wait for an EEPROM write to complete */
+int lpp_device_eeprom_write_wait(struct lpp_context_t *context)
+{
+    struct lpp_device_eeprom_predictor_t *predictor = &context->device.eeprom_predictor;
+    const struct lpp_device_timing_t *timing = &context->device.timing;
+    unsigned int poll_us, waited_us, busy_polls;
+    unsigned char eecon1, write_complete;
+    int ret;
+
+    /* poll finely, but not for nothing */
+    poll_us = timing->eeprom_poll_us / LPP_DEVICE_EEPROM_FINE_POLL_DIVIDER;
+    if (poll_us == 0) poll_us = 1;
+
+    /* sleep through most of the write, if we know how long it takes */
+    waited_us = predictor->predicted_us;
+    ret = (waited_us == 0) || lpp_icsp_delay_us(context, waited_us);
+
+    /* while WR bit is set to 1 and not timed out */
+    for (write_complete = 0, busy_polls = 0; ret && !write_complete; )
+    {
+        /* get WR bit */
+        ret = lpp_exec_instruction(context, LPP_MOVF_EECON1_W)                      &&
+              lpp_exec_instruction(context, LPP_OP_MOVWF(LPP_REG_TABLAT))           &&
+              lpp_icsp_read_8(context, LPP_ICSP_CMD_SHIFT_TABLAT_REG, &eecon1);
+
+        /* if we read OK, check if write complete */
+        if (ret) 
+        {
+            /* check if WR clear */
+            write_complete = ((eecon1 & LPP_DEVICE_EECON1_WR) == 0);
+
+            /* wait a bit more, unless it's taken too long already */
+            if (!write_complete)
+            {
+                ret = (waited_us < timing->eeprom_write_max_us) && 
+                      lpp_icsp_delay_us(context, poll_us);
+
+                /* count it */
+                waited_us += poll_us;
+                busy_polls++;
+            }
+        }
+    }
+
+    /* 
+     * once predicting, aim for the write to complete right after the first poll. the time spent 
+     * polling isn't counted, so the prediction is short by that and corrected here
+     */
+    if (ret && predictor->predicted_us)
+    {
+        /* slept through all of it - maybe too long. otherwise, every poll after the first was late */
+        if (busy_polls == 0 && predictor->predicted_us > poll_us) 
+            predictor->predicted_us -= poll_us;
+        else if (busy_polls > 1)
+            predictor->predicted_us += (busy_polls - 1) * poll_us;
+    }
+    
+    /* time the first few writes, predicting from their average */
+    else if (ret && predictor->samples < LPP_DEVICE_EEPROM_LEARN_SAMPLES)
+    {
+        /* another sample */
+        predictor->total_us += waited_us;
+        predictor->samples++;
+
+        /* enough? */
+        if (predictor->samples == LPP_DEVICE_EEPROM_LEARN_SAMPLES)
+            predictor->predicted_us = predictor->total_us / predictor->samples;
+    }
+
+    /* return result */
+    return ret;
+}
+
+/* read back a just programmed row and compare it to the image */
+int lpp_device_row_verify(struct lpp_context_t *context, 
+                          struct lpp_image_t *image,
+                          const unsigned int address,
+                          const unsigned int size,
+                          int *mismatch)
+{
+    unsigned char row[LPP_DEVICE_MAX_ROW_SIZE];
+    unsigned int byte_offset;
+
+    /* nothing differs until it's read */
+    if (mismatch) *mismatch = 0;
+
+    /* TBLPTR is still in the row, so this costs only its low byte */
+    if (size > sizeof(row) || !lpp_read_block(context, address, row, size)) return 0;
+
+    /* compare word by word, the device's are lsb first */
+    for (byte_offset = 0; byte_offset < size; byte_offset += 2)
+    {
+        const unsigned short expected = lpp_image_word(image, address + byte_offset);
+        const unsigned short actual = row[byte_offset] | (row[byte_offset + 1] << 8);
+
+        /* differs? */
+        if (expected != actual)
+        {
+            /* say where */
+            printf("\nRow @ %06X failed to verify: expected %04X @ %06X, read %04X\n", 
+                   address, expected, address + byte_offset, actual);
+
+            /* failed, on the data */
+            if (mismatch) *mismatch = 1;
+            return 0;
+        }
+    }
+
+    /* one more good row */
+    context->row_verify_count++;
+
+    /* success */
+    return 1;
+}
@@ -11,137 +11,483 @@
  */
 
 #include <stdio.h>
-#include <fcntl.h>
-#include <unistd.h>
-#include <sys/ioctl.h>
+#include <stdlib.h>
 #include "lpicp_icsp.h"
 #include "lpicp_log.h"
-
-/* simulate. TODO: proper */
-/* #define ioctl(x, y, z) (0) */
+#include "lpicp_capture.h"
 
 /* open access to driver */
-int lpp_icsp_init(struct lpp_context_t *context, char *icsp_dev_name)
+int lpp_icsp_init(struct lpp_context_t *context, 
+                  const enum lpp_transport_type_t transport_type,
+                  char *icsp_dev_name)
 {
-    /* open ICSP driver */
-    context->icsp_dev_file = open(icsp_dev_name, O_RDWR);
-
-    /* check */
-    if (context->icsp_dev_file >= 0)
-    {
-        /* save name */
-        context->icsp_dev_name = icsp_dev_name;
-    }
-    else
-    {
-        /* failed */
-        printf("Failed to open ICSP driver @ %s\n", icsp_dev_name);
-
+    /* calibrate delays, before the transport needs them */
+    lpp_timing_init(&context->timing);
+
+    /* get the transport */
+    if (!lpp_transport_init_by_type(context, transport_type))
+    {
+        /* failed */
+        printf("Unsupported transport\n");
+
+        /* failed */
+        goto err_icsp_open;
+    }
+
+    /* open it */
+    if (context->transport->open(context, icsp_dev_name))
+    {
+        /* save name */
+        context->icsp_dev_name = icsp_dev_name;
+    }
+    else
+    {
         /* failed */
         goto err_icsp_open;
-    }
+    }
 
+    /* allocate the transaction queue */
+    context->xfer_queue = malloc(sizeof(struct lpp_icsp_xfer_t) * LPP_ICSP_QUEUE_SIZE);
+    context->xfer_queue_count = 0;
+
+    /* check allocation */
+    if (context->xfer_queue == NULL)
+    {
+        /* failed */
+        goto err_alloc_queue;
+    }
+
+    /* assume batching until the transport says otherwise */
+    context->xfer_batch_supported = (context->transport->batch != NULL);
+    context->rx_block_supported = (context->transport->rx_block != NULL);
+
     /* success */
     return 1;
-
-err_icsp_open:
-    return 0;
+
+err_alloc_queue:
+    context->transport->close(context);
+err_icsp_open:
+    return 0;
 }
 
 /* close access to driver */
 int lpp_icsp_destroy(struct lpp_context_t *context)
 {
-    /* check if file exists */
-    if (context->icsp_dev_file)
-    {
-        /* close the file */
-        close(context->icsp_dev_file);
-    }
+    /* push anything left in the queue */
+    if (context->xfer_queue)
+    {
+        /* flush and free the queue */
+        lpp_icsp_flush(context);
+        free(context->xfer_queue);
+        context->xfer_queue = NULL;
+    }
+
+    /* close the transport */
+    if (context->transport) context->transport->close(context);
 
     /* nullify */
-    context->icsp_dev_file = -1;
+    context->transport = NULL;
     context->icsp_dev_name = NULL;
 
     /* success */
     return 1;
 }
 
-/* execute a command via ICSP driver */
+/* issue a single transaction to the transport */
+static int lpp_icsp_xfer_issue(struct lpp_context_t *context, 
+                               const struct lpp_icsp_xfer_t *xfer)
+{
+    /* by type */
+    switch (xfer->type)
+    {
+        /* tx command and data */
+        case LPP_ICSP_XFER_TX:
+            return context->transport->tx(context, xfer->command, xfer->value);
+
+        /* command only */
+        case LPP_ICSP_XFER_CMD_ONLY:
+            return context->transport->cmd_only(context, &xfer->cmd_config);
+
+        /* data only */
+        case LPP_ICSP_XFER_DATA_ONLY:
+            return context->transport->data_only(context, xfer->value);
+
+        /* delay */
+        case LPP_ICSP_XFER_DELAY:
+            return context->transport->delay(context, xfer->value);
+    }
+
+    /* unknown transaction */
+    return 0;
+}
+
+/* log a queued transaction once it's been issued */
+static void lpp_icsp_xfer_log(struct lpp_context_t *context, 
+                              const struct lpp_icsp_xfer_t *xfer,
+                              const int result)
+{
+    /* by type */
+    switch (xfer->type)
+    {
+        /* tx command and data */
+        case LPP_ICSP_XFER_TX:
+            lpp_log_xfer(context, LPP_LOG_KIND_TX, xfer->command, xfer->value, result, 0);
+            break;
+
+        /* command only, and how long it was held */
+        case LPP_ICSP_XFER_CMD_ONLY:
+            lpp_log_xfer(context, LPP_LOG_KIND_CMD_ONLY, xfer->cmd_config.command, 
+                         xfer->cmd_config.mdelay * 1000 + xfer->cmd_config.udelay, 
+                         result, xfer->cmd_config.pgc_value_after_cmd);
+            break;
+
+        /* data only */
+        case LPP_ICSP_XFER_DATA_ONLY:
+            lpp_log_xfer(context, LPP_LOG_KIND_DATA_ONLY, 0, xfer->value, result, 0);
+            break;
+
+        /* delay */
+        case LPP_ICSP_XFER_DELAY:
+            lpp_log_xfer(context, LPP_LOG_KIND_DELAY, 0, xfer->value, result, 0);
+            break;
+    }
+}
+
+/* capture a queued transaction as it's issued */
+static void lpp_icsp_xfer_capture(struct lpp_context_t *context, 
+                                  const struct lpp_icsp_xfer_t *xfer,
+                                  const int result)
+{
+    /* by type */
+    switch (xfer->type)
+    {
+        /* tx command and data */
+        case LPP_ICSP_XFER_TX:
+            lpp_capture_xfer(context, LPP_LOG_KIND_TX, xfer->command, xfer->value, 0, 0, result);
+            break;
+
+        /* command only, the levels it leaves and how long it's held */
+        case LPP_ICSP_XFER_CMD_ONLY:
+            lpp_capture_xfer(context, LPP_LOG_KIND_CMD_ONLY, xfer->cmd_config.command, 
+                             xfer->cmd_config.mdelay * 1000 + xfer->cmd_config.udelay, 
+                             xfer->cmd_config.pgc_value_after_cmd, xfer->cmd_config.pgd_value_after_cmd, result);
+            break;
+
+        /* data only */
+        case LPP_ICSP_XFER_DATA_ONLY:
+            lpp_capture_xfer(context, LPP_LOG_KIND_DATA_ONLY, 0, xfer->value, 0, 0, result);
+            break;
+
+        /* delay */
+        case LPP_ICSP_XFER_DELAY:
+            lpp_capture_xfer(context, LPP_LOG_KIND_DELAY, 0, xfer->value, 0, 0, result);
+            break;
+    }
+}
+
+/* push all queued transactions to the transport, the queue isn't empty */
+static int lpp_icsp_flush_queue(struct lpp_context_t *context)
+{
+    unsigned int xfer_idx;
+    int ret;
+
+    /* try to push everything in one shot */
+    if (context->xfer_batch_supported)
+    {
+        /* do the batch */
+        ret = context->transport->batch(context, 
+                                        context->xfer_queue, 
+                                        context->xfer_queue_count);
+
+        /* if the transport can't batch, stop trying and fall back to one by one */
+        if (ret >= 0)
+        {
+            /* log them all, with the result of the batch */
+            for (xfer_idx = 0; xfer_idx < context->xfer_queue_count && context->log_records; ++xfer_idx)
+                lpp_icsp_xfer_log(context, &context->xfer_queue[xfer_idx], ret);
+
+            /* and capture them, the same as if they'd been issued one by one */
+            for (xfer_idx = 0; xfer_idx < context->xfer_queue_count && context->capture; ++xfer_idx)
+                lpp_icsp_xfer_capture(context, &context->xfer_queue[xfer_idx], ret);
+
+            /* done */
+            context->xfer_queue_count = 0;
+            return ret;
+        }
+        else context->xfer_batch_supported = 0;
+    }
+
+    /* issue transactions one by one */
+    for (ret = 1, xfer_idx = 0; xfer_idx < context->xfer_queue_count && ret; ++xfer_idx)
+    {
+        /* issue the transaction */
+        ret = lpp_icsp_xfer_issue(context, &context->xfer_queue[xfer_idx]);
+
+        /* log it */
+        if (context->log_records) lpp_icsp_xfer_log(context, &context->xfer_queue[xfer_idx], ret);
+        if (context->capture) lpp_icsp_xfer_capture(context, &context->xfer_queue[xfer_idx], ret);
+    }
+
+    /* queue is empty, whether we succeeded or not */
+    context->xfer_queue_count = 0;
+
+    /* return result */
+    return ret;
+}
+
+/* push all queued transactions to the transport */
+int lpp_icsp_flush(struct lpp_context_t *context)
+{
+    unsigned long long start_ns;
+    int ret;
+
+    /* nothing to do if queue is empty */
+    if (context->xfer_queue_count == 0) return 1;
+
+    /* push them, counting the time spent doing so */
+    start_ns = lpp_timing_now_ns();
+    ret = lpp_icsp_flush_queue(context);
+    lpp_stats_current(context)->transport_ns += lpp_timing_now_ns() - start_ns;
+
+    /* return result */
+    return ret;
+}
+
+/* can a core instruction write TBLPTR? */
+static int lpp_icsp_inst_writes_tblptr(const unsigned short instruction)
+{
+    const unsigned char file_register = (instruction & 0xFF);
+
+    /* movlw, nop and goto don't touch file registers */
+    if ((instruction & 0xFF00) == LPP_OP_MOVLW(0)  || 
+        instruction == LPP_OP_NOP                  || 
+        (instruction & 0xFF00) == LPP_SET_PC_100K_0 || 
+        (instruction & 0xF000) == 0xF000) return 0;
+
+    /* everything that isn't a byte or bit oriented file register op is suspect */
+    if (instruction < 0x1000 || instruction >= 0xC000) return 1;
+
+    /* byte oriented ops with the result to W and bit tests don't write the register */
+    if ((instruction < 0x6000 && !(instruction & 0x0200)) || instruction >= 0xA000) return 0;
+
+    /* written - is it one of the TBLPTR bytes? */
+    return (file_register == LPP_REG_TBLPTRU || 
+            file_register == LPP_REG_TBLPTRH || 
+            file_register == LPP_REG_TBLPTRL);
+}
+
+/* follow the effect of a command on TBLPTR */
+static void lpp_icsp_tblptr_track(struct lpp_context_t *context, 
+                                  const unsigned char command, 
+                                  const unsigned short data)
+{
+    /* nothing to follow if unknown */
+    if (!context->tblptr_shadow_valid) return;
+
+    /* by command */
+    switch (command)
+    {
+        /* core instruction. incrementing TBLPTRL doesn't carry */
+        case LPP_ICSP_CMD_CORE_INST:
+            if (data == LPP_INC_TBLPTRL)
+                context->tblptr_shadow = (context->tblptr_shadow & ~0xFF) | ((context->tblptr_shadow + 1) & 0xFF);
+            else if (lpp_icsp_inst_writes_tblptr(data))
+                context->tblptr_shadow_valid = 0;
+            break;
+
+        /* post/pre increment by one */
+        case LPP_ICSP_CMD_TBL_RD_POST_INC:
+        case LPP_ICSP_CMD_TBL_RD_PRE_INC:
+            context->tblptr_shadow++;
+            break;
+
+        /* post decrement by one */
+        case LPP_ICSP_CMD_TBL_RD_POST_DEC:
+            context->tblptr_shadow--;
+            break;
+
+        /* post increment by two */
+        case LPP_ICSP_CMD_TBL_WR_POST_INC_2:
+        case LPP_ICSP_CMD_TBL_WR_PROG_POST_INC_2:
+            context->tblptr_shadow += 2;
+            break;
+
+        /* pointer is left as is */
+        case LPP_ICSP_CMD_SHIFT_TABLAT_REG:
+        case LPP_ICSP_CMD_TBL_RD:
+        case LPP_ICSP_CMD_TBL_WR_PROG:
+            break;
+
+        /* anything else - don't assume */
+        default:
+            context->tblptr_shadow_valid = 0;
+            break;
+    }
+
+    /* TBLPTR is 22 bits wide */
+    context->tblptr_shadow &= LPP_TBLPTR_MASK;
+}
+
+/* queue a transaction, flushing if the queue is full */
+static int lpp_icsp_queue(struct lpp_context_t *context, 
+                          const unsigned int type, 
+                          const unsigned char command, 
+                          const unsigned int value, 
+                          const struct mc_icsp_cmd_only_t *cmd_config)
+{
+    struct lpp_icsp_xfer_t *xfer;
+
+    /* make room if required */
+    if (context->xfer_queue_count == LPP_ICSP_QUEUE_SIZE && 
+        !lpp_icsp_flush(context))
+    {
+        /* failed to make room */
+        return 0;
+    }
+
+    /* point to next free transaction */
+    xfer = &context->xfer_queue[context->xfer_queue_count++];
+
+    /* count what goes on the bus */
+    if (type != LPP_ICSP_XFER_DELAY)
+    {
+        lpp_stats_current(context)->transfers++;
+        if (type != LPP_ICSP_XFER_CMD_ONLY) lpp_stats_current(context)->bytes_tx += 2;
+    }
+
+    /* fill it */
+    xfer->type = type;
+    xfer->command = command;
+    xfer->value = value;
+    if (cmd_config) xfer->cmd_config = *cmd_config;
+
+    /* success */
+    return 1;
+}
+
+/* execute a command via transport */
 int lpp_icsp_write_16(struct lpp_context_t *context, 
                       const unsigned char command, 
                       const unsigned short data)
 {
-    unsigned int xfer_command = 0;
-
-    /* log write, if applicable */
-    lpp_log_command(context, command, data);
+    /* follow TBLPTR */
+    lpp_icsp_tblptr_track(context, command, data);
 
-    /* encode the xfer */
-    MC_ICSP_ENCODE_XFER(command, data, xfer_command);
-
-    /* tx */
-    return (ioctl(context->icsp_dev_file, MC_ICSP_IOC_TX, xfer_command) == 0);
+    /* tx, when the queue is next flushed */
+    return lpp_icsp_queue(context, LPP_ICSP_XFER_TX, command, data, NULL);
 }
 
-/* Read 8 bits via ICSP driver */
+/* Read 8 bits via transport */
 int lpp_icsp_read_8(struct lpp_context_t *context, 
                     const unsigned char command, 
                     unsigned char *data)
 {
-    unsigned int xfer_command = 0;
-    int ret;
-
-    /* encode the xfer */
-    MC_ICSP_ENCODE_XFER(command, 0, xfer_command);
-
-    /* rx */
-    ret = (ioctl(context->icsp_dev_file, MC_ICSP_IOC_RX, &xfer_command) == 0);
-
-    /* get LSB */
-    *data = ((xfer_command >> 8) & 0xFF);
+    unsigned long long start_ns;
+    int ret;
+
+    /* everything queued must hit the device before we read */
+    if (!lpp_icsp_flush(context)) return 0;
+
+    /* rx */
+    start_ns = lpp_timing_now_ns();
+    ret = context->transport->rx(context, command, data);
+
+    /* count it */
+    lpp_stats_current(context)->transport_ns += lpp_timing_now_ns() - start_ns;
+    lpp_stats_current(context)->transfers++;
+    lpp_stats_current(context)->bytes_rx++;
 
     /* log read, if applicable */
-    lpp_log_command(context, command, (unsigned short)*data);
+    lpp_log_xfer(context, LPP_LOG_KIND_RX, command, *data, ret, 0);
+
+    /* capture what was read and whether it was, for replay to hand back */
+    if (context->capture) lpp_capture_xfer(context, LPP_LOG_KIND_RX, command, ret ? *data : 0, 0, 0, ret);
+
+    /* follow TBLPTR */
+    lpp_icsp_tblptr_track(context, command, 0);
 
     /* return result */
     return ret;
 }
 
-/* send only a command */
-int lpp_icsp_command_only(struct lpp_context_t *context, 
-                          const struct mc_icsp_cmd_only_t *cmd_config)
+/* Read a number of 8 bit values via transport */
+int lpp_icsp_read_block(struct lpp_context_t *context, 
+                        const unsigned char command, 
+                        unsigned char *data, 
+                        const unsigned int size)
 {
-    int ret;
+    unsigned long long start_ns;
+    unsigned int byte_idx, read_count = 0;
+    int ret = -1;
 
-    /*  */
-    ret = (ioctl(context->icsp_dev_file, MC_ICSP_IOC_CMD_ONLY, cmd_config) == 0);
+    /* everything queued must hit the device before we read */
+    if (!lpp_icsp_flush(context)) return 0;
+    start_ns = lpp_timing_now_ns();
 
-    /* log as a nop, if applicable */
-    if (ret) lpp_log_command(context, 0, 0);
+    /* try to read everything in one shot */
+    if (context->rx_block_supported)
+    {
+        /* do the block read. if it failed, there's no telling how much of it was read */
+        ret = context->transport->rx_block(context, command, data, size);
+        if (ret > 0) read_count = size;
 
-    /* return result */
-    return ret;
+        /* if the transport can't do block reads, stop trying */
+        if (ret < 0) context->rx_block_supported = 0;
+    }
+
+    /* read byte by byte if block read wasn't done, stopping on failure */
+    if (ret < 0)
+    {
+        for (ret = 1; read_count < size && ret; )
+        {
+            /* rx */
+            ret = context->transport->rx(context, command, &data[read_count]);
+            if (ret) read_count++;
+        }
+    }
+
+    /* count what was read */
+    lpp_stats_current(context)->transport_ns += lpp_timing_now_ns() - start_ns;
+    lpp_stats_current(context)->transfers += read_count;
+    lpp_stats_current(context)->bytes_rx += read_count;
+
+    /* log reads, if applicable */
+    for (byte_idx = 0; byte_idx < read_count && context->log_records; ++byte_idx)
+        lpp_log_xfer(context, LPP_LOG_KIND_RX, command, data[byte_idx], 1, 0);
+
+    /* capture them, and the read that failed if one did so replay fails it too */
+    for (byte_idx = 0; byte_idx < read_count && context->capture; ++byte_idx)
+        lpp_capture_xfer(context, LPP_LOG_KIND_RX, command, data[byte_idx], 0, 0, 1);
+    if (!ret && context->capture) lpp_capture_xfer(context, LPP_LOG_KIND_RX, command, 0, 0, 0, 0);
+
+    /* follow TBLPTR. past a failed read, where the device left it is unknown */
+    for (byte_idx = 0; byte_idx < read_count && context->tblptr_shadow_valid; ++byte_idx)
+        lpp_icsp_tblptr_track(context, command, 0);
+    if (!ret) context->tblptr_shadow_valid = 0;
+
+    /* success if block read succeeded or all bytes were read */
+    return (ret != 0);
+}
+
+/* send only a command */
+int lpp_icsp_command_only(struct lpp_context_t *context, 
+                          const struct mc_icsp_cmd_only_t *cmd_config)
+{
+    /* queue the command */
+    return lpp_icsp_queue(context, LPP_ICSP_XFER_CMD_ONLY, 0, 0, cmd_config);
 }
 
 /* send only data */
 int lpp_icsp_data_only(struct lpp_context_t *context, 
                        const unsigned int data)
 {
-    int ret;
-
-    /* send only data */
-    ret = (ioctl(context->icsp_dev_file, MC_ICSP_IOC_DATA_ONLY, data) == 0);
-
-    /* return result */
-    return ret;
+    /* queue the data */
+    return lpp_icsp_queue(context, LPP_ICSP_XFER_DATA_ONLY, 0, data, NULL);
 }
 
 /* delay and return success */
 int lpp_icsp_delay_us(struct lpp_context_t *context, const unsigned int delay_us)
 {
-    /* delay */
-    usleep(delay_us);
-
-    /* success */
-    return 1;
+    /* delay in order with the rest of the queued transactions */
+    return lpp_icsp_queue(context, LPP_ICSP_XFER_DELAY, 0, delay_us, NULL);
 }
@@ -13,6 +13,13 @@
 #include "lpicp_image.h"
 #include "ihex.h"
 #include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* most data a single hex record can hold */
+#define LPP_IMAGE_MAX_RECORD_DATA (255)
 
 /* initialize an image */
 int lpp_image_init(struct lpp_context_t *context, 
@@ -22,34 +29,169 @@ int lpp_image_init(struct lpp_context_t *context,
     /* zero out the image */
     memset(image, 0, sizeof(struct lpp_image_t));
 
-    /* allocate contents */
-    image->contents = malloc(max_content_size);
-    
-    /* check allocation */
-    if (image->contents != NULL)
+    /* contents are allocated as they're populated, up to this size */
+    image->max_contents_size = max_content_size;
+
+    /* zero out eeprom/configs */
+    memset(image->config, 0xFF, sizeof(image->config));
+    memset(image->eeprom, 0xFF, sizeof(image->eeprom));
+
+    /* success */
+    return 1;
+}
+
+/* make sure contents up to some size are allocated */
+int lpp_image_reserve(struct lpp_context_t *context, 
+                      struct lpp_image_t *image, 
+                      const unsigned int size)
+{
+    unsigned char *contents;
+    unsigned int allocated_size;
+
+    /* mapped contents are read only, take a copy before anyone writes to them */
+    if (image->map != NULL)
+    {
+        /* copy what's populated, in whole words */
+        allocated_size = lpp_image_contents_word_size(image);
+        contents = malloc(allocated_size ? allocated_size : 1);
+        if (contents == NULL) return 0;
+        memcpy(contents, image->contents, allocated_size);
+
+        /* drop the mapping */
+        munmap(image->map, image->map_size);
+        image->map = NULL;
+        image->contents = contents;
+        image->allocated_size = allocated_size;
+    }
+
+    /* already there? */
+    if (size <= image->allocated_size) return 1;
+
+    /* can't grow past the limit */
+    if (size > image->max_contents_size) return 0;
+
+    /* grow by chunks, up to the limit */
+    allocated_size = ((size + LPP_IMAGE_ALLOC_GRANULARITY - 1) / LPP_IMAGE_ALLOC_GRANULARITY) * LPP_IMAGE_ALLOC_GRANULARITY;
+    if (allocated_size > image->max_contents_size) allocated_size = image->max_contents_size;
+
+    /* reallocate */
+    contents = realloc(image->contents, allocated_size);
+    if (contents == NULL) return 0;
+
+    /* new contents are erased */
+    memset(contents + image->allocated_size, 0xFF, allocated_size - image->allocated_size);
+
+    /* save */
+    image->contents = contents;
+    image->allocated_size = allocated_size;
+
+    /* success */
+    return 1;
+}
+
+/* find the first extent which ends at or after an address */
+static unsigned int lpp_image_extent_find(struct lpp_image_t *image, const unsigned int address)
+{
+    unsigned int low = 0, high = image->extent_count;
+
+    /* binary search */
+    while (low < high)
     {
-        /* init buffers */
-        memset(image->contents, 0xFF, max_content_size);
+        const unsigned int middle = (low + high) / 2;
 
-        /* save sizes */
-        image->max_contents_size = max_content_size;
+        /* go right if it ends before the address */
+        if (image->extents[middle].end < address) low = middle + 1;
+        else high = middle;
     }
-    else
+
+    /* return index, extent_count if none */
+    return low;
+}
+
+/* mark a range of the contents as populated */
+int lpp_image_extent_add(struct lpp_context_t *context, 
+                         struct lpp_image_t *image, 
+                         const unsigned int start, 
+                         const unsigned int size)
+{
+    const unsigned int end = start + size;
+    unsigned int extent_idx, merged_idx;
+    struct lpp_image_extent_t *extent;
+
+    /* nothing to add */
+    if (size == 0) return 1;
+
+    /* first extent that may touch the range */
+    extent_idx = lpp_image_extent_find(image, start);
+
+    /* touches? merge into it and any extents following it that now touch it */
+    if (extent_idx < image->extent_count && image->extents[extent_idx].start <= end)
     {
-        /* failed */
-        goto err_alloc_contents;
+        /* grow */
+        extent = &image->extents[extent_idx];
+        if (start < extent->start) extent->start = start;
+        if (end > extent->end) extent->end = end;
+
+        /* absorb following extents */
+        for (merged_idx = extent_idx + 1; 
+             merged_idx < image->extent_count && image->extents[merged_idx].start <= extent->end; 
+             ++merged_idx)
+        {
+            /* take the end, if further */
+            if (image->extents[merged_idx].end > extent->end) extent->end = image->extents[merged_idx].end;
+        }
+
+        /* remove absorbed extents */
+        memmove(extent + 1, &image->extents[merged_idx], 
+                (image->extent_count - merged_idx) * sizeof(struct lpp_image_extent_t));
+        image->extent_count -= (merged_idx - extent_idx - 1);
     }
+    else
+    {
+        /* make room */
+        if (image->extent_count == image->max_extent_count)
+        {
+            const unsigned int max_extent_count = image->max_extent_count ? image->max_extent_count * 2 : 16;
 
-    /* zero out eeprom/configs */
-    memset(image->config, 0xFF, sizeof(image->config));
-    memset(image->eeprom, 0xFF, sizeof(image->eeprom));
+            /* grow the map */
+            extent = realloc(image->extents, max_extent_count * sizeof(struct lpp_image_extent_t));
+            if (extent == NULL) return 0;
+
+            /* save */
+            image->extents = extent;
+            image->max_extent_count = max_extent_count;
+        }
+
+        /* insert in place */
+        extent = &image->extents[extent_idx];
+        memmove(extent + 1, extent, (image->extent_count - extent_idx) * sizeof(struct lpp_image_extent_t));
+        extent->start = start;
+        extent->end = end;
+        image->extent_count++;
+    }
 
     /* success */
     return 1;
+}
 
-    /* failed */
-err_alloc_contents:
-    return 0;
+/* get the first populated block at or after an address */
+int lpp_image_block_next(struct lpp_context_t *context, 
+                         struct lpp_image_t *image, 
+                         const unsigned int block_size, 
+                         unsigned int *address)
+{
+    unsigned int extent_idx, block_address;
+
+    /* first extent that ends after the address */
+    extent_idx = lpp_image_extent_find(image, *address + 1);
+    if (extent_idx == image->extent_count) return 0;
+
+    /* the block holding the start of the extent, unless we're past it */
+    block_address = (image->extents[extent_idx].start / block_size) * block_size;
+    if (block_address > *address) *address = block_address;
+
+    /* found */
+    return 1;
 }
 
 /* destroy an image */
@@ -57,12 +199,20 @@ int lpp_image_destroy(struct lpp_context_t *context,
                       struct lpp_image_t *image)
 {                   
     /* check if we have contents */
-    if (image->contents != NULL)
+    if (image->map != NULL)
+    {
+        /* contents are mapped */
+        munmap(image->map, image->map_size);
+    }
+    else if (image->contents != NULL)
     {
         /* free the image */
         free(image->contents);
     }
 
+    /* free the extent map */
+    free(image->extents);
+
     /* zero out the image */
     memset(image, 0, sizeof(struct lpp_image_t));
 
@@ -70,76 +220,146 @@ int lpp_image_destroy(struct lpp_context_t *context,
     return 1;
 }
 
-/* record to big endian */
-void lpp_image_data_record_to_big_endian(struct lpp_context_t *context, 
-                                         IHexRecord *hex_record)
+/* check if a range of the image holds only erased (0xFF) bytes */
+int lpp_image_is_blank(struct lpp_context_t *context, 
+                       struct lpp_image_t *image, 
+                       const unsigned int offset, 
+                       const unsigned int size)
 {
-    unsigned int byte_index;
+    const unsigned int contents_end = lpp_image_contents_word_size(image) < image->allocated_size ? 
+                                        lpp_image_contents_word_size(image) : image->allocated_size;
+    const unsigned char *data;
+    unsigned long word;
+    unsigned int size_left;
+
+    /* nothing past the contents is programmed. they end on a whole word, as they're written */
+    if (offset >= contents_end) return 1;
+    size_left = (offset + size > contents_end) ? (contents_end - offset) : size;
+    data = image->contents + offset;
+
+    /* a byte at a time up to word alignment */
+    for (; size_left && ((unsigned long)data & (sizeof(word) - 1)); --size_left)
+        if (*data++ != 0xFF) return 0;
+
+    /* then a word at a time */
+    for (; size_left >= sizeof(word); size_left -= sizeof(word), data += sizeof(word))
+    {
+        /* get the word (compiles to a single load) */
+        memcpy(&word, data, sizeof(word));
+        if (word != ~0UL) return 0;
+    }
 
-    /* doesn't support records with odd number of bytes */
-    /* lpp_assert(hex_record->dataLen & 0x1 == 0, 
-               "HEX file record must contain even number of bytes"); */
+    /* and whatever's left */
+    for (; size_left; --size_left)
+        if (*data++ != 0xFF) return 0;
 
-    /* swap all bytes @ N, N+1 */
-    for (byte_index = 0; byte_index < hex_record->dataLen; byte_index += 2)
-    {   
-        /* save original */
-        unsigned char original_byte_n = hex_record->data[byte_index];
+    /* all erased */
+    return 1;
+}
 
-        /* do swap */
-        hex_record->data[byte_index] = hex_record->data[byte_index + 1];
-        hex_record->data[byte_index + 1] = original_byte_n;
-    }
+/* ascii hex digit to its value, LPP_IMAGE_HEX_INVALID if it isn't one */
+#define LPP_IMAGE_HEX_INVALID (0x100)
+static unsigned short lpp_image_hex_nibble[256];
+
+/* 
+ * decode two ascii hex digits to a byte. invalid digits push the result over 0xFF,
+ * so a record can be checked once after all its bytes are or'ed together
+ */
+#define lpp_image_hex_byte(text)                                        \
+        ((lpp_image_hex_nibble[(unsigned char)(text)[0]] << 4) |        \
+          lpp_image_hex_nibble[(unsigned char)(text)[1]])
+
+/* fill the hex digit table */
+static void lpp_image_hex_table_init(void)
+{
+    unsigned int char_idx;
+
+    /* done already? */
+    if (lpp_image_hex_nibble['1'] == 1) return;
+
+    /* everything is invalid, except for digits */
+    for (char_idx = 0; char_idx < 256; ++char_idx)
+        lpp_image_hex_nibble[char_idx] = LPP_IMAGE_HEX_INVALID;
+
+    /* 0-9, A-F and a-f */
+    for (char_idx = 0; char_idx < 10; ++char_idx) lpp_image_hex_nibble['0' + char_idx] = char_idx;
+    for (char_idx = 0; char_idx < 6; ++char_idx) lpp_image_hex_nibble['A' + char_idx] = 10 + char_idx;
+    for (char_idx = 0; char_idx < 6; ++char_idx) lpp_image_hex_nibble['a' + char_idx] = 10 + char_idx;
 }
 
-/* handle record type */
-int lpp_image_read_handle_data_record(struct lpp_context_t *context, 
-                                      struct lpp_image_t *image, 
-                                      const unsigned short address_ext,
-                                      IHexRecord *hex_record)
+/* 
+ * decode a program data record straight into the image. words are kept msb first 
+ * so each byte goes to the other byte of its word
+ */
+static int lpp_image_read_program_record(struct lpp_context_t *context, 
+                                         struct lpp_image_t *image, 
+                                         const unsigned int address,
+                                         const char *data_text,
+                                         const unsigned int data_size,
+                                         unsigned int *sum)
 {
-    /* check address extension */
-    if (address_ext == 0)
-    {
-        /* get the address at which this block ends */
-        unsigned int write_end_address = hex_record->address + hex_record->dataLen;
+    const unsigned int write_end_address = address + data_size;
+    unsigned int byte_idx, value, invalid;
 
-        /* is there enough room for this data? */
-        if (write_end_address > image->max_contents_size)
-        {
-            /* not enough room for records */
-            printf("Not enough space @ address %04X\n", hex_record->address);
-            goto err_not_enough_space;
-        }
+    /* is there enough room for this data? */
+    if (write_end_address > image->max_contents_size)
+    {
+        /* not enough room for records */
+        printf("Not enough space @ address %04X\n", address);
+        return 0;
+    }
 
-        /* convert record to big endian */
-        lpp_image_data_record_to_big_endian(context, hex_record);
+    /* make room and mark it as populated */
+    if (!lpp_image_reserve(context, image, write_end_address) ||
+        !lpp_image_extent_add(context, image, address, data_size))
+    {
+        /* out of memory */
+        printf("Failed to allocate image @ address %04X\n", address);
+        return 0;
+    }
 
-        /* read the record to the proper offset */
-        memcpy(image->contents + hex_record->address, 
-               hex_record->data, 
-               hex_record->dataLen);
+    /* decode the bytes to their place */
+    for (byte_idx = 0, invalid = 0; byte_idx < data_size; ++byte_idx, data_text += 2)
+    {
+        /* decode */
+        value = lpp_image_hex_byte(data_text);
+        invalid |= value;
+        *sum += value;
 
-        /* check if we passed the high address watermark */
-        if (write_end_address > image->contents_size) 
-            image->contents_size = write_end_address;
+        /* write swapped */
+        image->contents[(address + byte_idx) ^ 1] = (unsigned char)value;
     }
+
+    /* check if we passed the high address watermark */
+    if (write_end_address > image->contents_size) 
+        image->contents_size = write_end_address;
+
+    /* all digits must have been valid */
+    return (invalid <= 0xFF);
+}
+
+/* handle a config or eeprom data record */
+static int lpp_image_read_handle_data_record(struct lpp_context_t *context, 
+                                             struct lpp_image_t *image, 
+                                             const unsigned short address_ext,
+                                             const unsigned int address,
+                                             const unsigned char *data,
+                                             const unsigned int data_size)
+{
     /* config space */
-    else if (address_ext == (context->device.config_address >> 8))
+    if (address_ext == (context->device.config_address >> 8))
     {
         /* write to configuration */
-        if ((hex_record->address + hex_record->dataLen) <= sizeof(image->config))
+        if ((address + data_size) <= sizeof(image->config))
         {
             unsigned int valid_byte_idx;
 
             /* copy configuration to offset */
-            memcpy(&image->config[hex_record->address], 
-                   hex_record->data,
-                   hex_record->dataLen);
+            memcpy(&image->config[address], data, data_size);
 
             /* set valid bits, indicating that this configuration byte has been read from source */
-            for (valid_byte_idx = hex_record->address;
-                  valid_byte_idx < hex_record->address + hex_record->dataLen;
+            for (valid_byte_idx = address;
+                  valid_byte_idx < address + data_size;
                   ++valid_byte_idx)
             {
                 /* set appropriate byte valid bit */
@@ -153,12 +373,16 @@ int lpp_image_read_handle_data_record(struct lpp_context_t *context,
     else if (address_ext == (context->device.eeprom_address >> 8))
     {
         /* write to configuration */
-        if ((hex_record->address + hex_record->dataLen) <= sizeof(image->eeprom))
+        if ((address + data_size) <= sizeof(image->eeprom))
         {
+            unsigned int valid_byte_idx;
+
             /* copy eeprom to offset */
-            memcpy(&image->eeprom[hex_record->address], 
-                   hex_record->data,
-                   hex_record->dataLen);
+            memcpy(&image->eeprom[address], data, data_size);
+
+            /* set valid bits, indicating that this eeprom byte has been read from source */
+            for (valid_byte_idx = address; valid_byte_idx < address + data_size; ++valid_byte_idx)
+                image->eeprom_valid[valid_byte_idx >> 3] |= (1 << (valid_byte_idx & 0x7));
         }
         /* can't store this, not supported */
         else goto err_not_enough_space;
@@ -171,169 +395,562 @@ err_not_enough_space:
     return 0;
 }
 
-/* read a file into an image */
-int lpp_image_read_from_file(struct lpp_context_t *context, 
-                             struct lpp_image_t *image, 
-                             const char *file_name)
+/* parse an intel hex file held in memory into an image */
+static int lpp_image_read_from_buffer(struct lpp_context_t *context, 
+                                      struct lpp_image_t *image, 
+                                      const char *text, 
+                                      const char *text_end)
 {
-    FILE *hex_file;
-    IHexRecord hex_record;
-    enum IHexErrors record_read_result;
+    unsigned char data[LPP_IMAGE_MAX_RECORD_DATA];
+    unsigned int data_size, address, type, sum, byte_idx, header;
     unsigned short address_ext = 0;
+    const char *data_text;
 
-    /* try to open the file */
-    hex_file = fopen(file_name, "r");
+    /* make sure hex digits can be decoded */
+    lpp_image_hex_table_init();
 
-    /* success? */
-    if (hex_file)
+    /* iterate through the records */
+    while (text < text_end)
     {
-        /* read records */
-        while (1)
+        /* skip line endings and whitespace between records */
+        if (*text == '\r' || *text == '\n' || *text == ' ' || *text == '\t') 
         {
-            /* read the record */
-            record_read_result = Read_IHexRecord(&hex_record, hex_file);
+            text++;
+            continue;
+        }
+
+        /* records start with ':' and have at least a count, address, type and checksum */
+        if (*text != ':' || text_end - text < 11) goto err_invalid_record;
+
+        /* decode the header */
+        data_size = lpp_image_hex_byte(text + 1);
+        address = (lpp_image_hex_byte(text + 3) << 8) | lpp_image_hex_byte(text + 5);
+        type = lpp_image_hex_byte(text + 7);
+        header = data_size | type | lpp_image_hex_byte(text + 3) | lpp_image_hex_byte(text + 5);
+        data_text = text + 9;
+
+        /* check the header is valid and the whole record is there */
+        if (header > 0xFF || (unsigned int)(text_end - data_text) < (data_size * 2) + 2) goto err_invalid_record;
+
+        /* the checksum covers everything */
+        sum = data_size + (address >> 8) + (address & 0xFF) + type;
 
-            /* if no error, read to image */
-            if (record_read_result == IHEX_OK)
+        /* program data goes straight into the image */
+        if (type == IHEX_TYPE_00 && address_ext == 0)
+        {
+            /* decode into the image */
+            if (!lpp_image_read_program_record(context, image, address, data_text, data_size, &sum))
+                goto err_handling_data_record;
+        }
+        else
+        {
+            /* decode the data */
+            for (byte_idx = 0, header = 0; byte_idx < data_size; ++byte_idx)
             {
-                /* data record */
-                if (hex_record.type == IHEX_TYPE_00)
-                {
-                    /* handle the data record */
-                    if (!lpp_image_read_handle_data_record(context, image, address_ext, &hex_record))
-                    {
-                        /* error */
-                        goto err_handling_data_record;
-                    }
-                }
-                /* set address MSb */
-                else if (hex_record.type == IHEX_TYPE_04)
-                {
-                    /* set the extended address */
-                    address_ext = hex_record.data[0];
-                    address_ext |= (hex_record.data[1] << 8);
-                }
-                /* end record */
-                else if (hex_record.type == IHEX_TYPE_01)
-                {
-                    break;
-                }
+                const unsigned int value = lpp_image_hex_byte(data_text + (byte_idx * 2));
+
+                /* save */
+                header |= value;
+                sum += value;
+                data[byte_idx] = (unsigned char)value;
             }
-            /* end of file? */
-            else if (record_read_result == IHEX_ERROR_EOF)
+
+            /* all digits must have been valid */
+            if (header > 0xFF) goto err_invalid_record;
+
+            /* config or eeprom data */
+            if (type == IHEX_TYPE_00)
             {
-                /* if we got here, we're done */
-                break;
+                /* handle the data record */
+                if (!lpp_image_read_handle_data_record(context, image, address_ext, address, data, data_size))
+                    goto err_handling_data_record;
             }
-            /* some other error */
-            else
+            /* set address MSb */
+            else if (type == IHEX_TYPE_04 && data_size >= 2)
             {
-                /* error */
-                printf("Failed to parse file. err(%d)\n", record_read_result);
-                goto err_parse_file;
+                /* set the extended address */
+                address_ext = data[0];
+                address_ext |= (data[1] << 8);
             }
         }
+
+        /* the checksum digits must be valid too, or masking the sum would hide them */
+        header = lpp_image_hex_byte(data_text + (data_size * 2));
+        if (header > 0xFF) goto err_invalid_record;
+
+        /* verify the checksum, which makes the sum zero */
+        sum += header;
+        if (sum & 0xFF)
+        {
+            /* bad record */
+            printf("Failed to parse file. Bad checksum @ address %04X\n", address);
+            return 0;
+        }
+
+        /* end record */
+        if (type == IHEX_TYPE_01) break;
+
+        /* next record */
+        text = data_text + (data_size * 2) + 2;
     }
-    else
+
+    /* success */
+    return 1;
+
+err_invalid_record:
+    printf("Failed to parse file. Invalid record\n");
+err_handling_data_record:
+    return 0;
+}
+
+/* read a file into an image */
+int lpp_image_read_from_file(struct lpp_context_t *context, 
+                             struct lpp_image_t *image, 
+                             const char *file_name)
+{
+    struct stat hex_file_stat;
+    const char *hex_file_map;
+    int hex_file, ret;
+
+    /* try to open the file */
+    hex_file = open(file_name, O_RDONLY);
+
+    /* success? */
+    if (hex_file < 0 || fstat(hex_file, &hex_file_stat) != 0)
     {
         /* error */
         printf("Failed to open file @ %s\n", file_name);
         goto err_alloc_open_file;
     }
 
-    /* close file */
-    fclose(hex_file);
+    /* empty file holds no records */
+    if (hex_file_stat.st_size == 0)
+    {
+        /* nothing to do */
+        close(hex_file);
+        return 1;
+    }
+
+    /* map it */
+    hex_file_map = mmap(NULL, hex_file_stat.st_size, PROT_READ, MAP_PRIVATE, hex_file, 0);
+    if (hex_file_map == MAP_FAILED)
+    {
+        /* error */
+        printf("Failed to map file @ %s\n", file_name);
+        goto err_map_file;
+    }
+
+    /* it's going to be read start to end */
+    madvise((void *)hex_file_map, hex_file_stat.st_size, MADV_SEQUENTIAL);
+
+    /* parse it */
+    ret = lpp_image_read_from_buffer(context, image, hex_file_map, hex_file_map + hex_file_stat.st_size);
+
+    /* unmap and close file */
+    munmap((void *)hex_file_map, hex_file_stat.st_size);
+    close(hex_file);
+
+    /* return result */
+    return ret;
+
+err_map_file:
+    close(hex_file);
+err_alloc_open_file:
+    return 0;
+}
+
+/* byte to its two ascii hex digits */
+static char lpp_image_hex_digits[256][2];
+
+/* fill the hex digit table */
+static void lpp_image_hex_digits_init(void)
+{
+    static const char digits[] = "0123456789ABCDEF";
+    unsigned int byte_idx;
+
+    /* done already? */
+    if (lpp_image_hex_digits[1][1] == '1') return;
+
+    /* both digits of each byte */
+    for (byte_idx = 0; byte_idx < 256; ++byte_idx)
+    {
+        lpp_image_hex_digits[byte_idx][0] = digits[byte_idx >> 4];
+        lpp_image_hex_digits[byte_idx][1] = digits[byte_idx & 0xF];
+    }
+}
+
+/* format bytes as ascii hex, returns where it stopped */
+static char *lpp_image_hex_format(char *text, const unsigned char *data, const unsigned int size)
+{
+    unsigned int byte_idx;
+
+    /* two digits per byte */
+    for (byte_idx = 0; byte_idx < size; ++byte_idx, text += 2)
+        memcpy(text, lpp_image_hex_digits[data[byte_idx]], 2);
+
+    /* return end */
+    return text;
+}
+
+/* push out whatever the writer holds */
+static int lpp_image_hex_writer_flush(struct lpp_image_hex_writer_t *writer)
+{
+    int ret;
+
+    /* write it */
+    ret = (writer->buffer_used == 0 || 
+           fwrite(writer->buffer, writer->buffer_used, 1, writer->file) == 1);
+
+    /* empty */
+    writer->buffer_used = 0;
+
+    /* return result */
+    return ret;
+}
+
+/* get room for some text in the writer, NULL on failure */
+static char *lpp_image_hex_writer_reserve(struct lpp_image_hex_writer_t *writer, const unsigned int size)
+{
+    /* flush if it won't fit */
+    if (writer->buffer_used + size > sizeof(writer->buffer) && 
+        !lpp_image_hex_writer_flush(writer)) return NULL;
+
+    /* point to free space */
+    return writer->buffer + writer->buffer_used;
+}
+
+/* write a single record */
+static int lpp_image_hex_writer_record(struct lpp_image_hex_writer_t *writer, 
+                                       const unsigned char type, 
+                                       const unsigned short address, 
+                                       const unsigned char *data, 
+                                       const unsigned char size)
+{
+    unsigned char header[4] = {size, (address >> 8), (address & 0xFF), type};
+    unsigned char checksum;
+    unsigned int byte_idx;
+    char *text, *text_start;
+
+    /* ':', header, data, checksum and line ending */
+    text = text_start = lpp_image_hex_writer_reserve(writer, 1 + (sizeof(header) + size + 1) * 2 + 2);
+    if (text == NULL) return 0;
+
+    /* checksum is the two's complement of the sum of everything */
+    for (byte_idx = 0, checksum = header[0] + header[1] + header[2] + header[3]; byte_idx < size; ++byte_idx)
+        checksum += data[byte_idx];
+    checksum = -checksum;
+
+    /* format */
+    *text++ = ':';
+    text = lpp_image_hex_format(text, header, sizeof(header));
+    text = lpp_image_hex_format(text, data, size);
+    text = lpp_image_hex_format(text, &checksum, 1);
+    *text++ = '\r';
+    *text++ = '\n';
+
+    /* commit */
+    writer->buffer_used += (text - text_start);
+
+    /* success */
+    return 1;
+}
+
+/* start writing a hex file */
+int lpp_image_hex_writer_open(struct lpp_context_t *context, 
+                              struct lpp_image_hex_writer_t *writer, 
+                              const char *file_name)
+{
+    /* make sure bytes can be formatted */
+    lpp_image_hex_digits_init();
+
+    /* zero out */
+    writer->buffer_used = 0;
+    writer->address_ext = 0;
+    writer->address_ext_valid = 0;
+
+    /* stdout or file, buffering is ours */
+    writer->file = (strcmp(file_name, "-") == 0) ? stdout : fopen(file_name, "wb");
+    if (writer->file == NULL)
+    {
+        /* error */
+        printf("Failed to open file @ %s\n", file_name);
+        return 0;
+    }
+
+    /* success */
+    return 1;
+}
+
+/* write data records, with extended address records as required */
+int lpp_image_hex_writer_data(struct lpp_context_t *context, 
+                              struct lpp_image_hex_writer_t *writer, 
+                              const unsigned int address, 
+                              const unsigned char *data, 
+                              const unsigned int size)
+{
+    unsigned int current_address, record_size;
+
+    /* a record per 16 byte row, which never crosses 64K */
+    for (current_address = address; current_address < address + size; current_address += record_size)
+    {
+        /* up to the end of the row */
+        record_size = 16 - (current_address & 0xF);
+        if (record_size > address + size - current_address) record_size = address + size - current_address;
+
+        /* moved to another 64K? */
+        if (!writer->address_ext_valid || writer->address_ext != (current_address >> 16))
+        {
+            unsigned char address_ext[2] = {(current_address >> 24), (current_address >> 16)};
+
+            /* extended linear address record */
+            if (!lpp_image_hex_writer_record(writer, IHEX_TYPE_04, 0, address_ext, sizeof(address_ext))) return 0;
+
+            /* save */
+            writer->address_ext = (current_address >> 16);
+            writer->address_ext_valid = 1;
+        }
+
+        /* write the row */
+        if (!lpp_image_hex_writer_record(writer, IHEX_TYPE_00, current_address & 0xFFFF, 
+                                         data + (current_address - address), record_size)) return 0;
+    }
 
     /* success */
     return 1;
+}
 
-err_handling_data_record:
-err_parse_file:
-    fclose(hex_file);
-err_alloc_open_file:
-    return 0;    
+/* write data records for a range of image contents */
+int lpp_image_hex_writer_program(struct lpp_context_t *context, 
+                                 struct lpp_image_hex_writer_t *writer, 
+                                 struct lpp_image_t *image, 
+                                 const unsigned int address, 
+                                 const unsigned int size)
+{
+    unsigned char data[256];
+    unsigned int current_address, byte_idx, chunk_size;
+
+    /* a chunk at a time */
+    for (current_address = address; current_address < address + size; current_address += chunk_size)
+    {
+        /* up to the chunk size */
+        chunk_size = (address + size - current_address < sizeof(data)) ? 
+                        (address + size - current_address) : sizeof(data);
+
+        /* image words are msb first, the device's are lsb first */
+        for (byte_idx = 0; byte_idx < chunk_size; ++byte_idx)
+            data[byte_idx] = lpp_image_byte(image, current_address + byte_idx);
+
+        /* write it */
+        if (!lpp_image_hex_writer_data(context, writer, current_address, data, chunk_size)) return 0;
+    }
+
+    /* success */
+    return 1;
+}
+
+/* write data records for the valid config bytes and the eeprom of an image */
+int lpp_image_hex_writer_config_eeprom(struct lpp_context_t *context, 
+                                       struct lpp_image_hex_writer_t *writer, 
+                                       struct lpp_image_t *image)
+{
+    unsigned int config_byte_idx, run_start, ret;
+
+    /* runs of valid config bytes */
+    for (ret = 1, config_byte_idx = 0; config_byte_idx < context->device.config_bytes && ret; )
+    {
+        /* skip invalid */
+        if (!(image->config_valid & (1 << config_byte_idx)))
+        {
+            ++config_byte_idx;
+            continue;
+        }
+
+        /* find the end of the run */
+        for (run_start = config_byte_idx; 
+              config_byte_idx < context->device.config_bytes && (image->config_valid & (1 << config_byte_idx)); 
+              ++config_byte_idx);
+
+        /* write it */
+        ret = lpp_image_hex_writer_data(context, writer, 
+                                        context->device.config_address + run_start, 
+                                        &image->config[run_start], 
+                                        config_byte_idx - run_start);
+    }
+
+    /* and the eeprom */
+    return ret && lpp_image_hex_writer_data(context, writer, 
+                                            context->device.eeprom_address, 
+                                            image->eeprom, 
+                                            context->device.eeprom_bytes);
+}
+
+/* write the end record and close the file */
+int lpp_image_hex_writer_close(struct lpp_context_t *context, 
+                               struct lpp_image_hex_writer_t *writer)
+{
+    int ret;
+
+    /* end record, then push everything out */
+    ret = lpp_image_hex_writer_record(writer, IHEX_TYPE_01, 0, NULL, 0) && 
+          lpp_image_hex_writer_flush(writer);
+
+    /* close, unless stdout */
+    if (writer->file == stdout) ret = (fflush(stdout) == 0) && ret;
+    else ret = (fclose(writer->file) == 0) && ret;
+
+    /* return result */
+    return ret;
 }
 
 /* write the image to file */
 int lpp_image_write_to_file(struct lpp_context_t *context, 
-                             struct lpp_image_t *image, 
-                             const char *file_name)
+                            struct lpp_image_t *image, 
+                            const char *file_name)
 {
-    /* TODO */
+    struct lpp_image_hex_writer_t *writer;
+    struct lpp_image_extent_t *extent;
+    int ret;
+
+    /* the writer holds its buffer */
+    writer = malloc(sizeof(*writer));
+    if (writer == NULL || !lpp_image_hex_writer_open(context, writer, file_name)) goto err_open_writer;
+
+    /* the populated program ranges */
+    ret = 1;
+    lpp_image_for_each_extent(image, extent)
+        ret = ret && lpp_image_hex_writer_program(context, writer, image, extent->start, extent->end - extent->start);
+
+    /* then config, eeprom and the end */
+    ret = ret && lpp_image_hex_writer_config_eeprom(context, writer, image);
+    ret = lpp_image_hex_writer_close(context, writer) && ret;
+
+    /* done with the writer */
+    free(writer);
+
+    /* return result */
+    return ret;
+
+err_open_writer:
+    free(writer);
     return 0;
 }
 
+/* print some text through the writer */
+static int lpp_image_print_text(struct lpp_image_hex_writer_t *writer, const char *text)
+{
+    const unsigned int size = strlen(text);
+    char *buffer;
+
+    /* copy it in */
+    buffer = lpp_image_hex_writer_reserve(writer, size);
+    if (buffer == NULL) return 0;
+    memcpy(buffer, text, size);
+    writer->buffer_used += size;
+
+    /* success */
+    return 1;
+}
+
+/* print rows of bytes, each headed by its address */
+static int lpp_image_print_rows(struct lpp_image_hex_writer_t *writer, 
+                                const unsigned int address, 
+                                const unsigned char *data, 
+                                const unsigned int size)
+{
+    const unsigned int row_byte_count = 16;
+    unsigned int row_offset, row_size;
+    char *text;
+
+    /* a row at a time */
+    for (row_offset = 0; row_offset < size; row_offset += row_size)
+    {
+        /* up to a full row */
+        row_size = (size - row_offset < row_byte_count) ? (size - row_offset) : row_byte_count;
+
+        /* room for "\n[XXXXXXXX] " and the bytes */
+        text = lpp_image_hex_writer_reserve(writer, 12 + (row_size * 2));
+        if (text == NULL) return 0;
+
+        /* row header, then the bytes */
+        text += sprintf(text, "\n[%04X] ", address + row_offset);
+        text = lpp_image_hex_format(text, data + row_offset, row_size);
+
+        /* commit */
+        writer->buffer_used = text - writer->buffer;
+    }
+
+    /* success */
+    return 1;
+}
+
 /* print an image to stdout */
 int lpp_image_print(struct lpp_context_t *context, 
                     struct lpp_image_t *image)
 {
-    unsigned int byte_idx, row_address, config_byte_idx, eeprom_byte_idx;
+    struct lpp_image_hex_writer_t *writer;
+    unsigned int row_address, row_size, config_byte_idx;
     const unsigned int row_byte_count = 16;
+    int ret;
 
-    /* space out */
-    printf("\nProgram:");
+    /* rows are formatted into the writer's buffer */
+    writer = malloc(sizeof(*writer));
+    if (writer == NULL || !lpp_image_hex_writer_open(context, writer, "-")) goto err_open_writer;
 
-    /* iterate through the bytes */
-    for (row_address = 0, byte_idx = 0; 
-          byte_idx < image->contents_size; 
-          ++byte_idx)
-    {
-        /* starting new row? */
-        if ((byte_idx & (row_byte_count - 1)) == 0)
-        {
-            /* row header */
-            printf("\n[%04X] ", row_address);
+    /* everything printed so far goes first */
+    fflush(stdout);
 
-            /* next address */
-            row_address += row_byte_count;
-        }
+    /* space out */
+    ret = lpp_image_print_text(writer, "\nProgram:");
 
-        /* print the byte */
-        printf("%02X", image->contents[byte_idx]);
+    /* iterate through the populated rows */
+    for (row_address = 0; 
+          ret && lpp_image_block_next(context, image, row_byte_count, &row_address) && row_address < image->contents_size; 
+          row_address += row_byte_count)
+    {
+        /* print it, never past the contents */
+        row_size = (image->contents_size - row_address < row_byte_count) ? 
+                        (image->contents_size - row_address) : row_byte_count;
+        ret = lpp_image_print_rows(writer, row_address, image->contents + row_address, row_size);
     }
 
     /* space out */
-    printf("\n\nConfiguration:\n");
+    ret = ret && lpp_image_print_text(writer, "\n\nConfiguration:\n");
 
     /* print configuration bytes */
     for (config_byte_idx = 0;
-          config_byte_idx < context->device.config_bytes;
+          config_byte_idx < context->device.config_bytes && ret;
           ++config_byte_idx)
     {
         /* is the byte valid? */
         if (image->config_valid & (1 << config_byte_idx))
         {
+            char config_text[16];
+
             /* print config byte */
-            printf("[%04X] %02X\n", config_byte_idx, image->config[config_byte_idx]);
+            sprintf(config_text, "[%04X] %c%c\n", config_byte_idx, 
+                    lpp_image_hex_digits[image->config[config_byte_idx]][0], 
+                    lpp_image_hex_digits[image->config[config_byte_idx]][1]);
+            ret = lpp_image_print_text(writer, config_text);
         }
     }
 
-    /* space out */
-    printf("\nEEPROM:");
-
     /* print eeprom */
-    for (row_address = 0, eeprom_byte_idx = 0;
-          eeprom_byte_idx < context->device.eeprom_bytes;
-          ++eeprom_byte_idx)
-    {
-        /* starting new row? */
-        if ((eeprom_byte_idx & (row_byte_count - 1)) == 0)
-        {
-            /* row header */
-            printf("\n[%04X] ", row_address);
+    ret = ret                                                                                   && 
+          lpp_image_print_text(writer, "\nEEPROM:")                                             &&
+          lpp_image_print_rows(writer, 0, image->eeprom, context->device.eeprom_bytes)          &&
+          lpp_image_print_text(writer, "\n");
 
-            /* next address */
-            row_address += row_byte_count;
-        }
+    /* push it out */
+    ret = lpp_image_hex_writer_flush(writer) && (fflush(stdout) == 0) && ret;
 
-        /* print the byte */
-        printf("%02X", image->eeprom[eeprom_byte_idx]);
-    }
+    /* done with the writer */
+    free(writer);
 
-    /* done */
-    printf("\n");
+    /* return result */
+    return ret;
 
-    /* success */
-    return 1;
+err_open_writer:
+    free(writer);
+    return 0;
 }
 
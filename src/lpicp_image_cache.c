@@ -0,0 +1,316 @@
+/* 
+ * Linux PIC Programmer (lpicp)
+ * Compiled image cache
+ *
+ * Author: Eran Duchan <pavius@gmail.com>
+ *
+ * This program is free software; you can redistribute  it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ */
+
+#include "lpicp_image_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* "LIMG", in host order. a cache from a host of the other endianness won't match */
+#define LPP_IMAGE_CACHE_MAGIC           (0x474D494C)
+#define LPP_IMAGE_CACHE_VERSION         (3)
+
+/* contents start on this boundary in the file */
+#define LPP_IMAGE_CACHE_CONTENTS_ALIGN  (64)
+
+/* 
+ * file layout: header, extents, config, eeprom, eeprom valid bits, then contents on an aligned offset,
+ * in whole words (see lpp_image_contents_word_size). everything is in host order
+ */
+struct lpp_image_cache_header_t
+{
+    unsigned int        magic;
+    unsigned int        version;
+    unsigned int        device_id;              /* device the HEX file was parsed for */
+    unsigned int        config_valid;
+    unsigned long long  source_size;            /* HEX file this was compiled from */
+    unsigned long long  source_mtime_sec;
+    unsigned long long  source_mtime_nsec;
+    unsigned long long  hash;                   /* of everything following the header */
+    unsigned int        extent_count;
+    unsigned int        eeprom_size;
+    unsigned int        contents_size;
+    unsigned int        contents_offset;
+};
+
+/* offsets of the parts, in the file */
+#define LPP_IMAGE_CACHE_EXTENTS_OFFSET      (sizeof(struct lpp_image_cache_header_t))
+#define LPP_IMAGE_CACHE_CONFIG_OFFSET(h)    (LPP_IMAGE_CACHE_EXTENTS_OFFSET + \
+                                             (h)->extent_count * sizeof(struct lpp_image_extent_t))
+#define LPP_IMAGE_CACHE_EEPROM_OFFSET(h)    (LPP_IMAGE_CACHE_CONFIG_OFFSET(h) + LPP_MAX_CONFIG_BYTES)
+#define LPP_IMAGE_CACHE_EEPROM_VALID_OFFSET(h)  (LPP_IMAGE_CACHE_EEPROM_OFFSET(h) + LPP_MAX_EEPROM_BYTES)
+#define LPP_IMAGE_CACHE_END_OFFSET(h)       (LPP_IMAGE_CACHE_EEPROM_VALID_OFFSET(h) + (LPP_MAX_EEPROM_BYTES / 8))
+
+/* hash a buffer into a running FNV-1a hash */
+static unsigned long long lpp_image_cache_hash(unsigned long long hash, 
+                                               const void *buffer, 
+                                               const unsigned int size)
+{
+    const unsigned char *data = buffer;
+    unsigned int byte_idx;
+
+    /* xor and multiply by the prime */
+    for (byte_idx = 0; byte_idx < size; ++byte_idx)
+        hash = (hash ^ data[byte_idx]) * 0x100000001B3ULL;
+
+    /* return hash */
+    return hash;
+}
+
+/* hash the parts of an image kept in the cache */
+static unsigned long long lpp_image_cache_hash_image(const struct lpp_image_extent_t *extents,
+                                                     const unsigned int extent_count,
+                                                     const unsigned char *config,
+                                                     const unsigned int config_valid,
+                                                     const unsigned char *eeprom,
+                                                     const unsigned char *eeprom_valid,
+                                                     const unsigned char *contents,
+                                                     const unsigned int contents_size)
+{
+    unsigned long long hash = 0xCBF29CE484222325ULL;
+
+    /* all of it */
+    hash = lpp_image_cache_hash(hash, extents, extent_count * sizeof(struct lpp_image_extent_t));
+    hash = lpp_image_cache_hash(hash, config, LPP_MAX_CONFIG_BYTES);
+    hash = lpp_image_cache_hash(hash, &config_valid, sizeof(config_valid));
+    hash = lpp_image_cache_hash(hash, eeprom, LPP_MAX_EEPROM_BYTES);
+    hash = lpp_image_cache_hash(hash, eeprom_valid, LPP_MAX_EEPROM_BYTES / 8);
+    hash = lpp_image_cache_hash(hash, contents, contents_size);
+
+    /* return hash */
+    return hash;
+}
+
+/* get the name of the compiled image of a HEX file, must be freed */
+static char *lpp_image_cache_file_name(const char *file_name)
+{
+    char *cache_file_name;
+
+    /* allocate room for the suffix */
+    cache_file_name = malloc(strlen(file_name) + sizeof(LPP_IMAGE_CACHE_SUFFIX));
+
+    /* append it */
+    if (cache_file_name) 
+        strcat(strcpy(cache_file_name, file_name), LPP_IMAGE_CACHE_SUFFIX);
+
+    /* return name */
+    return cache_file_name;
+}
+
+/* check if a mapped compiled image is valid for a HEX file and a device */
+static int lpp_image_cache_valid(struct lpp_context_t *context, 
+                                 struct lpp_image_t *image, 
+                                 const struct stat *source_stat,
+                                 const unsigned char *map, 
+                                 const unsigned long map_size)
+{
+    const struct lpp_image_cache_header_t *header = (const struct lpp_image_cache_header_t *)map;
+    unsigned int contents_word_size;
+
+    /* header must be there and be ours */
+    if (map_size < sizeof(*header)                                  || 
+        header->magic != LPP_IMAGE_CACHE_MAGIC                      || 
+        header->version != LPP_IMAGE_CACHE_VERSION) return 0;
+
+    /* compiled from this very HEX file, for this device */
+    if (header->device_id != context->device.id                                 ||
+        header->source_size != (unsigned long long)source_stat->st_size        ||
+        header->source_mtime_sec != (unsigned long long)source_stat->st_mtim.tv_sec ||
+        header->source_mtime_nsec != (unsigned long long)source_stat->st_mtim.tv_nsec) return 0;
+
+    /* contents are kept in whole words */
+    contents_word_size = (header->contents_size + 1) & ~1U;
+
+    /* everything it points to must be in the file and fit in the image */
+    if (header->extent_count > (map_size / sizeof(struct lpp_image_extent_t))  ||
+        LPP_IMAGE_CACHE_END_OFFSET(header) > header->contents_offset            ||
+        header->contents_offset > map_size                                     ||
+        contents_word_size > map_size - header->contents_offset               ||
+        contents_word_size > image->max_contents_size                          ||
+        header->eeprom_size > LPP_MAX_EEPROM_BYTES) return 0;
+
+    /* and not be corrupt */
+    return (header->hash == lpp_image_cache_hash_image(
+                                (const struct lpp_image_extent_t *)(map + LPP_IMAGE_CACHE_EXTENTS_OFFSET),
+                                header->extent_count,
+                                map + LPP_IMAGE_CACHE_CONFIG_OFFSET(header),
+                                header->config_valid,
+                                map + LPP_IMAGE_CACHE_EEPROM_OFFSET(header),
+                                map + LPP_IMAGE_CACHE_EEPROM_VALID_OFFSET(header),
+                                map + header->contents_offset,
+                                contents_word_size));
+}
+
+/* try to read the compiled image of a HEX file */
+static int lpp_image_cache_map(struct lpp_context_t *context, 
+                               struct lpp_image_t *image, 
+                               const char *cache_file_name, 
+                               const struct stat *source_stat)
+{
+    const struct lpp_image_cache_header_t *header;
+    struct stat cache_stat;
+    unsigned char *map;
+    unsigned int extents_size;
+    int cache_file;
+
+    /* open and map it */
+    cache_file = open(cache_file_name, O_RDONLY);
+    if (cache_file < 0) goto err_open_file;
+    if (fstat(cache_file, &cache_stat) != 0 || cache_stat.st_size == 0) goto err_map_file;
+    map = mmap(NULL, cache_stat.st_size, PROT_READ, MAP_SHARED, cache_file, 0);
+    if (map == MAP_FAILED) goto err_map_file;
+
+    /* the mapping holds on its own */
+    close(cache_file);
+
+    /* check it */
+    if (!lpp_image_cache_valid(context, image, source_stat, map, cache_stat.st_size)) goto err_invalid_cache;
+    header = (const struct lpp_image_cache_header_t *)map;
+
+    /* the extent map is small and grows with the image, so it's copied */
+    extents_size = header->extent_count * sizeof(struct lpp_image_extent_t);
+    image->extents = malloc(extents_size ? extents_size : 1);
+    if (image->extents == NULL) goto err_invalid_cache;
+    memcpy(image->extents, map + LPP_IMAGE_CACHE_EXTENTS_OFFSET, extents_size);
+    image->extent_count = image->max_extent_count = header->extent_count;
+
+    /* copy config and eeprom */
+    memcpy(image->config, map + LPP_IMAGE_CACHE_CONFIG_OFFSET(header), LPP_MAX_CONFIG_BYTES);
+    memcpy(image->eeprom, map + LPP_IMAGE_CACHE_EEPROM_OFFSET(header), LPP_MAX_EEPROM_BYTES);
+    memcpy(image->eeprom_valid, map + LPP_IMAGE_CACHE_EEPROM_VALID_OFFSET(header), LPP_MAX_EEPROM_BYTES / 8);
+    image->config_valid = header->config_valid;
+    image->eeprom_size = header->eeprom_size;
+
+    /* contents are used where they are */
+    image->contents = map + header->contents_offset;
+    image->contents_size = header->contents_size;
+    image->allocated_size = lpp_image_contents_word_size(image);
+    image->map = map;
+    image->map_size = cache_stat.st_size;
+
+    /* success */
+    return 1;
+
+err_invalid_cache:
+    munmap(map, cache_stat.st_size);
+    return 0;
+err_map_file:
+    close(cache_file);
+err_open_file:
+    return 0;
+}
+
+/* write the compiled image of a HEX file */
+int lpp_image_cache_store(struct lpp_context_t *context, 
+                          struct lpp_image_t *image, 
+                          const char *file_name)
+{
+    const unsigned int contents_word_size = lpp_image_contents_word_size(image);
+    struct lpp_image_cache_header_t header;
+    char *cache_file_name, *temp_file_name;
+    struct stat source_stat;
+    FILE *cache_file;
+    int ret;
+
+    /* the source must be there */
+    if (stat(file_name, &source_stat) != 0) goto err_stat_source;
+
+    /* fill the header */
+    memset(&header, 0, sizeof(header));
+    header.magic = LPP_IMAGE_CACHE_MAGIC;
+    header.version = LPP_IMAGE_CACHE_VERSION;
+    header.device_id = context->device.id;
+    header.config_valid = image->config_valid;
+    header.source_size = source_stat.st_size;
+    header.source_mtime_sec = source_stat.st_mtim.tv_sec;
+    header.source_mtime_nsec = source_stat.st_mtim.tv_nsec;
+    header.extent_count = image->extent_count;
+    header.eeprom_size = image->eeprom_size;
+    header.contents_size = image->contents_size;
+    header.contents_offset = ((LPP_IMAGE_CACHE_END_OFFSET(&header) + LPP_IMAGE_CACHE_CONTENTS_ALIGN - 1) / 
+                              LPP_IMAGE_CACHE_CONTENTS_ALIGN) * LPP_IMAGE_CACHE_CONTENTS_ALIGN;
+    header.hash = lpp_image_cache_hash_image(image->extents, image->extent_count, 
+                                             image->config, image->config_valid, 
+                                             image->eeprom, image->eeprom_valid, 
+                                             image->contents, contents_word_size);
+
+    /* written aside and renamed into place, so readers never see half a file */
+    cache_file_name = lpp_image_cache_file_name(file_name);
+    temp_file_name = malloc(strlen(file_name) + sizeof(LPP_IMAGE_CACHE_SUFFIX) + 16);
+    if (cache_file_name == NULL || temp_file_name == NULL) goto err_alloc_names;
+    sprintf(temp_file_name, "%s.%d", cache_file_name, (int)getpid());
+
+    /* write it */
+    cache_file = fopen(temp_file_name, "wb");
+    if (cache_file == NULL) goto err_alloc_names;
+    ret = fwrite(&header, sizeof(header), 1, cache_file) == 1                                  &&
+          (image->extent_count == 0 || 
+           fwrite(image->extents, sizeof(struct lpp_image_extent_t), image->extent_count, cache_file) == image->extent_count) &&
+          fwrite(image->config, LPP_MAX_CONFIG_BYTES, 1, cache_file) == 1                       &&
+          fwrite(image->eeprom, LPP_MAX_EEPROM_BYTES, 1, cache_file) == 1                       &&
+          fwrite(image->eeprom_valid, LPP_MAX_EEPROM_BYTES / 8, 1, cache_file) == 1             &&
+          fseek(cache_file, header.contents_offset, SEEK_SET) == 0                              &&
+          (contents_word_size == 0 || 
+           fwrite(image->contents, contents_word_size, 1, cache_file) == 1);
+
+    /* close and move into place */
+    ret = (fclose(cache_file) == 0) && ret && (rename(temp_file_name, cache_file_name) == 0);
+    if (!ret) unlink(temp_file_name);
+
+    /* free names */
+    free(temp_file_name);
+    free(cache_file_name);
+
+    /* return result */
+    return ret;
+
+err_alloc_names:
+    free(temp_file_name);
+    free(cache_file_name);
+err_stat_source:
+    return 0;
+}
+
+/* read a HEX file into an image through its compiled image */
+int lpp_image_cache_load(struct lpp_context_t *context, 
+                         struct lpp_image_t *image, 
+                         const char *file_name)
+{
+    struct stat source_stat;
+    char *cache_file_name;
+    int ret;
+
+    /* no source, no cache. let the parser complain */
+    if (stat(file_name, &source_stat) != 0) 
+        return lpp_image_read_from_file(context, image, file_name);
+
+    /* try the compiled image */
+    cache_file_name = lpp_image_cache_file_name(file_name);
+    if (cache_file_name == NULL) return 0;
+    ret = lpp_image_cache_map(context, image, cache_file_name, &source_stat);
+    free(cache_file_name);
+
+    /* missing or stale? parse and compile it for next time. failing to compile is fine */
+    if (!ret)
+    {
+        /* parse */
+        ret = lpp_image_read_from_file(context, image, file_name);
+        if (ret) lpp_image_cache_store(context, image, file_name);
+    }
+
+    /* return result */
+    return ret;
+}
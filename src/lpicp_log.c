@@ -12,16 +12,14 @@
 
 #include "lpicp_log.h"
 #include "lpicp_icsp.h"
+#include "lpicp_timing.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
 
-/* command log record */
-struct lpp_log_record_t
-{
-    unsigned char command;
-    unsigned short data;
-};
+/* EECON1 bits, as named by the datasheet */
+static const char *lpp_log_eecon1_bit_names[] = {"RD", "WR", "WREN", "WRERR", "FREE", "5", "CFGS", "EEPGD"};
 
 /* print the log - assumes string is 5 bytes long, at least */
 void lpp_log_format_cmd_string(const unsigned char cmd, 
@@ -52,69 +50,407 @@ void lpp_log_format_cmd_string(const unsigned char cmd,
     }
 }
 
+/* get the index of the oldest record still in the ring */
+static unsigned int lpp_log_first_idx(struct lpp_context_t *context)
+{
+    const unsigned int head = __atomic_load_n(&context->log_head, __ATOMIC_ACQUIRE);
+
+    /* the ring holds the last records */
+    return (head > context->log_record_count) ? (head - context->log_record_count) : 0;
+}
+
+/* get a record by index */
+#define lpp_log_record_get(context, idx) \
+        (&(context)->log_records[(idx) & ((context)->log_record_count - 1)])
+
 /* print the log */
 void lpp_log_print(struct lpp_context_t *context)
 {
+    struct lpp_log_decoder_t decoder;
     unsigned int record_idx;
-    char cmd_string[LPP_COMMAND_BIT_COUNT + 1];
+    char line[160];
 
-    /* iterat records */
-    for (record_idx = 0; record_idx < context->log_current_idx; ++record_idx)
+    /* start decoding */
+    lpp_log_decoder_init(&decoder);
+
+    /* say how many were lost */
+    if (lpp_log_first_idx(context)) 
+        printf("(%d older records overwritten)\n", lpp_log_first_idx(context));
+
+    /* iterate records */
+    for (record_idx = lpp_log_first_idx(context); record_idx != context->log_head; ++record_idx)
     {
-        /* get formatted string */
-        lpp_log_format_cmd_string(context->log_records[record_idx].command, 
-                                  cmd_string,
-                                  sizeof(cmd_string));
+        /* decode it */
+        lpp_log_decode(&decoder, lpp_log_record_get(context, record_idx), line, sizeof(line));
 
         /* print it */
-        printf("[%.3d] cmd(%s) data(%04X)\n", record_idx, 
-                cmd_string,
-                context->log_records[record_idx].data);
+        printf("%s\n", line);
     }
 
     /* flush stdout */
     fflush(stdout);
 }
 
-/* log a command */
-int lpp_log_command(struct lpp_context_t *context, 
-                    const unsigned char command, 
-                    const unsigned short data)
+/* dump the log to a file */
+int lpp_log_dump(struct lpp_context_t *context, const char *file_name)
+{
+    struct lpp_log_file_header_t header;
+    unsigned int record_idx, head;
+    FILE *log_file;
+    int ret;
+
+    /* nothing logged */
+    if (context->log_records == NULL) return 0;
+
+    /* open the file */
+    log_file = fopen(file_name, "wb");
+    if (log_file == NULL) goto err_open_file;
+
+    /* take a snapshot of the ring */
+    head = __atomic_load_n(&context->log_head, __ATOMIC_ACQUIRE);
+
+    /* describe the records */
+    memcpy(header.magic, LPP_LOG_FILE_MAGIC, sizeof(header.magic));
+    header.version = LPP_LOG_FILE_VERSION;
+    header.record_size = sizeof(struct lpp_log_record_t);
+    header.record_count = head - lpp_log_first_idx(context);
+    header.total_record_count = head;
+
+    /* write the header, then the records oldest first */
+    ret = (fwrite(&header, sizeof(header), 1, log_file) == 1);
+    for (record_idx = lpp_log_first_idx(context); ret && record_idx != head; ++record_idx)
+        ret = (fwrite(lpp_log_record_get(context, record_idx), sizeof(struct lpp_log_record_t), 1, log_file) == 1);
+
+    /* close it */
+    if (fclose(log_file) != 0) ret = 0;
+    if (!ret) goto err_write_file;
+
+    /* success */
+    return 1;
+
+err_write_file:
+err_open_file:
+    printf("Failed to write log to %s\n", file_name);
+    return 0;
+}
+
+/* log a transfer */
+void lpp_log_xfer(struct lpp_context_t *context, 
+                  const unsigned char kind,
+                  const unsigned char command, 
+                  const unsigned int data,
+                  const unsigned char result,
+                  const unsigned char pgc_value)
+{
+    const unsigned int head = context->log_head;
+    struct lpp_log_record_t *record;
+
+    /* not logging? */
+    if (context->log_records == NULL) return;
+
+    /* overwrite the oldest record */
+    record = lpp_log_record_get(context, head);
+    record->timestamp_ns = lpp_timing_now_ns();
+    record->data = data;
+    record->kind = kind;
+    record->command = command;
+    record->result = result;
+    record->pgc_value = pgc_value;
+
+    /* publish it only once it's filled, for whoever is reading the ring */
+    __atomic_store_n(&context->log_head, head + 1, __ATOMIC_RELEASE);
+}
+
+/* initialize a decoder */
+void lpp_log_decoder_init(struct lpp_log_decoder_t *decoder)
+{
+    /* nothing is known */
+    memset(decoder, 0, sizeof(*decoder));
+}
+
+/* append to a line */
+static void lpp_log_append(char *line, const unsigned int line_size, const char *format, ...)
+{
+    const unsigned int length = strlen(line);
+    va_list args;
+
+    /* no room */
+    if (length + 1 >= line_size) return;
+
+    /* format after what's there */
+    va_start(args, format);
+    vsnprintf(line + length, line_size - length, format, args);
+    va_end(args);
+}
+
+/* append a register name */
+static void lpp_log_append_reg(char *line, const unsigned int line_size, const unsigned char reg)
+{
+    switch (reg)
+    {
+        case LPP_REG_TBLPTRU:   lpp_log_append(line, line_size, "TBLPTRU"); break;
+        case LPP_REG_TBLPTRH:   lpp_log_append(line, line_size, "TBLPTRH"); break;
+        case LPP_REG_TBLPTRL:   lpp_log_append(line, line_size, "TBLPTRL"); break;
+        case LPP_REG_TABLAT:    lpp_log_append(line, line_size, "TABLAT"); break;
+        case LPP_REG_EEDATA:    lpp_log_append(line, line_size, "EEDATA"); break;
+        case LPP_REG_EEADR:     lpp_log_append(line, line_size, "EEADR"); break;
+        case LPP_REG_EEADRH:    lpp_log_append(line, line_size, "EEADRH"); break;
+        case LPP_REG_EECON2:    lpp_log_append(line, line_size, "EECON2"); break;
+        case LPP_REG_EECON1:    lpp_log_append(line, line_size, "EECON1"); break;
+        default:                lpp_log_append(line, line_size, "0x%02X", reg); break;
+    }
+}
+
+/* set a register the decoder follows */
+static void lpp_log_decoder_reg_set(struct lpp_log_decoder_t *decoder, 
+                                    const unsigned char reg, 
+                                    const unsigned char value, 
+                                    const int valid)
+{
+    decoder->regs[reg] = value;
+    decoder->regs_valid[reg] = valid;
+}
+
+/* is TBLPTR known? */
+#define lpp_log_decoder_tblptr_valid(decoder)                           \
+        ((decoder)->regs_valid[LPP_REG_TBLPTRU] &&                      \
+         (decoder)->regs_valid[LPP_REG_TBLPTRH] &&                      \
+         (decoder)->regs_valid[LPP_REG_TBLPTRL])
+
+/* get TBLPTR */
+#define lpp_log_decoder_tblptr(decoder)                                 \
+        ((((decoder)->regs[LPP_REG_TBLPTRU] & 0x3F) << 16) |            \
+          ((decoder)->regs[LPP_REG_TBLPTRH] << 8)          |            \
+           (decoder)->regs[LPP_REG_TBLPTRL])
+
+/* add to TBLPTR */
+static void lpp_log_decoder_tblptr_add(struct lpp_log_decoder_t *decoder, const int delta)
+{
+    const unsigned int tblptr = (lpp_log_decoder_tblptr(decoder) + delta) & LPP_TBLPTR_MASK;
+
+    /* write it back */
+    decoder->regs[LPP_REG_TBLPTRU] = (tblptr >> 16);
+    decoder->regs[LPP_REG_TBLPTRH] = (tblptr >> 8);
+    decoder->regs[LPP_REG_TBLPTRL] = (tblptr >> 0);
+}
+
+/* disassemble a core instruction, following its effect */
+static void lpp_log_decode_core(struct lpp_log_decoder_t *decoder, 
+                                const unsigned short instruction,
+                                char *line,
+                                const unsigned int line_size)
 {
-    /* check if room available */
-    if (context->log_current_idx < context->log_record_count)
+    const unsigned char f = (instruction & 0xFF);
+
+    /* nop */
+    if (instruction == LPP_OP_NOP)
+        lpp_log_append(line, line_size, "nop");
+
+    /* movlw */
+    else if ((instruction & 0xFF00) == LPP_OP_MOVLW(0))
+    {
+        lpp_log_append(line, line_size, "movlw 0x%02X", f);
+        decoder->w = f;
+        decoder->w_valid = 1;
+    }
+
+    /* movwf */
+    else if ((instruction & 0xFF00) == LPP_OP_MOVWF(0))
+    {
+        lpp_log_append(line, line_size, "movwf ");
+        lpp_log_append_reg(line, line_size, f);
+        lpp_log_decoder_reg_set(decoder, f, decoder->w, decoder->w_valid);
+    }
+
+    /* movf, to w or to itself */
+    else if ((instruction & 0xFD00) == LPP_OP_MOVF_W(0))
+    {
+        lpp_log_append(line, line_size, "movf ");
+        lpp_log_append_reg(line, line_size, f);
+        lpp_log_append(line, line_size, (instruction & 0x0200) ? ", F" : ", W");
+
+        /* to w */
+        if (!(instruction & 0x0200))
+        {
+            decoder->w = decoder->regs[f];
+            decoder->w_valid = decoder->regs_valid[f];
+        }
+    }
+
+    /* incf, to w or to itself */
+    else if ((instruction & 0xFD00) == 0x2800)
+    {
+        lpp_log_append(line, line_size, "incf ");
+        lpp_log_append_reg(line, line_size, f);
+        lpp_log_append(line, line_size, (instruction & 0x0200) ? ", F" : ", W");
+
+        /* to itself or to w */
+        if (instruction & 0x0200) 
+            decoder->regs[f]++;
+        else
+        {
+            decoder->w = decoder->regs[f] + 1;
+            decoder->w_valid = decoder->regs_valid[f];
+        }
+    }
+
+    /* bsf/bcf */
+    else if ((instruction & 0xE100) == 0x8000)
     {
-        /* log the command */
-        context->log_records[context->log_current_idx].command = command;
-        context->log_records[context->log_current_idx].data = data;
+        const unsigned int bit = ((instruction >> 9) & 0x7);
 
-        /* point to next record */
-        context->log_current_idx++;
+        /* name the bit if it's EECON1's */
+        lpp_log_append(line, line_size, (instruction & 0x1000) ? "bcf " : "bsf ");
+        lpp_log_append_reg(line, line_size, f);
+        if (f == LPP_REG_EECON1) lpp_log_append(line, line_size, ", %s", lpp_log_eecon1_bit_names[bit]);
+        else lpp_log_append(line, line_size, ", %d", bit);
 
-        /* ok */
-        return 1;
+        /* follow it */
+        if (instruction & 0x1000) decoder->regs[f] &= ~(1 << bit);
+        else decoder->regs[f] |= (1 << bit);
+
+        /* eeprom reads and writes happen at EEADR */
+        if (f == LPP_REG_EECON1 && !(instruction & 0x1000) && (bit == 0 || bit == 1) && 
+            decoder->regs_valid[LPP_REG_EEADR] && decoder->regs_valid[LPP_REG_EEADRH])
+        {
+            lpp_log_append(line, line_size, "\t; EEADR=%04X", 
+                           (decoder->regs[LPP_REG_EEADRH] << 8) | decoder->regs[LPP_REG_EEADR]);
+        }
     }
+
+    /* goto, first word then second */
+    else if ((instruction & 0xFF00) == LPP_SET_PC_100K_0)
+        lpp_log_append(line, line_size, "goto 0x%02X...", f);
+    else if ((instruction & 0xF000) == 0xF000)
+        lpp_log_append(line, line_size, "nop (0x%03X)", instruction & 0xFFF);
+
+    /* not something lpicp issues */
     else
+        lpp_log_append(line, line_size, "dw 0x%04X", instruction);
+}
+
+/* disassemble a table command, following its effect */
+static void lpp_log_decode_table(struct lpp_log_decoder_t *decoder, 
+                                 const struct lpp_log_record_t *record,
+                                 char *line,
+                                 const unsigned int line_size)
+{
+    const int tblptr_valid = lpp_log_decoder_tblptr_valid(decoder);
+    const unsigned int tblptr = lpp_log_decoder_tblptr(decoder);
+
+    /* by command */
+    switch (record->command)
     {
-        /* no room */
-        return 0;
+        case LPP_ICSP_CMD_SHIFT_TABLAT_REG:         lpp_log_append(line, line_size, "shift out TABLAT"); break;
+        case LPP_ICSP_CMD_TBL_RD:                   lpp_log_append(line, line_size, "tblrd*"); break;
+        case LPP_ICSP_CMD_TBL_RD_POST_INC:          lpp_log_append(line, line_size, "tblrd*+"); break;
+        case LPP_ICSP_CMD_TBL_RD_POST_DEC:          lpp_log_append(line, line_size, "tblrd*-"); break;
+        case LPP_ICSP_CMD_TBL_RD_PRE_INC:           lpp_log_append(line, line_size, "tblrd+*"); break;
+        case LPP_ICSP_CMD_TBL_WR_POST_INC:          lpp_log_append(line, line_size, "tblwt* 0x%04X", record->data); break;
+        case LPP_ICSP_CMD_TBL_WR_POST_INC_2:        lpp_log_append(line, line_size, "tblwt*+2 0x%04X", record->data); break;
+        case LPP_ICSP_CMD_TBL_WR_PROG_POST_INC_2:   lpp_log_append(line, line_size, "tblwt*+2 0x%04X, program", record->data); break;
+        case LPP_ICSP_CMD_TBL_WR_PROG:              lpp_log_append(line, line_size, "tblwt* 0x%04X, program", record->data); break;
+        default:                                    lpp_log_append(line, line_size, "command %X", record->command); break;
+    }
+
+    /* what was read */
+    if (record->kind == LPP_LOG_KIND_RX) lpp_log_append(line, line_size, " -> %02X", record->data);
+
+    /* where, for table accesses */
+    if (record->command != LPP_ICSP_CMD_SHIFT_TABLAT_REG && tblptr_valid)
+        lpp_log_append(line, line_size, "\t; TBLPTR=%06X", tblptr);
+
+    /* follow TBLPTR */
+    switch (record->command)
+    {
+        case LPP_ICSP_CMD_TBL_RD_POST_INC:
+        case LPP_ICSP_CMD_TBL_RD_PRE_INC:           lpp_log_decoder_tblptr_add(decoder, 1); break;
+        case LPP_ICSP_CMD_TBL_RD_POST_DEC:          lpp_log_decoder_tblptr_add(decoder, -1); break;
+        case LPP_ICSP_CMD_TBL_WR_POST_INC_2:
+        case LPP_ICSP_CMD_TBL_WR_PROG_POST_INC_2:   lpp_log_decoder_tblptr_add(decoder, 2); break;
     }
 }
 
-/* initialize a context */
+/* disassemble and annotate a record */
+void lpp_log_decode(struct lpp_log_decoder_t *decoder, 
+                    const struct lpp_log_record_t *record,
+                    char *line,
+                    const unsigned int line_size)
+{
+    static const char *kind_names[] = {"tx", "rx", "cmd", "data", "delay"};
+    unsigned long long since_first_ns, since_previous_ns;
+    char cmd_string[LPP_COMMAND_BIT_COUNT + 1];
+
+    /* time is relative to the first record */
+    if (decoder->record_idx == 0) 
+        decoder->first_timestamp_ns = decoder->previous_timestamp_ns = record->timestamp_ns;
+    since_first_ns = record->timestamp_ns - decoder->first_timestamp_ns;
+    since_previous_ns = record->timestamp_ns - decoder->previous_timestamp_ns;
+    decoder->previous_timestamp_ns = record->timestamp_ns;
+
+    /* index, time, kind */
+    line[0] = '\0';
+    lpp_log_append(line, line_size, "[%06d] %10llu.%03lluus (+%6llu.%03llu) %-5s ", 
+                   decoder->record_idx++, 
+                   since_first_ns / 1000, since_first_ns % 1000,
+                   since_previous_ns / 1000, since_previous_ns % 1000,
+                   (record->kind < sizeof(kind_names) / sizeof(kind_names[0])) ? kind_names[record->kind] : "?");
+
+    /* by kind */
+    switch (record->kind)
+    {
+        /* commands with data */
+        case LPP_LOG_KIND_TX:
+        case LPP_LOG_KIND_RX:
+        {
+            /* raw */
+            lpp_log_format_cmd_string(record->command, cmd_string, sizeof(cmd_string));
+            lpp_log_append(line, line_size, "cmd(%s) data(%04X)  ", cmd_string, record->data);
+
+            /* disassembled */
+            if (record->command == LPP_ICSP_CMD_CORE_INST && record->kind == LPP_LOG_KIND_TX)
+                lpp_log_decode_core(decoder, record->data, line, line_size);
+            else
+                lpp_log_decode_table(decoder, record, line, line_size);
+        }
+        break;
+
+        /* command with a hold after it */
+        case LPP_LOG_KIND_CMD_ONLY:
+            lpp_log_format_cmd_string(record->command, cmd_string, sizeof(cmd_string));
+            lpp_log_append(line, line_size, "cmd(%s) hold PGC %s for %dus", 
+                           cmd_string, record->pgc_value ? "high" : "low", record->data);
+            break;
+
+        /* data alone */
+        case LPP_LOG_KIND_DATA_ONLY:
+            lpp_log_append(line, line_size, "data(%04X)", record->data);
+            break;
+
+        /* delay */
+        case LPP_LOG_KIND_DELAY:
+            lpp_log_append(line, line_size, "%dus", record->data);
+            break;
+    }
+
+    /* say if it failed */
+    if (!record->result) lpp_log_append(line, line_size, "  FAILED");
+}
+
+/* initialize the log */
 int lpp_log_init(struct lpp_context_t *context,
                  const unsigned int log_record_count)
 {
-    int log_size_bytes;
+    unsigned int ring_record_count;
 
-    /* init current log record */
-    context->log_current_idx = 0;
+    /* init head */
+    context->log_head = 0;
 
-    /* calc how big the log is, in bytes */
-    log_size_bytes = sizeof(struct lpp_log_record_t) * log_record_count;
+    /* round the ring up to a power of two, so that indexes can just wrap */
+    for (ring_record_count = 1; ring_record_count < log_record_count; ring_record_count <<= 1);
 
     /* try to allocate log */
-    context->log_records = malloc(log_size_bytes);
+    context->log_records = calloc(ring_record_count, sizeof(struct lpp_log_record_t));
 
     /* check allocation */
     if (context->log_records == NULL)
@@ -124,10 +460,7 @@ int lpp_log_init(struct lpp_context_t *context,
     }
 
     /* save command log info */
-    context->log_record_count = log_record_count;
-
-    /* init command log */
-    memset(context->log_records, 0, log_size_bytes);
+    context->log_record_count = ring_record_count;
 
     /* success */
     return 1;
@@ -149,7 +482,7 @@ int lpp_log_destroy(struct lpp_context_t *context)
 
     /* init counters */
     context->log_record_count = 0;
-    context->log_current_idx = 0;
+    context->log_head = 0;
 
     /* success */
     return 1;
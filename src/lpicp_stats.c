@@ -0,0 +1,187 @@
+/* 
+ * Linux PIC Programmer (lpicp)
+ * Performance counters implementation
+ *
+ * Author: Eran Duchan <pavius@gmail.com>
+ *
+ * This program is free software; you can redistribute  it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "lpicp.h"
+#include "lpicp_icsp.h"
+#include "lpicp_stats.h"
+
+/* phase names, by phase */
+static const char *lpp_stats_phase_names[LPP_STATS_PHASE_COUNT] = 
+{
+    "detect", "load", "erase", "program", "config", "eeprom", "verify", "read"
+};
+
+/* get host CPU time of the process, in ns */
+static unsigned long long lpp_stats_cpu_now_ns(void)
+{
+    struct timespec cpu_time;
+
+    /* get time */
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_time);
+
+    /* convert */
+    return cpu_time.tv_sec * 1000000000ULL + cpu_time.tv_nsec;
+}
+
+/* start counting the current phase from now */
+static void lpp_stats_phase_start(struct lpp_context_t *context)
+{
+    context->stats.phase_start_ns = lpp_timing_now_ns();
+    context->stats.phase_start_cpu_ns = lpp_stats_cpu_now_ns();
+    context->stats.phase_start_delay_ns = context->timing.achieved_ns;
+}
+
+/* add the time since the current phase was started to it */
+static void lpp_stats_phase_account(struct lpp_context_t *context)
+{
+    struct lpp_stats_counters_t *counters = lpp_stats_current(context);
+
+    /* add it up */
+    counters->wall_ns += lpp_timing_now_ns() - context->stats.phase_start_ns;
+    counters->cpu_ns += lpp_stats_cpu_now_ns() - context->stats.phase_start_cpu_ns;
+    counters->delay_ns += context->timing.achieved_ns - context->stats.phase_start_delay_ns;
+
+    /* and go on from here */
+    lpp_stats_phase_start(context);
+}
+
+/* start counting */
+void lpp_stats_init(struct lpp_context_t *context)
+{
+    /* zero out */
+    memset(&context->stats, 0, sizeof(context->stats));
+
+    /* first phase */
+    context->stats.phase = LPP_STATS_PHASE_DETECT;
+    lpp_stats_phase_start(context);
+}
+
+/* start counting a phase */
+int lpp_stats_phase_set(struct lpp_context_t *context, const enum lpp_stats_phase_t phase)
+{
+    /* whatever was queued belongs to the phase we're leaving */
+    if (context->xfer_queue) lpp_icsp_flush(context);
+
+    /* close it */
+    lpp_stats_phase_account(context);
+
+    /* switch */
+    context->stats.phase = phase;
+
+    /* always succeeds */
+    return 1;
+}
+
+/* get the up to date counters of a phase, or the total */
+void lpp_stats_get(struct lpp_context_t *context, 
+                   const enum lpp_stats_phase_t phase,
+                   struct lpp_stats_counters_t *counters)
+{
+    unsigned int phase_idx;
+
+    /* bring the current phase up to date */
+    lpp_stats_phase_account(context);
+
+    /* just the one */
+    if (phase < LPP_STATS_PHASE_COUNT)
+    {
+        *counters = context->stats.phases[phase];
+        return;
+    }
+
+    /* add them all up */
+    memset(counters, 0, sizeof(*counters));
+    for (phase_idx = 0; phase_idx < LPP_STATS_PHASE_COUNT; ++phase_idx)
+    {
+        const struct lpp_stats_counters_t *phase_counters = &context->stats.phases[phase_idx];
+
+        counters->transfers     += phase_counters->transfers;
+        counters->syscalls      += phase_counters->syscalls;
+        counters->bytes_tx      += phase_counters->bytes_tx;
+        counters->bytes_rx      += phase_counters->bytes_rx;
+        counters->retries       += phase_counters->retries;
+        counters->wall_ns       += phase_counters->wall_ns;
+        counters->transport_ns  += phase_counters->transport_ns;
+        counters->delay_ns      += phase_counters->delay_ns;
+        counters->cpu_ns        += phase_counters->cpu_ns;
+    }
+}
+
+/* get the name of a phase */
+const char *lpp_stats_phase_name(const enum lpp_stats_phase_t phase)
+{
+    return (phase < LPP_STATS_PHASE_COUNT) ? lpp_stats_phase_names[phase] : "total";
+}
+
+/* print the counters of a phase */
+static void lpp_stats_print_counters(FILE *file, 
+                                     const char *name, 
+                                     const struct lpp_stats_counters_t *counters, 
+                                     const int json)
+{
+    /* time in the transport is split into the bus and delays, what's left of the wall time is the host's */
+    const unsigned long long bus_ns = (counters->transport_ns > counters->delay_ns) ? 
+                                        (counters->transport_ns - counters->delay_ns) : 0;
+    const unsigned long long host_ns = (counters->wall_ns > counters->transport_ns) ? 
+                                        (counters->wall_ns - counters->transport_ns) : 0;
+
+    /* as a json member, or a table row */
+    if (json)
+    {
+        fprintf(file, "\"%s\": {\"transfers\": %u, \"syscalls\": %u, \"bytes_tx\": %llu, \"bytes_rx\": %llu, "
+                      "\"retries\": %u, \"wall_ns\": %llu, \"bus_ns\": %llu, \"delay_ns\": %llu, "
+                      "\"host_ns\": %llu, \"cpu_ns\": %llu}",
+                name, counters->transfers, counters->syscalls, counters->bytes_tx, counters->bytes_rx,
+                counters->retries, counters->wall_ns, bus_ns, counters->delay_ns, host_ns, counters->cpu_ns);
+    }
+    else
+    {
+        fprintf(file, "%-8s %10u %9u %9llu %9llu %7u %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+                name, counters->transfers, counters->syscalls, counters->bytes_tx, counters->bytes_rx,
+                counters->retries, counters->wall_ns / 1e6, bus_ns / 1e6, counters->delay_ns / 1e6, 
+                host_ns / 1e6, counters->cpu_ns / 1e6);
+    }
+}
+
+/* print the counters */
+void lpp_stats_print(struct lpp_context_t *context, FILE *file, const int json)
+{
+    struct lpp_stats_counters_t counters;
+    unsigned int phase_idx, printed_count;
+
+    /* header */
+    if (json) fprintf(file, "{\"phases\": {");
+    else fprintf(file, "%-8s %10s %9s %9s %9s %7s %10s %10s %10s %10s %10s\n", 
+                 "phase", "transfers", "syscalls", "bytes_tx", "bytes_rx", "retries", 
+                 "wall_ms", "bus_ms", "delay_ms", "host_ms", "cpu_ms");
+
+    /* phases that were entered */
+    for (phase_idx = printed_count = 0; phase_idx < LPP_STATS_PHASE_COUNT; ++phase_idx)
+    {
+        /* skip those that weren't */
+        lpp_stats_get(context, phase_idx, &counters);
+        if (counters.wall_ns == 0 && counters.transfers == 0) continue;
+
+        /* print it */
+        if (json && printed_count++) fprintf(file, ", ");
+        lpp_stats_print_counters(file, lpp_stats_phase_name(phase_idx), &counters, json);
+    }
+
+    /* and the total */
+    lpp_stats_get(context, LPP_STATS_PHASE_COUNT, &counters);
+    if (json) fprintf(file, "}, ");
+    lpp_stats_print_counters(file, lpp_stats_phase_name(LPP_STATS_PHASE_COUNT), &counters, json);
+    if (json) fprintf(file, "}\n");
+}
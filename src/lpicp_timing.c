@@ -0,0 +1,146 @@
+/* 
+ * Linux PIC Programmer (lpicp)
+ * Timing engine implementation
+ *
+ * Author: Eran Duchan <pavius@gmail.com>
+ *
+ * This program is free software; you can redistribute  it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "lpicp_timing.h"
+
+/* number of sleeps done to measure wake up latency, and for how long */
+#define LPP_TIMING_CALIBRATION_SLEEPS       (8)
+#define LPP_TIMING_CALIBRATION_SLEEP_NS     (100000)
+
+/* don't trust wake up latency beyond this - past it we'd just spin for too long */
+#define LPP_TIMING_MAX_OVERSHOOT_NS         (500000)
+
+/* convert a timespec to ns */
+#define lpp_timing_timespec_to_ns(ts) ((ts)->tv_sec * 1000000000ULL + (ts)->tv_nsec)
+
+/* get monotonic time, in ns */
+unsigned long long lpp_timing_now_ns(void)
+{
+    struct timespec current_time;
+
+    /* get time */
+    clock_gettime(CLOCK_MONOTONIC, &current_time);
+
+    /* convert */
+    return lpp_timing_timespec_to_ns(&current_time);
+}
+
+/* sleep until an absolute monotonic time, returns 0 if the sleep failed */
+static int lpp_timing_sleep_until(const unsigned long long wakeup_ns)
+{
+    struct timespec wakeup_time;
+    int ret;
+
+    /* convert */
+    wakeup_time.tv_sec = wakeup_ns / 1000000000ULL;
+    wakeup_time.tv_nsec = wakeup_ns % 1000000000ULL;
+
+    /* sleep, resuming only if interrupted - any other error won't go away by retrying */
+    do ret = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wakeup_time, NULL); while (ret == EINTR);
+
+    /* return result */
+    return (ret == 0);
+}
+
+/* calibrate */
+int lpp_timing_init(struct lpp_timing_t *timing)
+{
+    unsigned int sleep_idx;
+
+    /* init structure */
+    memset(timing, 0, sizeof(struct lpp_timing_t));
+
+    /* measure how late a sleep wakes up - the worst seen is what we spin through */
+    for (sleep_idx = 0; sleep_idx < LPP_TIMING_CALIBRATION_SLEEPS; ++sleep_idx)
+    {
+        const unsigned long long wakeup_ns = lpp_timing_now_ns() + LPP_TIMING_CALIBRATION_SLEEP_NS;
+        unsigned long long overshoot_ns;
+
+        /* sleep and see when we woke up. a failed sleep says nothing about latency */
+        if (!lpp_timing_sleep_until(wakeup_ns)) continue;
+        overshoot_ns = lpp_timing_now_ns() - wakeup_ns;
+
+        /* keep worst */
+        if (overshoot_ns > timing->sleep_overshoot_ns)
+            timing->sleep_overshoot_ns = (overshoot_ns < LPP_TIMING_MAX_OVERSHOOT_NS) ? 
+                                            overshoot_ns : LPP_TIMING_MAX_OVERSHOOT_NS;
+    }
+
+    /* success */
+    return 1;
+}
+
+/* busy wait */
+void lpp_timing_spin_ns(const unsigned int delay_ns)
+{
+    unsigned long long deadline_ns;
+
+    /* nothing to do */
+    if (delay_ns == 0) return;
+
+    /* spin until deadline passed */
+    for (deadline_ns = lpp_timing_now_ns() + delay_ns; lpp_timing_now_ns() < deadline_ns;);
+}
+
+/* wait at least the given time */
+int lpp_timing_delay_ns(struct lpp_timing_t *timing, const unsigned long long delay_ns)
+{
+    const unsigned long long start_ns = lpp_timing_now_ns();
+    const unsigned long long deadline_ns = start_ns + delay_ns;
+    unsigned long long current_ns, achieved_ns;
+
+    /* sleep through whatever the wake up latency leaves room for. if the sleep fails, 
+     * the spin below covers the whole delay */
+    if (delay_ns > timing->sleep_overshoot_ns)
+        lpp_timing_sleep_until(deadline_ns - timing->sleep_overshoot_ns);
+
+    /* and spin the rest of the way */
+    do current_ns = lpp_timing_now_ns(); while (current_ns < deadline_ns);
+
+    /* account */
+    achieved_ns = current_ns - start_ns;
+    timing->delay_count++;
+    timing->requested_ns += delay_ns;
+    timing->achieved_ns += achieved_ns;
+    if (achieved_ns - delay_ns > timing->max_overshoot_ns) 
+        timing->max_overshoot_ns = achieved_ns - delay_ns;
+
+    /* success */
+    return 1;
+}
+
+/* wait at least the given time, in us */
+int lpp_timing_delay_us(struct lpp_timing_t *timing, const unsigned int delay_us)
+{
+    /* convert */
+    return lpp_timing_delay_ns(timing, delay_us * 1000ULL);
+}
+
+/* print achieved delay statistics */
+void lpp_timing_print(struct lpp_timing_t *timing)
+{
+    /* nothing to print */
+    if (timing->delay_count == 0) return;
+
+    /* print it */
+    printf("Delays: %u, requested %llu us, achieved %llu us (overshoot avg %llu ns, max %u ns, sleep latency %u ns)\n", 
+           timing->delay_count, 
+           timing->requested_ns / 1000, 
+           timing->achieved_ns / 1000,
+           (timing->achieved_ns - timing->requested_ns) / timing->delay_count,
+           timing->max_overshoot_ns,
+           timing->sleep_overshoot_ns);
+}
@@ -0,0 +1,132 @@
+/* 
+ * Linux PIC Programmer (lpicp)
+ * Transport base implementation
+ *
+ * Author: Eran Duchan <pavius@gmail.com>
+ *
+ * This program is free software; you can redistribute  it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lpicp.h"
+#include "lpicp_transport.h"
+
+/* forward declare all structures */
+#ifdef LPP_HAVE_MC_ICSP_H
+extern struct lpp_transport_t lpp_transport_icsp_driver;
+#endif
+extern struct lpp_transport_t lpp_transport_gpio;
+extern struct lpp_transport_t lpp_transport_sim;
+extern struct lpp_transport_t lpp_transport_mmio;
+extern struct lpp_transport_t lpp_transport_replay;
+
+/* get transport structure by type */
+int lpp_transport_init_by_type(struct lpp_context_t *context, 
+                               const enum lpp_transport_type_t type)
+{
+    /* by type */
+    switch (type)
+    {
+        /* kernel ICSP driver */
+        case LPP_TRANSPORT_ICSP_DRIVER:
+#ifdef LPP_HAVE_MC_ICSP_H
+            context->transport = &lpp_transport_icsp_driver;
+#else
+            printf("Built without the ICSP kernel driver (linux/mc_icsp.h)\n");
+            context->transport = NULL;
+#endif
+            break;
+
+        /* GPIO character device */
+        case LPP_TRANSPORT_GPIO:
+            context->transport = &lpp_transport_gpio;
+            break;
+
+        /* simulated target */
+        case LPP_TRANSPORT_SIM:
+            context->transport = &lpp_transport_sim;
+            break;
+
+        /* memory mapped GPIO registers */
+        case LPP_TRANSPORT_MMIO:
+            context->transport = &lpp_transport_mmio;
+            break;
+
+        /* captured session */
+        case LPP_TRANSPORT_REPLAY:
+            context->transport = &lpp_transport_replay;
+            break;
+
+        /* unknown */
+        default:
+            context->transport = NULL;
+            break;
+    }
+
+    /* success if a transport has been assigned */
+    return (context->transport != NULL);
+}
+
+/* get the path part of a device name */
+int lpp_transport_get_path(const char *dev_name, 
+                           char *path, 
+                           const unsigned int path_size)
+{
+    const char *options_start;
+    unsigned int path_length;
+
+    /* path ends where options start */
+    options_start = strchr(dev_name, ':');
+    path_length = options_start ? (unsigned int)(options_start - dev_name) : strlen(dev_name);
+
+    /* make sure there's room for path and null term */
+    if (path_length >= path_size) return 0;
+
+    /* copy it */
+    memcpy(path, dev_name, path_length);
+    path[path_length] = '\0';
+
+    /* success */
+    return 1;
+}
+
+/* get a numeric option from a device name */
+int lpp_transport_get_option(const char *dev_name, 
+                             const char *option_name, 
+                             unsigned int *value)
+{
+    const char *current_option;
+    const unsigned int option_name_length = strlen(option_name);
+
+    /* options start after the path */
+    current_option = strchr(dev_name, ':');
+
+    /* iterate over "<name>=<value>" pairs */
+    while (current_option != NULL)
+    {
+        /* skip delimiter */
+        current_option++;
+
+        /* is this the option? */
+        if (strncmp(current_option, option_name, option_name_length) == 0 && 
+            current_option[option_name_length] == '=')
+        {
+            /* parse value */
+            *value = strtoul(current_option + option_name_length + 1, NULL, 0);
+
+            /* found */
+            return 1;
+        }
+
+        /* next option */
+        current_option = strchr(current_option, ',');
+    }
+
+    /* not found */
+    return 0;
+}
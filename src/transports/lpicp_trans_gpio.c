@@ -0,0 +1,399 @@
+/* 
+ * Linux PIC Programmer (lpicp)
+ * Transport over the GPIO character device (bit-banged from userspace)
+ *
+ * Author: Eran Duchan <pavius@gmail.com>
+ *
+ * This program is free software; you can redistribute  it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ */
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+#include "lpicp.h"
+#include "lpicp_icsp.h"
+#include "lpicp_transport.h"
+
+/* max number of clock edges in a single waveform (4 command bits + 16 data bits) */
+#define LPP_TRANS_GPIO_MAX_EDGES ((LPP_COMMAND_BIT_COUNT + 16) * 2)
+
+/* line bits, by order of request (mclr and pgm are optional and come last) */
+#define LPP_TRANS_GPIO_PGC_BIT (1ULL << 0)
+#define LPP_TRANS_GPIO_PGD_BIT (1ULL << 1)
+
+/* transport state */
+struct lpp_trans_gpio_t
+{
+    struct lpp_context_t        *context;       /* for counting syscalls */
+    int                         chip_file;
+    int                         line_file;
+    unsigned long long          mclr_bit;
+    unsigned long long          pgm_bit;
+    unsigned long long          output_bits;
+    unsigned int                half_period_ns;
+    struct gpio_v2_line_config  pgd_input_config;
+    struct gpio_v2_line_config  pgd_output_config;
+    struct gpio_v2_line_values  waveform[LPP_TRANS_GPIO_MAX_EDGES];
+};
+
+/* get the transport state */
+#define lpp_trans_gpio_get(context) ((struct lpp_trans_gpio_t *)(context)->transport_data)
+
+/* busy wait for the configured half period, nothing to do if the syscall is slow enough */
+#define lpp_trans_gpio_half_period(gpio) lpp_timing_spin_ns((gpio)->half_period_ns)
+
+/* set the value of a number of lines at once */
+static int lpp_trans_gpio_set(struct lpp_trans_gpio_t *gpio, 
+                              const unsigned long long bits, 
+                              const unsigned long long mask)
+{
+    struct gpio_v2_line_values values = {.bits = bits, .mask = mask};
+
+    /* save what we drive */
+    gpio->output_bits = (gpio->output_bits & ~mask) | (bits & mask);
+
+    /* set the lines */
+    lpp_stats_syscall(gpio->context);
+    return (ioctl(gpio->line_file, GPIO_V2_LINE_SET_VALUES_IOCTL, &values) == 0);
+}
+
+/* append clocking out a value to a waveform, returns the number of edges in the waveform */
+static unsigned int lpp_trans_gpio_waveform_add(struct lpp_trans_gpio_t *gpio, 
+                                                unsigned int edge_idx, 
+                                                const unsigned int value, 
+                                                const unsigned int bit_count)
+{
+    unsigned int bit_idx;
+
+    /* LSb first. data is set with the rising edge and sampled by the PIC on the falling edge */
+    for (bit_idx = 0; bit_idx < bit_count; ++bit_idx)
+    {
+        /* get the data bit */
+        const unsigned long long pgd = ((value >> bit_idx) & 0x1) ? LPP_TRANS_GPIO_PGD_BIT : 0;
+
+        /* rising edge, with data */
+        gpio->waveform[edge_idx].bits = LPP_TRANS_GPIO_PGC_BIT | pgd;
+        gpio->waveform[edge_idx++].mask = LPP_TRANS_GPIO_PGC_BIT | LPP_TRANS_GPIO_PGD_BIT;
+
+        /* falling edge, data held */
+        gpio->waveform[edge_idx].bits = pgd;
+        gpio->waveform[edge_idx++].mask = LPP_TRANS_GPIO_PGC_BIT | LPP_TRANS_GPIO_PGD_BIT;
+    }
+
+    /* return number of edges */
+    return edge_idx;
+}
+
+/* clock out a waveform, one line-set ioctl per edge */
+static int lpp_trans_gpio_waveform_play(struct lpp_trans_gpio_t *gpio, 
+                                        const unsigned int edge_count)
+{
+    unsigned int edge_idx;
+
+    /* play the edges */
+    for (edge_idx = 0; edge_idx < edge_count; ++edge_idx)
+    {
+        /* set clock and data together */
+        lpp_stats_syscall(gpio->context);
+        if (ioctl(gpio->line_file, GPIO_V2_LINE_SET_VALUES_IOCTL, &gpio->waveform[edge_idx]) != 0)
+            return 0;
+
+        /* wait half a clock */
+        lpp_trans_gpio_half_period(gpio);
+    }
+
+    /* PGC and PGD now hold the last edge */
+    if (edge_count)
+    {
+        /* save it */
+        gpio->output_bits &= ~(LPP_TRANS_GPIO_PGC_BIT | LPP_TRANS_GPIO_PGD_BIT);
+        gpio->output_bits |= gpio->waveform[edge_count - 1].bits;
+    }
+
+    /* success */
+    return 1;
+}
+
+/* initialize the line configurations used to turn PGD around */
+static void lpp_trans_gpio_init_configs(struct lpp_trans_gpio_t *gpio)
+{
+    struct gpio_v2_line_config *config;
+
+    /* PGD as input, everything else stays an output */
+    config = &gpio->pgd_input_config;
+    memset(config, 0, sizeof(*config));
+    config->flags = GPIO_V2_LINE_FLAG_OUTPUT;
+    config->num_attrs = 1;
+    config->attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_FLAGS;
+    config->attrs[0].attr.flags = GPIO_V2_LINE_FLAG_INPUT;
+    config->attrs[0].mask = LPP_TRANS_GPIO_PGD_BIT;
+
+    /* all outputs. values are set before use, so that other lines don't glitch */
+    config = &gpio->pgd_output_config;
+    memset(config, 0, sizeof(*config));
+    config->flags = GPIO_V2_LINE_FLAG_OUTPUT;
+    config->num_attrs = 1;
+    config->attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+    config->attrs[0].mask = ~0ULL;
+}
+
+/* turn PGD around */
+static int lpp_trans_gpio_pgd_direction_set(struct lpp_trans_gpio_t *gpio, const int output)
+{
+    /* to output? */
+    if (output)
+    {
+        /* keep lines as they are, with PGD low */
+        gpio->output_bits &= ~LPP_TRANS_GPIO_PGD_BIT;
+        gpio->pgd_output_config.attrs[0].attr.values = gpio->output_bits;
+
+        /* set the config */
+        lpp_stats_syscall(gpio->context);
+        return (ioctl(gpio->line_file, GPIO_V2_LINE_SET_CONFIG_IOCTL, &gpio->pgd_output_config) == 0);
+    }
+    else
+    {
+        /* set the config */
+        lpp_stats_syscall(gpio->context);
+        return (ioctl(gpio->line_file, GPIO_V2_LINE_SET_CONFIG_IOCTL, &gpio->pgd_input_config) == 0);
+    }
+}
+
+/* open the gpio chip and request the lines */
+int lpp_trans_gpio_open(struct lpp_context_t *context, const char *dev_name)
+{
+    struct lpp_trans_gpio_t *gpio;
+    struct gpio_v2_line_request line_request;
+    char chip_path[LPP_TRANSPORT_MAX_PATH];
+    unsigned int pgc_line, pgd_line, mclr_line, pgm_line;
+
+    /* get chip and lines */
+    if (!lpp_transport_get_path(dev_name, chip_path, sizeof(chip_path))    ||
+        !lpp_transport_get_option(dev_name, "pgc", &pgc_line)               ||
+        !lpp_transport_get_option(dev_name, "pgd", &pgd_line))
+    {
+        /* need at least pgc/pgd */
+        printf("Expected <gpiochip>:pgc=<line>,pgd=<line>[,mclr=<line>][,pgm=<line>][,half_period_ns=<ns>]\n");
+        goto err_parse_dev_name;
+    }
+
+    /* allocate state */
+    gpio = calloc(1, sizeof(struct lpp_trans_gpio_t));
+    if (gpio == NULL) goto err_alloc_state;
+    gpio->context = context;
+
+    /* open the chip */
+    gpio->chip_file = open(chip_path, O_RDWR);
+
+    /* check */
+    if (gpio->chip_file < 0)
+    {
+        /* failed */
+        printf("Failed to open GPIO chip @ %s\n", chip_path);
+        goto err_open_chip;
+    }
+
+    /* set up the request, pgc and pgd first */
+    memset(&line_request, 0, sizeof(line_request));
+    strncpy(line_request.consumer, "lpicp", sizeof(line_request.consumer) - 1);
+    line_request.offsets[line_request.num_lines++] = pgc_line;
+    line_request.offsets[line_request.num_lines++] = pgd_line;
+
+    /* optional MCLR (programming voltage enable) */
+    if (lpp_transport_get_option(dev_name, "mclr", &mclr_line))
+    {
+        /* add line */
+        gpio->mclr_bit = (1ULL << line_request.num_lines);
+        line_request.offsets[line_request.num_lines++] = mclr_line;
+    }
+
+    /* optional PGM (low voltage programming enable) */
+    if (lpp_transport_get_option(dev_name, "pgm", &pgm_line))
+    {
+        /* add line */
+        gpio->pgm_bit = (1ULL << line_request.num_lines);
+        line_request.offsets[line_request.num_lines++] = pgm_line;
+    }
+
+    /* all outputs, low */
+    line_request.config.flags = GPIO_V2_LINE_FLAG_OUTPUT;
+
+    /* request the lines */
+    if (ioctl(gpio->chip_file, GPIO_V2_GET_LINE_IOCTL, &line_request) != 0)
+    {
+        /* failed */
+        printf("Failed to request GPIO lines from %s\n", chip_path);
+        goto err_request_lines;
+    }
+
+    /* save line file and options */
+    gpio->line_file = line_request.fd;
+    lpp_transport_get_option(dev_name, "half_period_ns", &gpio->half_period_ns);
+    lpp_trans_gpio_init_configs(gpio);
+
+    /* enter programming mode, if we control MCLR: PGM high, then MCLR high (P12/P15) */
+    if (gpio->mclr_bit && 
+        !(lpp_trans_gpio_set(gpio, gpio->pgm_bit, gpio->pgm_bit)   &&
+          lpp_timing_delay_us(&context->timing, 2)                   &&
+          lpp_trans_gpio_set(gpio, gpio->mclr_bit, gpio->mclr_bit) &&
+          lpp_timing_delay_us(&context->timing, 2)))
+    {
+        /* failed */
+        goto err_enter_program_mode;
+    }
+
+    /* save state */
+    context->transport_data = gpio;
+
+    /* success */
+    return 1;
+
+err_enter_program_mode:
+    close(gpio->line_file);
+err_request_lines:
+    close(gpio->chip_file);
+err_open_chip:
+    free(gpio);
+err_alloc_state:
+err_parse_dev_name:
+    return 0;
+}
+
+/* release the lines */
+int lpp_trans_gpio_close(struct lpp_context_t *context)
+{
+    struct lpp_trans_gpio_t *gpio = lpp_trans_gpio_get(context);
+
+    /* check if open */
+    if (gpio)
+    {
+        /* exit programming mode: MCLR, then everything else low */
+        if (gpio->mclr_bit) lpp_trans_gpio_set(gpio, 0, gpio->mclr_bit);
+        lpp_trans_gpio_set(gpio, 0, ~0ULL);
+
+        /* close files */
+        close(gpio->line_file);
+        close(gpio->chip_file);
+
+        /* free state */
+        free(gpio);
+        context->transport_data = NULL;
+    }
+
+    /* success */
+    return 1;
+}
+
+/* clock out command and 16 bits of data */
+int lpp_trans_gpio_tx(struct lpp_context_t *context, 
+                      const unsigned char command, 
+                      const unsigned short data)
+{
+    struct lpp_trans_gpio_t *gpio = lpp_trans_gpio_get(context);
+    unsigned int edge_count;
+
+    /* build the whole 20 bit transfer */
+    edge_count = lpp_trans_gpio_waveform_add(gpio, 0, command, LPP_COMMAND_BIT_COUNT);
+    edge_count = lpp_trans_gpio_waveform_add(gpio, edge_count, data, 16);
+
+    /* and play it */
+    return lpp_trans_gpio_waveform_play(gpio, edge_count);
+}
+
+/* clock out a command, 8 bits of 0 and clock in 8 bits of data */
+int lpp_trans_gpio_rx(struct lpp_context_t *context, 
+                      const unsigned char command, 
+                      unsigned char *data)
+{
+    struct lpp_trans_gpio_t *gpio = lpp_trans_gpio_get(context);
+    struct gpio_v2_line_values values;
+    unsigned int edge_count, bit_idx;
+    int ret;
+
+    /* command and 8 don't care clocks */
+    edge_count = lpp_trans_gpio_waveform_add(gpio, 0, command, LPP_COMMAND_BIT_COUNT);
+    edge_count = lpp_trans_gpio_waveform_add(gpio, edge_count, 0, 8);
+
+    /* play it and let the PIC drive PGD */
+    ret = lpp_trans_gpio_waveform_play(gpio, edge_count) && 
+          lpp_trans_gpio_pgd_direction_set(gpio, 0);
+
+    /* clock in the data, LSb first. data is valid after the rising edge */
+    for (*data = 0, bit_idx = 0; bit_idx < 8 && ret; ++bit_idx)
+    {
+        /* sample PGD */
+        values.mask = LPP_TRANS_GPIO_PGD_BIT;
+
+        /* rising edge, sample, falling edge */
+        lpp_stats_syscall(context);
+        ret = lpp_trans_gpio_set(gpio, LPP_TRANS_GPIO_PGC_BIT, LPP_TRANS_GPIO_PGC_BIT)        &&
+              ioctl(gpio->line_file, GPIO_V2_LINE_GET_VALUES_IOCTL, &values) == 0           &&
+              lpp_trans_gpio_set(gpio, 0, LPP_TRANS_GPIO_PGC_BIT);
+
+        /* shift in */
+        if (values.bits & LPP_TRANS_GPIO_PGD_BIT) *data |= (1 << bit_idx);
+    }
+
+    /* take PGD back */
+    return lpp_trans_gpio_pgd_direction_set(gpio, 1) && ret;
+}
+
+/* clock out a command only, possibly holding PGC/PGD for a while after the last bit */
+int lpp_trans_gpio_cmd_only(struct lpp_context_t *context, 
+                            const struct mc_icsp_cmd_only_t *cmd_config)
+{
+    struct lpp_trans_gpio_t *gpio = lpp_trans_gpio_get(context);
+    unsigned int edge_count;
+
+    /* build the command */
+    edge_count = lpp_trans_gpio_waveform_add(gpio, 0, cmd_config->command, LPP_COMMAND_BIT_COUNT);
+
+    /* drop the last falling edge if PGC is held high, then set PGD as requested */
+    if (cmd_config->pgc_value_after_cmd) edge_count--;
+    gpio->waveform[edge_count].bits = (cmd_config->pgc_value_after_cmd ? LPP_TRANS_GPIO_PGC_BIT : 0) | 
+                                      (cmd_config->pgd_value_after_cmd ? LPP_TRANS_GPIO_PGD_BIT : 0);
+    gpio->waveform[edge_count++].mask = LPP_TRANS_GPIO_PGC_BIT | LPP_TRANS_GPIO_PGD_BIT;
+
+    /* play it, hold for the requested time and release PGC */
+    return lpp_trans_gpio_waveform_play(gpio, edge_count)                                          &&
+           lpp_timing_delay_us(&context->timing, cmd_config->mdelay * 1000 + cmd_config->udelay)    &&
+           lpp_trans_gpio_set(gpio, 0, LPP_TRANS_GPIO_PGC_BIT);
+}
+
+/* clock out 16 bits of data only */
+int lpp_trans_gpio_data_only(struct lpp_context_t *context, 
+                             const unsigned int data)
+{
+    struct lpp_trans_gpio_t *gpio = lpp_trans_gpio_get(context);
+
+    /* build and play */
+    return lpp_trans_gpio_waveform_play(gpio, lpp_trans_gpio_waveform_add(gpio, 0, data, 16));
+}
+
+/* delay */
+int lpp_trans_gpio_delay(struct lpp_context_t *context, 
+                         const unsigned int delay_us)
+{
+    /* delay */
+    return lpp_timing_delay_us(&context->timing, delay_us);
+}
+
+/* operations */
+struct lpp_transport_t lpp_transport_gpio = 
+{
+    .name                       = "gpio",
+    .open                       = lpp_trans_gpio_open,
+    .close                      = lpp_trans_gpio_close,
+    .tx                         = lpp_trans_gpio_tx,
+    .rx                         = lpp_trans_gpio_rx,
+    .cmd_only                   = lpp_trans_gpio_cmd_only,
+    .data_only                  = lpp_trans_gpio_data_only,
+    .delay                      = lpp_trans_gpio_delay,
+};
@@ -0,0 +1,265 @@
+/* 
+ * Linux PIC Programmer (lpicp)
+ * Transport over the mc_icsp kernel driver
+ *
+ * Author: Eran Duchan <pavius@gmail.com>
+ *
+ * This program is free software; you can redistribute  it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include "lpicp.h"
+#include "lpicp_icsp.h"
+#include "lpicp_transport.h"
+
+/* 
+ * batching and block reads are only used if the driver header defines their ioctls - 
+ * lpicp never makes up request numbers of its own. the arguments below must match
+ * what that driver expects. drivers which define them but don't implement them 
+ * fail the ioctl, in which case each transaction is issued on its own
+ */
+#ifdef MC_ICSP_IOC_BATCH
+
+/* transaction, as passed to the driver in a batch */
+struct lpp_trans_icsp_batch_xfer_t
+{
+    unsigned int                type;           /* lpp_icsp_xfer_type_t */
+    unsigned int                value;          /* encoded xfer, data or delay in us */
+    struct mc_icsp_cmd_only_t   cmd_config;     /* command only configuration */
+};
+
+/* batch transfer ioctl argument */
+struct lpp_trans_icsp_batch_t
+{
+    unsigned int                        count;
+    struct lpp_trans_icsp_batch_xfer_t  *xfers;
+};
+
+#endif
+
+#ifdef MC_ICSP_IOC_RX_BLOCK
+
+/* block read ioctl argument, the driver issues the command for each byte and copies the data back */
+struct lpp_trans_icsp_rx_block_t
+{
+    unsigned int                command;        /* encoded xfer, issued for each byte */
+    unsigned int                count;
+    unsigned char               *data;
+};
+
+#endif
+
+/* open access to driver */
+int lpp_trans_icsp_open(struct lpp_context_t *context, const char *dev_name)
+{
+    /* open ICSP driver */
+    context->icsp_dev_file = open(dev_name, O_RDWR);
+
+    /* check */
+    if (context->icsp_dev_file < 0)
+    {
+        /* failed */
+        printf("Failed to open ICSP driver @ %s\n", dev_name);
+
+        /* failed */
+        goto err_icsp_open;
+    }
+
+#ifdef MC_ICSP_IOC_BATCH
+    /* allocate room to encode a full queue */
+    context->transport_data = malloc(sizeof(struct lpp_trans_icsp_batch_xfer_t) * LPP_ICSP_QUEUE_SIZE);
+
+    /* check allocation */
+    if (context->transport_data == NULL)
+    {
+        /* failed */
+        goto err_alloc_batch;
+    }
+#endif
+
+    /* success */
+    return 1;
+
+#ifdef MC_ICSP_IOC_BATCH
+err_alloc_batch:
+    close(context->icsp_dev_file);
+    context->icsp_dev_file = -1;
+#endif
+err_icsp_open:
+    return 0;
+}
+
+/* close access to driver */
+int lpp_trans_icsp_close(struct lpp_context_t *context)
+{
+    /* check if file exists */
+    if (context->icsp_dev_file >= 0)
+    {
+        /* close the file */
+        close(context->icsp_dev_file);
+    }
+
+    /* free batch buffer */
+    free(context->transport_data);
+    context->transport_data = NULL;
+
+    /* nullify */
+    context->icsp_dev_file = -1;
+
+    /* success */
+    return 1;
+}
+
+/* Write 16 bits via ICSP driver */
+int lpp_trans_icsp_tx(struct lpp_context_t *context, 
+                      const unsigned char command, 
+                      const unsigned short data)
+{
+    unsigned int xfer_command = 0;
+
+    /* encode the xfer */
+    MC_ICSP_ENCODE_XFER(command, data, xfer_command);
+
+    /* tx */
+    lpp_stats_syscall(context);
+    return (ioctl(context->icsp_dev_file, MC_ICSP_IOC_TX, xfer_command) == 0);
+}
+
+/* Read 8 bits via ICSP driver */
+int lpp_trans_icsp_rx(struct lpp_context_t *context, 
+                      const unsigned char command, 
+                      unsigned char *data)
+{
+    unsigned int xfer_command = 0;
+    int ret;
+
+    /* encode the xfer */
+    MC_ICSP_ENCODE_XFER(command, 0, xfer_command);
+
+    /* rx */
+    lpp_stats_syscall(context);
+    ret = (ioctl(context->icsp_dev_file, MC_ICSP_IOC_RX, &xfer_command) == 0);
+
+    /* get LSB */
+    *data = ((xfer_command >> 8) & 0xFF);
+
+    /* return result */
+    return ret;
+}
+
+/* send only a command */
+int lpp_trans_icsp_cmd_only(struct lpp_context_t *context, 
+                            const struct mc_icsp_cmd_only_t *cmd_config)
+{
+    /* send only command */
+    lpp_stats_syscall(context);
+    return (ioctl(context->icsp_dev_file, MC_ICSP_IOC_CMD_ONLY, cmd_config) == 0);
+}
+
+/* send only data */
+int lpp_trans_icsp_data_only(struct lpp_context_t *context, 
+                             const unsigned int data)
+{
+    /* send only data */
+    lpp_stats_syscall(context);
+    return (ioctl(context->icsp_dev_file, MC_ICSP_IOC_DATA_ONLY, data) == 0);
+}
+
+/* delay */
+int lpp_trans_icsp_delay(struct lpp_context_t *context, 
+                         const unsigned int delay_us)
+{
+    /* delay */
+    return lpp_timing_delay_us(&context->timing, delay_us);
+}
+
+#ifdef MC_ICSP_IOC_BATCH
+
+/* issue a number of transactions in one ioctl */
+int lpp_trans_icsp_batch(struct lpp_context_t *context, 
+                         struct lpp_icsp_xfer_t *xfers, 
+                         const unsigned int count)
+{
+    struct lpp_trans_icsp_batch_xfer_t *batch_xfers = context->transport_data;
+    struct lpp_trans_icsp_batch_t batch;
+    unsigned int xfer_idx;
+
+    /* encode the transactions */
+    for (xfer_idx = 0; xfer_idx < count; ++xfer_idx)
+    {
+        /* copy type and command config */
+        batch_xfers[xfer_idx].type = xfers[xfer_idx].type;
+        batch_xfers[xfer_idx].cmd_config = xfers[xfer_idx].cmd_config;
+
+        /* tx values are encoded, everything else passed as is */
+        if (xfers[xfer_idx].type == LPP_ICSP_XFER_TX)
+        {
+            /* encode the xfer */
+            MC_ICSP_ENCODE_XFER(xfers[xfer_idx].command, xfers[xfer_idx].value, batch_xfers[xfer_idx].value);
+        }
+        else batch_xfers[xfer_idx].value = xfers[xfer_idx].value;
+    }
+
+    /* point to transactions */
+    batch.count = count;
+    batch.xfers = batch_xfers;
+
+    /* do the batch */
+    lpp_stats_syscall(context);
+    if (ioctl(context->icsp_dev_file, MC_ICSP_IOC_BATCH, &batch) == 0) return 1;
+
+    /* let caller know if the driver doesn't know this ioctl */
+    return (errno == ENOTTY || errno == EINVAL) ? -1 : 0;
+}
+
+#endif
+
+#ifdef MC_ICSP_IOC_RX_BLOCK
+
+/* read a number of bytes in one ioctl */
+int lpp_trans_icsp_rx_block(struct lpp_context_t *context, 
+                            const unsigned char command, 
+                            unsigned char *data, 
+                            const unsigned int size)
+{
+    struct lpp_trans_icsp_rx_block_t rx_block = {.command = 0, .count = size, .data = data};
+
+    /* encode the xfer */
+    MC_ICSP_ENCODE_XFER(command, 0, rx_block.command);
+
+    /* do the read */
+    lpp_stats_syscall(context);
+    if (ioctl(context->icsp_dev_file, MC_ICSP_IOC_RX_BLOCK, &rx_block) == 0) return 1;
+
+    /* let caller know if the driver doesn't know this ioctl */
+    return (errno == ENOTTY || errno == EINVAL) ? -1 : 0;
+}
+
+#endif
+
+/* operations */
+struct lpp_transport_t lpp_transport_icsp_driver = 
+{
+    .name                       = "icsp",
+    .open                       = lpp_trans_icsp_open,
+    .close                      = lpp_trans_icsp_close,
+    .tx                         = lpp_trans_icsp_tx,
+    .rx                         = lpp_trans_icsp_rx,
+    .cmd_only                   = lpp_trans_icsp_cmd_only,
+    .data_only                  = lpp_trans_icsp_data_only,
+    .delay                      = lpp_trans_icsp_delay,
+#ifdef MC_ICSP_IOC_BATCH
+    .batch                      = lpp_trans_icsp_batch,
+#endif
+#ifdef MC_ICSP_IOC_RX_BLOCK
+    .rx_block                   = lpp_trans_icsp_rx_block,
+#endif
+};
@@ -0,0 +1,449 @@
+/* 
+ * Linux PIC Programmer (lpicp)
+ * Transport over memory mapped GPIO controller registers
+ *
+ * Author: Eran Duchan <pavius@gmail.com>
+ *
+ * This program is free software; you can redistribute  it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ */
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "lpicp.h"
+#include "lpicp_icsp.h"
+#include "lpicp_transport.h"
+
+/* register offsets that aren't set */
+#define LPP_TRANS_MMIO_NO_REG (~0U)
+
+/* transport state */
+struct lpp_trans_mmio_t
+{
+    int                         file;
+    void                        *map;
+    unsigned int                map_size;
+    volatile unsigned char      *window;
+    unsigned int                window_size;
+
+    /* register layout, offsets into the window in bytes */
+    unsigned int                data_offset;
+    unsigned int                input_offset;
+    unsigned int                set_offset;
+    unsigned int                clear_offset;
+    unsigned int                dir_offset;
+    unsigned int                dir_inverted;
+
+    /* pins */
+    unsigned int                pgc_mask;
+    unsigned int                pgd_mask;
+    unsigned int                mclr_mask;
+    unsigned int                pgm_mask;
+
+    /* timing */
+    unsigned int                half_period_ns;
+
+    /* stores are recorded here when the window is an ordinary file */
+    FILE                        *record_file;
+};
+
+/* get the transport state */
+#define lpp_trans_mmio_get(context) ((struct lpp_trans_mmio_t *)(context)->transport_data)
+
+/* access a register */
+#define lpp_trans_mmio_reg(mmio, offset) (*(volatile unsigned int *)((mmio)->window + (offset)))
+
+/* busy wait for the configured half period, stores alone are as fast as we'll go */
+#define lpp_trans_mmio_half_period(mmio) lpp_timing_spin_ns((mmio)->half_period_ns)
+
+/* store to a register */
+static void lpp_trans_mmio_store(struct lpp_trans_mmio_t *mmio, 
+                                 const unsigned int offset, 
+                                 const unsigned int value)
+{
+    /* store */
+    lpp_trans_mmio_reg(mmio, offset) = value;
+
+    /* record it, if applicable */
+    if (mmio->record_file) fprintf(mmio->record_file, "%04X %08X\n", offset, value);
+}
+
+/* drive a number of pins at once */
+static void lpp_trans_mmio_set(struct lpp_trans_mmio_t *mmio, 
+                               const unsigned int bits, 
+                               const unsigned int mask)
+{
+    /* set/clear registers need no read-modify-write */
+    if (mmio->set_offset != LPP_TRANS_MMIO_NO_REG)
+    {
+        /* set and clear whatever's required */
+        if (bits & mask) lpp_trans_mmio_store(mmio, mmio->set_offset, bits & mask);
+        if (~bits & mask) lpp_trans_mmio_store(mmio, mmio->clear_offset, ~bits & mask);
+    }
+    else
+    {
+        /* read, modify, write the data register */
+        lpp_trans_mmio_store(mmio, mmio->data_offset, 
+                             (lpp_trans_mmio_reg(mmio, mmio->data_offset) & ~mask) | (bits & mask));
+    }
+}
+
+/* clock out a value, LSb first */
+static void lpp_trans_mmio_clock_out(struct lpp_trans_mmio_t *mmio, 
+                                     const unsigned int value, 
+                                     const unsigned int bit_count)
+{
+    const unsigned int clock_data_mask = mmio->pgc_mask | mmio->pgd_mask;
+    unsigned int bit_idx;
+
+    /* data is set with the rising edge and sampled by the PIC on the falling edge */
+    for (bit_idx = 0; bit_idx < bit_count; ++bit_idx)
+    {
+        /* get the data bit */
+        const unsigned int pgd = ((value >> bit_idx) & 0x1) ? mmio->pgd_mask : 0;
+
+        /* rising edge, with data */
+        lpp_trans_mmio_set(mmio, mmio->pgc_mask | pgd, clock_data_mask);
+        lpp_trans_mmio_half_period(mmio);
+
+        /* falling edge, data held */
+        lpp_trans_mmio_set(mmio, pgd, clock_data_mask);
+        lpp_trans_mmio_half_period(mmio);
+    }
+}
+
+/* turn PGD around */
+static void lpp_trans_mmio_pgd_direction_set(struct lpp_trans_mmio_t *mmio, const int output)
+{
+    unsigned int dir;
+
+    /* nothing to do if direction isn't controlled by us */
+    if (mmio->dir_offset == LPP_TRANS_MMIO_NO_REG) return;
+
+    /* get the direction register with PGD as output */
+    dir = lpp_trans_mmio_reg(mmio, mmio->dir_offset);
+    dir = mmio->dir_inverted ? (dir & ~mmio->pgd_mask) : (dir | mmio->pgd_mask);
+
+    /* flip it for input */
+    if (!output) dir ^= mmio->pgd_mask;
+
+    /* set it */
+    lpp_trans_mmio_store(mmio, mmio->dir_offset, dir);
+}
+
+/* set all our pins as outputs */
+static void lpp_trans_mmio_outputs_set(struct lpp_trans_mmio_t *mmio)
+{
+    const unsigned int pins_mask = mmio->pgc_mask | mmio->pgd_mask | mmio->mclr_mask | mmio->pgm_mask;
+    unsigned int dir;
+
+    /* nothing to do if direction isn't controlled by us */
+    if (mmio->dir_offset == LPP_TRANS_MMIO_NO_REG) return;
+
+    /* set them */
+    dir = lpp_trans_mmio_reg(mmio, mmio->dir_offset);
+    dir = mmio->dir_inverted ? (dir & ~pins_mask) : (dir | pins_mask);
+    lpp_trans_mmio_store(mmio, mmio->dir_offset, dir);
+}
+
+/* get a pin bit option as a mask, returns 0 if not present */
+static unsigned int lpp_trans_mmio_get_pin(const char *dev_name, const char *pin_name)
+{
+    unsigned int bit;
+
+    /* get the bit */
+    if (!lpp_transport_get_option(dev_name, pin_name, &bit) || bit >= 32) return 0;
+
+    /* shift it */
+    return (1U << bit);
+}
+
+/* map the register window and parse the layout */
+int lpp_trans_mmio_open(struct lpp_context_t *context, const char *dev_name)
+{
+    struct lpp_trans_mmio_t *mmio;
+    struct stat file_stat;
+    char path[LPP_TRANSPORT_MAX_PATH];
+    char record_path[LPP_TRANSPORT_MAX_PATH + 4];
+    unsigned int base = 0, page_size, highest_offset, create = 0;
+
+    /* allocate state */
+    mmio = calloc(1, sizeof(struct lpp_trans_mmio_t));
+    if (mmio == NULL) goto err_alloc_state;
+
+    /* defaults */
+    mmio->window_size = page_size = sysconf(_SC_PAGESIZE);
+    mmio->input_offset = mmio->set_offset = mmio->clear_offset = mmio->dir_offset = LPP_TRANS_MMIO_NO_REG;
+
+    /* get the path, data register and at least pgc/pgd */
+    if (!lpp_transport_get_path(dev_name, path, sizeof(path))                 ||
+        !lpp_transport_get_option(dev_name, "data", &mmio->data_offset)       ||
+        (mmio->pgc_mask = lpp_trans_mmio_get_pin(dev_name, "pgc")) == 0       ||
+        (mmio->pgd_mask = lpp_trans_mmio_get_pin(dev_name, "pgd")) == 0)
+    {
+        /* bad */
+        printf("Expected <mem device|uio device|file>:data=<offset>,pgc=<bit>,pgd=<bit>"
+               "[,base=<address>][,size=<bytes>][,in=<offset>][,set=<offset>,clr=<offset>]"
+               "[,dir=<offset>][,dir_inv=1][,mclr=<bit>][,pgm=<bit>][,half_period_ns=<ns>][,create=1]\n");
+        goto err_parse_dev_name;
+    }
+
+    /* optional layout */
+    lpp_transport_get_option(dev_name, "base", &base);
+    lpp_transport_get_option(dev_name, "size", &mmio->window_size);
+    lpp_transport_get_option(dev_name, "in", &mmio->input_offset);
+    lpp_transport_get_option(dev_name, "set", &mmio->set_offset);
+    lpp_transport_get_option(dev_name, "clr", &mmio->clear_offset);
+    lpp_transport_get_option(dev_name, "dir", &mmio->dir_offset);
+    lpp_transport_get_option(dev_name, "dir_inv", &mmio->dir_inverted);
+    lpp_transport_get_option(dev_name, "half_period_ns", &mmio->half_period_ns);
+    lpp_transport_get_option(dev_name, "create", &create);
+    mmio->mclr_mask = lpp_trans_mmio_get_pin(dev_name, "mclr");
+    mmio->pgm_mask = lpp_trans_mmio_get_pin(dev_name, "pgm");
+
+    /* input is read from the data register, unless told otherwise */
+    if (mmio->input_offset == LPP_TRANS_MMIO_NO_REG) mmio->input_offset = mmio->data_offset;
+
+    /* set and clear registers come in pairs */
+    if ((mmio->set_offset == LPP_TRANS_MMIO_NO_REG) != (mmio->clear_offset == LPP_TRANS_MMIO_NO_REG))
+    {
+        /* bad */
+        printf("Both set and clr register offsets are required\n");
+        goto err_parse_dev_name;
+    }
+
+    /* all registers must be aligned and reside in the window */
+    highest_offset = mmio->data_offset | mmio->input_offset;
+    if (mmio->set_offset != LPP_TRANS_MMIO_NO_REG) highest_offset |= mmio->set_offset | mmio->clear_offset;
+    if (mmio->dir_offset != LPP_TRANS_MMIO_NO_REG) highest_offset |= mmio->dir_offset;
+    if ((highest_offset & 0x3) || highest_offset + sizeof(unsigned int) > mmio->window_size)
+    {
+        /* bad */
+        printf("Register offsets must be 32 bit aligned and within the %u byte window\n", mmio->window_size);
+        goto err_parse_dev_name;
+    }
+
+    /* open the device or file. a stand in file is only created if asked to, a mistyped path must fail */
+    mmio->file = open(path, O_RDWR | O_SYNC | (create ? O_CREAT : 0), 0644);
+
+    /* check */
+    if (mmio->file < 0)
+    {
+        /* failed */
+        printf("Failed to open register window @ %s\n", path);
+        goto err_open_file;
+    }
+
+    /* an ordinary file stands in for the registers - make sure it's big enough and record stores */
+    if (fstat(mmio->file, &file_stat) == 0 && S_ISREG(file_stat.st_mode))
+    {
+        /* grow it */
+        if (file_stat.st_size < (off_t)(base + mmio->window_size) && 
+            ftruncate(mmio->file, base + mmio->window_size) != 0)
+        {
+            /* failed */
+            printf("Failed to size register window file %s\n", path);
+            goto err_size_file;
+        }
+
+        /* open the record, next to it */
+        snprintf(record_path, sizeof(record_path), "%s.rec", path);
+        mmio->record_file = fopen(record_path, "w");
+    }
+
+    /* mmap must start on a page */
+    mmio->map_size = (base & (page_size - 1)) + mmio->window_size;
+    mmio->map = mmap(NULL, mmio->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, 
+                     mmio->file, base & ~(page_size - 1));
+
+    /* check */
+    if (mmio->map == MAP_FAILED)
+    {
+        /* failed */
+        printf("Failed to map %u bytes @ 0x%08X of %s\n", mmio->window_size, base, path);
+        goto err_map;
+    }
+
+    /* point to the registers */
+    mmio->window = (volatile unsigned char *)mmio->map + (base & (page_size - 1));
+
+    /* all pins are outputs, clock and data low */
+    lpp_trans_mmio_set(mmio, 0, mmio->pgc_mask | mmio->pgd_mask);
+    lpp_trans_mmio_outputs_set(mmio);
+
+    /* enter programming mode, if we control MCLR: PGM high, then MCLR high (P12/P15) */
+    if (mmio->mclr_mask)
+    {
+        /* PGM first, if any */
+        lpp_trans_mmio_set(mmio, mmio->pgm_mask, mmio->pgm_mask);
+        lpp_timing_delay_us(&context->timing, 2);
+
+        /* then MCLR */
+        lpp_trans_mmio_set(mmio, mmio->mclr_mask, mmio->mclr_mask);
+        lpp_timing_delay_us(&context->timing, 2);
+    }
+
+    /* save state */
+    context->transport_data = mmio;
+
+    /* success */
+    return 1;
+
+err_map:
+    if (mmio->record_file) fclose(mmio->record_file);
+err_size_file:
+    close(mmio->file);
+err_open_file:
+err_parse_dev_name:
+    free(mmio);
+err_alloc_state:
+    return 0;
+}
+
+/* unmap the register window */
+int lpp_trans_mmio_close(struct lpp_context_t *context)
+{
+    struct lpp_trans_mmio_t *mmio = lpp_trans_mmio_get(context);
+
+    /* check if open */
+    if (mmio)
+    {
+        /* exit programming mode: MCLR, then everything else low */
+        if (mmio->mclr_mask) lpp_trans_mmio_set(mmio, 0, mmio->mclr_mask);
+        lpp_trans_mmio_set(mmio, 0, mmio->pgc_mask | mmio->pgd_mask | mmio->pgm_mask);
+
+        /* release everything */
+        munmap(mmio->map, mmio->map_size);
+        close(mmio->file);
+        if (mmio->record_file) fclose(mmio->record_file);
+
+        /* free state */
+        free(mmio);
+        context->transport_data = NULL;
+    }
+
+    /* success */
+    return 1;
+}
+
+/* clock out command and 16 bits of data */
+int lpp_trans_mmio_tx(struct lpp_context_t *context, 
+                      const unsigned char command, 
+                      const unsigned short data)
+{
+    struct lpp_trans_mmio_t *mmio = lpp_trans_mmio_get(context);
+
+    /* clock out the whole 20 bit transfer */
+    lpp_trans_mmio_clock_out(mmio, command, LPP_COMMAND_BIT_COUNT);
+    lpp_trans_mmio_clock_out(mmio, data, 16);
+
+    /* success */
+    return 1;
+}
+
+/* clock out a command, 8 bits of 0 and clock in 8 bits of data */
+int lpp_trans_mmio_rx(struct lpp_context_t *context, 
+                      const unsigned char command, 
+                      unsigned char *data)
+{
+    struct lpp_trans_mmio_t *mmio = lpp_trans_mmio_get(context);
+    unsigned int bit_idx;
+
+    /* command and 8 don't care clocks */
+    lpp_trans_mmio_clock_out(mmio, command, LPP_COMMAND_BIT_COUNT);
+    lpp_trans_mmio_clock_out(mmio, 0, 8);
+
+    /* let the PIC drive PGD */
+    lpp_trans_mmio_pgd_direction_set(mmio, 0);
+
+    /* clock in the data, LSb first. data is valid after the rising edge */
+    for (*data = 0, bit_idx = 0; bit_idx < 8; ++bit_idx)
+    {
+        /* rising edge */
+        lpp_trans_mmio_set(mmio, mmio->pgc_mask, mmio->pgc_mask);
+        lpp_trans_mmio_half_period(mmio);
+
+        /* sample PGD */
+        if (lpp_trans_mmio_reg(mmio, mmio->input_offset) & mmio->pgd_mask) *data |= (1 << bit_idx);
+
+        /* falling edge */
+        lpp_trans_mmio_set(mmio, 0, mmio->pgc_mask);
+        lpp_trans_mmio_half_period(mmio);
+    }
+
+    /* take PGD back, low */
+    lpp_trans_mmio_set(mmio, 0, mmio->pgd_mask);
+    lpp_trans_mmio_pgd_direction_set(mmio, 1);
+
+    /* success */
+    return 1;
+}
+
+/* clock out a command only, possibly holding PGC/PGD for a while after the last bit */
+int lpp_trans_mmio_cmd_only(struct lpp_context_t *context, 
+                            const struct mc_icsp_cmd_only_t *cmd_config)
+{
+    struct lpp_trans_mmio_t *mmio = lpp_trans_mmio_get(context);
+    const unsigned int last_bit = (LPP_COMMAND_BIT_COUNT - 1);
+
+    /* all but the last bit */
+    lpp_trans_mmio_clock_out(mmio, cmd_config->command, last_bit);
+
+    /* last rising edge, with data */
+    lpp_trans_mmio_set(mmio, 
+                       mmio->pgc_mask | (((cmd_config->command >> last_bit) & 0x1) ? mmio->pgd_mask : 0), 
+                       mmio->pgc_mask | mmio->pgd_mask);
+    lpp_trans_mmio_half_period(mmio);
+
+    /* hold PGC/PGD as requested */
+    lpp_trans_mmio_set(mmio, 
+                       (cmd_config->pgc_value_after_cmd ? mmio->pgc_mask : 0) | 
+                       (cmd_config->pgd_value_after_cmd ? mmio->pgd_mask : 0), 
+                       mmio->pgc_mask | mmio->pgd_mask);
+
+    /* hold for the requested time and release PGC */
+    lpp_timing_delay_us(&context->timing, cmd_config->mdelay * 1000 + cmd_config->udelay);
+    lpp_trans_mmio_set(mmio, 0, mmio->pgc_mask);
+
+    /* success */
+    return 1;
+}
+
+/* clock out 16 bits of data only */
+int lpp_trans_mmio_data_only(struct lpp_context_t *context, 
+                             const unsigned int data)
+{
+    /* clock it out */
+    lpp_trans_mmio_clock_out(lpp_trans_mmio_get(context), data, 16);
+
+    /* success */
+    return 1;
+}
+
+/* delay */
+int lpp_trans_mmio_delay(struct lpp_context_t *context, 
+                         const unsigned int delay_us)
+{
+    /* delay */
+    return lpp_timing_delay_us(&context->timing, delay_us);
+}
+
+/* operations */
+struct lpp_transport_t lpp_transport_mmio = 
+{
+    .name                       = "mmio",
+    .open                       = lpp_trans_mmio_open,
+    .close                      = lpp_trans_mmio_close,
+    .tx                         = lpp_trans_mmio_tx,
+    .rx                         = lpp_trans_mmio_rx,
+    .cmd_only                   = lpp_trans_mmio_cmd_only,
+    .data_only                  = lpp_trans_mmio_data_only,
+    .delay                      = lpp_trans_mmio_delay,
+};
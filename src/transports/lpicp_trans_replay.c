@@ -0,0 +1,318 @@
+/*
+ * Linux PIC Programmer (lpicp)
+ * Replay of a captured ICSP session, checking that the same transfers are issued
+ *
+ * Author: Eran Duchan <pavius@gmail.com>
+ *
+ * This program is free software; you can redistribute  it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lpicp.h"
+#include "lpicp_icsp.h"
+#include "lpicp_log.h"
+#include "lpicp_capture.h"
+#include "lpicp_transport.h"
+
+/* replay state */
+struct lpp_trans_replay_t
+{
+    char                file_path[LPP_TRANSPORT_MAX_PATH];
+    unsigned char       *records;               /* as captured, past the header */
+    unsigned int        records_size;
+    unsigned int        offset;                 /* of the next record to replay */
+    unsigned int        replayed_count;         /* records matched so far */
+    int                 diverged;               /* a transfer didn't match, nothing further is */
+};
+
+/* get the replay state from a context */
+#define lpp_trans_replay_get(context) ((struct lpp_trans_replay_t *)(context)->transport_data)
+
+/* print a record the way lpicp-trace would */
+static void lpp_trans_replay_record_print(const char *prefix,
+                                          const unsigned int record_idx,
+                                          const struct lpp_capture_record_t *record)
+{
+    struct lpp_log_decoder_t decoder;
+    struct lpp_log_record_t log_record;
+    char line[160];
+
+    /* as a log record, at its index */
+    memset(&log_record, 0, sizeof(log_record));
+    log_record.data = record->value;
+    log_record.kind = record->kind;
+    log_record.command = record->command;
+    log_record.result = record->result;
+    log_record.pgc_value = record->pgc_value;
+
+    /* decode and print */
+    lpp_log_decoder_init(&decoder);
+    decoder.record_idx = record_idx;
+    lpp_log_decode(&decoder, &log_record, line, sizeof(line));
+    printf("  %s %s\n", prefix, line);
+}
+
+/* take the next captured record, checking the issued transfer against it */
+static int lpp_trans_replay_next(struct lpp_context_t *context,
+                                 const struct lpp_capture_record_t *issued,
+                                 struct lpp_capture_record_t *captured)
+{
+    struct lpp_trans_replay_t *replay = lpp_trans_replay_get(context);
+    unsigned int record_size;
+
+    /* once off track, stay off */
+    if (replay->diverged) return 0;
+
+    /* get the record */
+    record_size = lpp_capture_record_decode(replay->records + replay->offset,
+                                            replay->records_size - replay->offset,
+                                            captured);
+
+    /* past the end? */
+    if (record_size == 0)
+    {
+        printf("Replay: record %u issued past the end of the capture\n", replay->replayed_count);
+        lpp_trans_replay_record_print("issued:  ", replay->replayed_count, issued);
+        goto err_diverged;
+    }
+
+    /* same transfer? reads are compared by command only, their data is what we hand back */
+    if (captured->kind != issued->kind                                              ||
+        captured->command != issued->command                                        ||
+        (issued->kind != LPP_LOG_KIND_RX && captured->value != issued->value)       ||
+        captured->pgc_value != issued->pgc_value                                    ||
+        captured->pgd_value != issued->pgd_value)
+    {
+        printf("Replay: record %u differs from the capture\n", replay->replayed_count);
+        lpp_trans_replay_record_print("captured:", replay->replayed_count, captured);
+        lpp_trans_replay_record_print("issued:  ", replay->replayed_count, issued);
+        goto err_diverged;
+    }
+
+    /* on to the next */
+    replay->offset += record_size;
+    replay->replayed_count++;
+
+    /* success */
+    return 1;
+
+err_diverged:
+    replay->diverged = 1;
+    return 0;
+}
+
+/* build a record for an issued transfer and check it */
+static int lpp_trans_replay_check(struct lpp_context_t *context,
+                                  const unsigned char kind,
+                                  const unsigned char command,
+                                  const unsigned int value,
+                                  const unsigned char pgc_value,
+                                  const unsigned char pgd_value,
+                                  struct lpp_capture_record_t *captured)
+{
+    struct lpp_capture_record_t issued;
+
+    /* fill it, levels as captured. its result is whatever the capture says */
+    issued.kind = kind;
+    issued.command = command;
+    issued.value = value;
+    issued.pgc_value = pgc_value ? 1 : 0;
+    issued.pgd_value = pgd_value ? 1 : 0;
+    issued.result = 1;
+
+    /* check it */
+    return lpp_trans_replay_next(context, &issued, captured);
+}
+
+/* load the capture */
+int lpp_trans_replay_open(struct lpp_context_t *context, const char *dev_name)
+{
+    struct lpp_capture_file_header_t header;
+    struct lpp_trans_replay_t *replay;
+    FILE *capture_file;
+    long file_size;
+
+    /* allocate state */
+    replay = calloc(1, sizeof(struct lpp_trans_replay_t));
+    if (replay == NULL) goto err_alloc_state;
+
+    /* device name is the capture file */
+    lpp_transport_get_path(dev_name, replay->file_path, sizeof(replay->file_path));
+
+    /* open it */
+    capture_file = fopen(replay->file_path, "rb");
+    if (capture_file == NULL)
+    {
+        /* failed */
+        printf("Replay: failed to open %s\n", replay->file_path);
+        goto err_open_file;
+    }
+
+    /* check the header */
+    if (fread(&header, sizeof(header), 1, capture_file) != 1                         ||
+        memcmp(header.magic, LPP_CAPTURE_FILE_MAGIC, sizeof(header.magic)) != 0      ||
+        header.version != LPP_CAPTURE_FILE_VERSION)
+    {
+        /* failed */
+        printf("Replay: %s is not an lpicp capture\n", replay->file_path);
+        goto err_read_file;
+    }
+
+    /* records are whatever follows */
+    if (fseek(capture_file, 0, SEEK_END) != 0 || (file_size = ftell(capture_file)) < (long)sizeof(header))
+        goto err_read_file;
+    replay->records_size = file_size - sizeof(header);
+
+    /* read them all, replay shouldn't wait on the file */
+    replay->records = malloc(replay->records_size ? replay->records_size : 1);
+    if (replay->records == NULL                                                      ||
+        fseek(capture_file, sizeof(header), SEEK_SET) != 0                           ||
+        (replay->records_size && fread(replay->records, replay->records_size, 1, capture_file) != 1))
+    {
+        /* failed */
+        printf("Replay: failed to read %s\n", replay->file_path);
+        goto err_read_file;
+    }
+
+    /* done with the file */
+    fclose(capture_file);
+
+    /* save state */
+    context->transport_data = replay;
+
+    /* success */
+    return 1;
+
+err_read_file:
+    free(replay->records);
+    fclose(capture_file);
+err_open_file:
+    free(replay);
+err_alloc_state:
+    return 0;
+}
+
+/* done replaying */
+int lpp_trans_replay_close(struct lpp_context_t *context)
+{
+    struct lpp_trans_replay_t *replay = lpp_trans_replay_get(context);
+
+    /* check if open */
+    if (replay)
+    {
+        /* say how far it got */
+        printf("Replay: %u records matched", replay->replayed_count);
+        if (!replay->diverged && replay->offset < replay->records_size) printf(", the rest of the capture wasn't issued");
+        printf("\n");
+
+        /* free everything */
+        free(replay->records);
+        free(replay);
+        context->transport_data = NULL;
+    }
+
+    /* success */
+    return 1;
+}
+
+/* command and 16 bits of data */
+int lpp_trans_replay_tx(struct lpp_context_t *context,
+                        const unsigned char command,
+                        const unsigned short data)
+{
+    struct lpp_capture_record_t captured;
+
+    /* as captured? fails if it did */
+    return lpp_trans_replay_check(context, LPP_LOG_KIND_TX, command, data, 0, 0, &captured) &&
+           captured.result;
+}
+
+/* command and 8 bits read, as captured */
+int lpp_trans_replay_rx(struct lpp_context_t *context,
+                        const unsigned char command,
+                        unsigned char *data)
+{
+    struct lpp_capture_record_t captured;
+
+    /* as captured? */
+    if (!lpp_trans_replay_check(context, LPP_LOG_KIND_RX, command, 0, 0, 0, &captured)) return 0;
+
+    /* the read failed when captured, fail it again */
+    if (!captured.result) return 0;
+
+    /* hand back what was read */
+    *data = captured.value;
+
+    /* success */
+    return 1;
+}
+
+/* a number of reads, as captured */
+int lpp_trans_replay_rx_block(struct lpp_context_t *context,
+                              const unsigned char command,
+                              unsigned char *data,
+                              const unsigned int size)
+{
+    unsigned int byte_idx;
+
+    /* each was captured on its own, up to the one that failed if any */
+    for (byte_idx = 0; byte_idx < size; ++byte_idx)
+        if (!lpp_trans_replay_rx(context, command, &data[byte_idx])) return 0;
+
+    /* success */
+    return 1;
+}
+
+/* command only, the hold isn't waited */
+int lpp_trans_replay_cmd_only(struct lpp_context_t *context,
+                              const struct mc_icsp_cmd_only_t *cmd_config)
+{
+    struct lpp_capture_record_t captured;
+
+    /* as captured? fails if it did */
+    return lpp_trans_replay_check(context, LPP_LOG_KIND_CMD_ONLY, cmd_config->command,
+                                  cmd_config->mdelay * 1000 + cmd_config->udelay,
+                                  cmd_config->pgc_value_after_cmd, cmd_config->pgd_value_after_cmd, &captured) &&
+           captured.result;
+}
+
+/* 16 bits of data only */
+int lpp_trans_replay_data_only(struct lpp_context_t *context,
+                               const unsigned int data)
+{
+    struct lpp_capture_record_t captured;
+
+    /* as captured? fails if it did */
+    return lpp_trans_replay_check(context, LPP_LOG_KIND_DATA_ONLY, 0, data, 0, 0, &captured) &&
+           captured.result;
+}
+
+/* delay, not waited */
+int lpp_trans_replay_delay(struct lpp_context_t *context,
+                           const unsigned int delay_us)
+{
+    struct lpp_capture_record_t captured;
+
+    /* as captured? fails if it did */
+    return lpp_trans_replay_check(context, LPP_LOG_KIND_DELAY, 0, delay_us, 0, 0, &captured) &&
+           captured.result;
+}
+
+/* operations */
+struct lpp_transport_t lpp_transport_replay =
+{
+    .name                       = "replay",
+    .open                       = lpp_trans_replay_open,
+    .close                      = lpp_trans_replay_close,
+    .tx                         = lpp_trans_replay_tx,
+    .rx                         = lpp_trans_replay_rx,
+    .cmd_only                   = lpp_trans_replay_cmd_only,
+    .data_only                  = lpp_trans_replay_data_only,
+    .delay                      = lpp_trans_replay_delay,
+    .rx_block                   = lpp_trans_replay_rx_block,
+};
@@ -0,0 +1,837 @@
+/* 
+ * Linux PIC Programmer (lpicp)
+ * In-process simulated PIC18 target
+ *
+ * Author: Eran Duchan <pavius@gmail.com>
+ *
+ * This program is free software; you can redistribute  it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lpicp.h"
+#include "lpicp_icsp.h"
+#include "lpicp_transport.h"
+
+/* EECON1 bits */
+#define LPP_TRANS_SIM_EECON1_RD         (1 << 0)
+#define LPP_TRANS_SIM_EECON1_WR         (1 << 1)
+#define LPP_TRANS_SIM_EECON1_WREN       (1 << 2)
+#define LPP_TRANS_SIM_EECON1_FREE       (1 << 4)
+#define LPP_TRANS_SIM_EECON1_CFGS       (1 << 6)
+#define LPP_TRANS_SIM_EECON1_EEPGD      (1 << 7)
+
+/* address space */
+#define LPP_TRANS_SIM_IDLOC_ADDRESS     (0x200000)
+#define LPP_TRANS_SIM_IDLOC_BYTES       (8)
+#define LPP_TRANS_SIM_CONFIG_ADDRESS    (0x300000)
+#define LPP_TRANS_SIM_CONFIG_BYTES      (16)
+#define LPP_TRANS_SIM_ERASE_KEY_LOW     (0x3C0004)
+#define LPP_TRANS_SIM_ERASE_KEY_HIGH    (0x3C0005)
+#define LPP_TRANS_SIM_PANEL_CONFIG      (0x3C0006)
+#define LPP_TRANS_SIM_DEVID_ADDRESS     (0x3FFFFE)
+
+/* multi-panel write enable, in the panel config register */
+#define LPP_TRANS_SIM_PANEL_MPEN        (0x40)
+
+/* geometry limits */
+#define LPP_TRANS_SIM_MAX_PANELS        (4)
+#define LPP_TRANS_SIM_MAX_LATCH_BYTES   (64)
+#define LPP_TRANS_SIM_BOOT_BLOCK_BYTES  (0x200)
+
+/* ICSP bits per transaction */
+#define LPP_TRANS_SIM_DATA_BIT_COUNT    (16)
+
+/* operations started by the programmer, executed during the programming hold */
+enum lpp_trans_sim_op_t
+{
+    LPP_TRANS_SIM_OP_NONE,
+    LPP_TRANS_SIM_OP_PROGRAM,
+    LPP_TRANS_SIM_OP_ERASE_ROW,
+    LPP_TRANS_SIM_OP_CONFIG,
+    LPP_TRANS_SIM_OP_BULK_ERASE,
+};
+
+/* simulator state */
+struct lpp_trans_sim_t
+{
+    /* configuration */
+    char                file_path[LPP_TRANSPORT_MAX_PATH];
+    unsigned int        devid;
+    unsigned int        code_size;
+    unsigned int        eeprom_size;
+    unsigned int        latch_size;
+    unsigned int        erase_page_size;
+    unsigned int        p9_us;
+    unsigned int        p11_us;
+    unsigned int        eeprom_write_us;
+    unsigned int        bit_ns;
+
+    /* core: W and access bank registers */
+    unsigned char       w;
+    unsigned char       regs[256];
+    unsigned int        eecon2_unlock;
+
+    /* bulk erase key and panel configuration registers */
+    unsigned char       erase_key[2];
+    unsigned char       panel_config;
+
+    /* table write latches, one per panel */
+    unsigned char       latch[LPP_TRANS_SIM_MAX_PANELS][LPP_TRANS_SIM_MAX_LATCH_BYTES];
+
+    /* operation waiting for the programming hold */
+    unsigned int        pending_op;
+    unsigned int        pending_address;
+    unsigned short      pending_data;
+
+    /* memories */
+    unsigned char       *code;
+    unsigned char       *eeprom;
+    unsigned char       config[LPP_TRANS_SIM_CONFIG_BYTES];
+    unsigned char       idloc[LPP_TRANS_SIM_IDLOC_BYTES];
+
+    /* virtual time */
+    unsigned long long  time_ns;
+    unsigned long long  eeprom_write_done_ns;
+
+    /* statistics */
+    unsigned int        xfer_count;
+    unsigned int        timing_violations;
+    unsigned int        unknown_instructions;
+};
+
+/* get the simulator state */
+#define lpp_trans_sim_get(context) ((struct lpp_trans_sim_t *)(context)->transport_data)
+
+/* get the current table pointer */
+static unsigned int lpp_trans_sim_tblptr_get(struct lpp_trans_sim_t *sim)
+{
+    return ((sim->regs[LPP_REG_TBLPTRU] & 0x3F) << 16) | 
+            (sim->regs[LPP_REG_TBLPTRH] << 8)          | 
+             sim->regs[LPP_REG_TBLPTRL];
+}
+
+/* set the table pointer */
+static void lpp_trans_sim_tblptr_set(struct lpp_trans_sim_t *sim, const unsigned int value)
+{
+    sim->regs[LPP_REG_TBLPTRU] = (value >> 16) & 0x3F;
+    sim->regs[LPP_REG_TBLPTRH] = (value >> 8) & 0xFF;
+    sim->regs[LPP_REG_TBLPTRL] = (value >> 0) & 0xFF;
+}
+
+/* get the eeprom address */
+static unsigned int lpp_trans_sim_eeprom_address(struct lpp_trans_sim_t *sim)
+{
+    return ((sim->regs[LPP_REG_EEADRH] << 8) | sim->regs[LPP_REG_EEADR]) % sim->eeprom_size;
+}
+
+/* advance virtual time and complete anything that's due */
+static void lpp_trans_sim_advance(struct lpp_trans_sim_t *sim, const unsigned long long time_ns)
+{
+    /* advance */
+    sim->time_ns += time_ns;
+
+    /* eeprom write done? */
+    if ((sim->regs[LPP_REG_EECON1] & LPP_TRANS_SIM_EECON1_WR) && 
+        sim->time_ns >= sim->eeprom_write_done_ns)
+    {
+        /* clear WR */
+        sim->regs[LPP_REG_EECON1] &= ~LPP_TRANS_SIM_EECON1_WR;
+    }
+}
+
+/* reset the write latches to erased */
+static void lpp_trans_sim_latch_reset(struct lpp_trans_sim_t *sim)
+{
+    memset(sim->latch, 0xFF, sizeof(sim->latch));
+}
+
+/* get size of a panel */
+static unsigned int lpp_trans_sim_panel_size(struct lpp_trans_sim_t *sim)
+{
+    return sim->code_size / LPP_TRANS_SIM_MAX_PANELS;
+}
+
+/* read a byte from the table address space */
+static unsigned char lpp_trans_sim_table_read(struct lpp_trans_sim_t *sim, const unsigned int address)
+{
+    /* program memory */
+    if (address < sim->code_size) 
+        return sim->code[address];
+
+    /* id locations */
+    if (address >= LPP_TRANS_SIM_IDLOC_ADDRESS && 
+        address < LPP_TRANS_SIM_IDLOC_ADDRESS + LPP_TRANS_SIM_IDLOC_BYTES)
+        return sim->idloc[address - LPP_TRANS_SIM_IDLOC_ADDRESS];
+
+    /* configuration */
+    if (address >= LPP_TRANS_SIM_CONFIG_ADDRESS && 
+        address < LPP_TRANS_SIM_CONFIG_ADDRESS + LPP_TRANS_SIM_CONFIG_BYTES)
+        return sim->config[address - LPP_TRANS_SIM_CONFIG_ADDRESS];
+
+    /* device id, DEVID1 then DEVID2 */
+    if (address == LPP_TRANS_SIM_DEVID_ADDRESS) return (sim->devid >> 8) & 0xFF;
+    if (address == LPP_TRANS_SIM_DEVID_ADDRESS + 1) return sim->devid & 0xFF;
+
+    /* unimplemented reads as 0 */
+    return 0;
+}
+
+/* do a bulk erase by key */
+static int lpp_trans_sim_bulk_erase(struct lpp_trans_sim_t *sim, const unsigned short key)
+{
+    const unsigned int panel_size = lpp_trans_sim_panel_size(sim);
+
+    /* by key */
+    switch (key)
+    {
+        /* chip erase (18f2xx/4xx and 18f2xxx/4xxx keys) */
+        case 0x0080:
+        case 0x3F8F:
+            memset(sim->code, 0xFF, sim->code_size);
+            memset(sim->eeprom, 0xFF, sim->eeprom_size);
+            memset(sim->config, 0xFF, sizeof(sim->config));
+            memset(sim->idloc, 0xFF, sizeof(sim->idloc));
+            break;
+
+        /* data eeprom */
+        case 0x0081:
+            memset(sim->eeprom, 0xFF, sim->eeprom_size);
+            break;
+
+        /* boot block */
+        case 0x0083:
+            memset(sim->code, 0xFF, LPP_TRANS_SIM_BOOT_BLOCK_BYTES);
+            break;
+
+        /* first panel, less the boot block */
+        case 0x0088:
+            memset(sim->code + LPP_TRANS_SIM_BOOT_BLOCK_BYTES, 0xFF, 
+                   panel_size - LPP_TRANS_SIM_BOOT_BLOCK_BYTES);
+            break;
+
+        /* other panels */
+        case 0x0089:
+        case 0x008A:
+        case 0x008B:
+            memset(sim->code + (key - 0x0088) * panel_size, 0xFF, panel_size);
+            break;
+
+        /* unknown key */
+        default:
+            return 0;
+    }
+
+    /* done */
+    return 1;
+}
+
+/* program the write latches */
+static void lpp_trans_sim_program(struct lpp_trans_sim_t *sim, const unsigned int address)
+{
+    const unsigned int panel_size = lpp_trans_sim_panel_size(sim);
+    unsigned int panel_idx, panel_count, byte_idx, row_offset;
+
+    /* all panels are written at once in multi-panel mode */
+    panel_count = (sim->panel_config & LPP_TRANS_SIM_PANEL_MPEN) ? LPP_TRANS_SIM_MAX_PANELS : 1;
+
+    /* offset of the row within the panel */
+    row_offset = (address % panel_size) & ~(sim->latch_size - 1);
+
+    /* write the latches (programming can only clear bits) */
+    for (panel_idx = 0; panel_idx < panel_count; ++panel_idx)
+    {
+        /* get start address */
+        const unsigned int row_address = (panel_count == 1) ? 
+            (address & ~(sim->latch_size - 1)) : (panel_idx * panel_size + row_offset);
+
+        /* program */
+        for (byte_idx = 0; byte_idx < sim->latch_size; ++byte_idx)
+            sim->code[(row_address + byte_idx) % sim->code_size] &= sim->latch[panel_idx][byte_idx];
+    }
+
+    /* latches are reset once written */
+    lpp_trans_sim_latch_reset(sim);
+}
+
+/* complete the operation which was started, given the time it was held for */
+static void lpp_trans_sim_pending_op_complete(struct lpp_trans_sim_t *sim, const unsigned int hold_us)
+{
+    unsigned int required_us;
+    
+    /* nothing pending? */
+    if (sim->pending_op == LPP_TRANS_SIM_OP_NONE) return;
+
+    /* bulk erase takes P11, everything else P9 */
+    required_us = (sim->pending_op == LPP_TRANS_SIM_OP_BULK_ERASE) ? sim->p11_us : sim->p9_us;
+
+    /* held long enough? */
+    if (hold_us >= required_us)
+    {
+        /* by operation */
+        switch (sim->pending_op)
+        {
+            /* program latches */
+            case LPP_TRANS_SIM_OP_PROGRAM:
+                lpp_trans_sim_program(sim, sim->pending_address);
+                break;
+
+            /* erase a row, FREE clears on completion */
+            case LPP_TRANS_SIM_OP_ERASE_ROW:
+                memset(sim->code + (sim->pending_address & ~(sim->erase_page_size - 1)), 
+                       0xFF, sim->erase_page_size);
+                sim->regs[LPP_REG_EECON1] &= ~LPP_TRANS_SIM_EECON1_FREE;
+                break;
+
+            /* single configuration byte (even addresses take the lsb) */
+            case LPP_TRANS_SIM_OP_CONFIG:
+                sim->config[sim->pending_address - LPP_TRANS_SIM_CONFIG_ADDRESS] = 
+                    (sim->pending_address & 0x1) ? (sim->pending_data >> 8) : (sim->pending_data & 0xFF);
+                break;
+
+            /* bulk erase */
+            case LPP_TRANS_SIM_OP_BULK_ERASE:
+                if (!lpp_trans_sim_bulk_erase(sim, sim->pending_data)) 
+                    printf("Simulated target: unknown bulk erase key %04X\n", sim->pending_data);
+                break;
+        }
+    }
+    else
+    {
+        /* operation is lost */
+        sim->timing_violations++;
+    }
+
+    /* done */
+    sim->pending_op = LPP_TRANS_SIM_OP_NONE;
+}
+
+/* write to the table address space */
+static void lpp_trans_sim_table_write(struct lpp_trans_sim_t *sim, 
+                                      const unsigned int address, 
+                                      const unsigned short data, 
+                                      const int start_programming)
+{
+    const unsigned char eecon1 = sim->regs[LPP_REG_EECON1];
+
+    /* bulk erase key registers and panel configuration (even addresses take the lsb) */
+    if (address >= LPP_TRANS_SIM_ERASE_KEY_LOW && address <= LPP_TRANS_SIM_PANEL_CONFIG)
+    {
+        const unsigned char value = (address & 0x1) ? (data >> 8) : (data & 0xFF);
+
+        /* by register */
+        if (address == LPP_TRANS_SIM_PANEL_CONFIG) 
+        {
+            /* save panel config */
+            sim->panel_config = value;
+        }
+        else 
+        {
+            /* save the key */
+            sim->erase_key[address - LPP_TRANS_SIM_ERASE_KEY_LOW] = value;
+
+            /* writing the low key starts the erase */
+            if (address == LPP_TRANS_SIM_ERASE_KEY_LOW)
+            {
+                sim->pending_op = LPP_TRANS_SIM_OP_BULK_ERASE;
+                sim->pending_data = (sim->erase_key[1] << 8) | sim->erase_key[0];
+            }
+        }
+    }
+    /* configuration */
+    else if (address >= LPP_TRANS_SIM_CONFIG_ADDRESS && 
+             address < LPP_TRANS_SIM_CONFIG_ADDRESS + LPP_TRANS_SIM_CONFIG_BYTES)
+    {
+        /* written only when programming starts */
+        if (start_programming && (eecon1 & LPP_TRANS_SIM_EECON1_CFGS))
+        {
+            sim->pending_op = LPP_TRANS_SIM_OP_CONFIG;
+            sim->pending_address = address;
+            sim->pending_data = data;
+        }
+    }
+    /* program memory */
+    else if (address < sim->code_size)
+    {
+        /* row erase? */
+        if (eecon1 & LPP_TRANS_SIM_EECON1_FREE)
+        {
+            /* start erase on programming */
+            if (start_programming)
+            {
+                sim->pending_op = LPP_TRANS_SIM_OP_ERASE_ROW;
+                sim->pending_address = address;
+            }
+        }
+        else
+        {
+            /* select the latch by panel, in multi panel mode */
+            const unsigned int latch_idx = (sim->panel_config & LPP_TRANS_SIM_PANEL_MPEN) ? 
+                                                (address / lpp_trans_sim_panel_size(sim)) : 0;
+            unsigned char *latch = sim->latch[latch_idx];
+
+            /* load the latch, lsb to the even address */
+            latch[(address & ~0x1) & (sim->latch_size - 1)] = (data & 0xFF);
+            latch[(address | 0x1) & (sim->latch_size - 1)] = (data >> 8);
+
+            /* start programming? */
+            if (start_programming)
+            {
+                sim->pending_op = LPP_TRANS_SIM_OP_PROGRAM;
+                sim->pending_address = address;
+            }
+        }
+    }
+}
+
+/* handle a write to EECON1 */
+static void lpp_trans_sim_eecon1_written(struct lpp_trans_sim_t *sim, const unsigned char previous)
+{
+    unsigned char *eecon1 = &sim->regs[LPP_REG_EECON1];
+    const int data_eeprom = !(*eecon1 & (LPP_TRANS_SIM_EECON1_EEPGD | LPP_TRANS_SIM_EECON1_CFGS));
+
+    /* read eeprom */
+    if (*eecon1 & LPP_TRANS_SIM_EECON1_RD)
+    {
+        /* read to EEDATA */
+        if (data_eeprom) 
+            sim->regs[LPP_REG_EEDATA] = sim->eeprom[lpp_trans_sim_eeprom_address(sim)];
+
+        /* RD clears immediately */
+        *eecon1 &= ~LPP_TRANS_SIM_EECON1_RD;
+    }
+
+    /* write eeprom (WR set now, was clear) */
+    if ((*eecon1 & LPP_TRANS_SIM_EECON1_WR) && !(previous & LPP_TRANS_SIM_EECON1_WR))
+    {
+        /* requires WREN and the unlock sequence */
+        if (data_eeprom && (*eecon1 & LPP_TRANS_SIM_EECON1_WREN) && sim->eecon2_unlock == 2)
+        {
+            /* write now, WR clears when the write time passes */
+            sim->eeprom[lpp_trans_sim_eeprom_address(sim)] = sim->regs[LPP_REG_EEDATA];
+            sim->eeprom_write_done_ns = sim->time_ns + sim->eeprom_write_us * 1000ULL;
+        }
+        else
+        {
+            /* ignored */
+            *eecon1 &= ~LPP_TRANS_SIM_EECON1_WR;
+        }
+
+        /* unlock must be redone */
+        sim->eecon2_unlock = 0;
+    }
+}
+
+/* write a register */
+static void lpp_trans_sim_reg_write(struct lpp_trans_sim_t *sim, 
+                                    const unsigned char reg, 
+                                    const unsigned char value)
+{
+    const unsigned char previous = sim->regs[reg];
+
+    /* eecon2 is not a real register, it only tracks the unlock sequence */
+    if (reg == LPP_REG_EECON2)
+    {
+        if (value == 0x55) sim->eecon2_unlock = 1;
+        else if (value == 0xAA && sim->eecon2_unlock == 1) sim->eecon2_unlock = 2;
+        else sim->eecon2_unlock = 0;
+
+        /* done */
+        return;
+    }
+
+    /* write it */
+    sim->regs[reg] = value;
+
+    /* side effects */
+    if (reg == LPP_REG_EECON1) lpp_trans_sim_eecon1_written(sim, previous);
+}
+
+/* execute a core instruction */
+static void lpp_trans_sim_core_execute(struct lpp_trans_sim_t *sim, const unsigned short instruction)
+{
+    const unsigned char f = instruction & 0xFF;
+
+    /* NOP and the second word of two word instructions */
+    if (instruction == LPP_OP_NOP || (instruction & 0xF000) == 0xF000) 
+        return;
+
+    /* MOVLW */
+    if ((instruction & 0xFF00) == 0x0E00)
+        sim->w = f;
+
+    /* MOVWF f (access bank) */
+    else if ((instruction & 0xFF00) == 0x6E00)
+        lpp_trans_sim_reg_write(sim, f, sim->w);
+
+    /* MOVF f, d (access bank) */
+    else if ((instruction & 0xFD00) == 0x5000)
+    {
+        if (instruction & 0x0200) lpp_trans_sim_reg_write(sim, f, sim->regs[f]);
+        else sim->w = sim->regs[f];
+    }
+
+    /* INCF f, d (access bank) */
+    else if ((instruction & 0xFD00) == 0x2800)
+    {
+        if (instruction & 0x0200) lpp_trans_sim_reg_write(sim, f, sim->regs[f] + 1);
+        else sim->w = sim->regs[f] + 1;
+    }
+
+    /* BSF/BCF f, b (access bank) */
+    else if ((instruction & 0xE100) == 0x8000)
+    {
+        const unsigned char bit = (1 << ((instruction >> 9) & 0x7));
+
+        /* set or clear */
+        if (instruction & 0x1000) lpp_trans_sim_reg_write(sim, f, sim->regs[f] & ~bit);
+        else lpp_trans_sim_reg_write(sim, f, sim->regs[f] | bit);
+    }
+
+    /* GOTO (first word), program counter isn't modelled */
+    else if ((instruction & 0xFF00) == 0xEF00)
+        return;
+
+    /* anything else is not modelled */
+    else sim->unknown_instructions++;
+}
+
+/* load memories from the backing file, if any */
+static void lpp_trans_sim_load(struct lpp_trans_sim_t *sim)
+{
+    FILE *sim_file;
+
+    /* no backing file? */
+    if (sim->file_path[0] == '\0') return;
+
+    /* try to open it. if it's not there, device is erased */
+    sim_file = fopen(sim->file_path, "rb");
+    if (sim_file == NULL) return;
+
+    /* read memories */
+    if (fread(sim->code, sim->code_size, 1, sim_file) != 1                  ||
+        fread(sim->config, sizeof(sim->config), 1, sim_file) != 1          ||
+        fread(sim->idloc, sizeof(sim->idloc), 1, sim_file) != 1            ||
+        fread(sim->eeprom, sim->eeprom_size, 1, sim_file) != 1)
+    {
+        /* mismatching file, start off erased */
+        printf("Simulated target: ignoring %s (size mismatch)\n", sim->file_path);
+
+        memset(sim->code, 0xFF, sim->code_size);
+        memset(sim->eeprom, 0xFF, sim->eeprom_size);
+        memset(sim->config, 0xFF, sizeof(sim->config));
+        memset(sim->idloc, 0xFF, sizeof(sim->idloc));
+    }
+
+    /* done */
+    fclose(sim_file);
+}
+
+/* save memories to the backing file, if any */
+static void lpp_trans_sim_save(struct lpp_trans_sim_t *sim)
+{
+    FILE *sim_file;
+
+    /* no backing file? */
+    if (sim->file_path[0] == '\0') return;
+
+    /* try to create it */
+    sim_file = fopen(sim->file_path, "wb");
+
+    /* write memories */
+    if (sim_file == NULL                                                    ||
+        fwrite(sim->code, sim->code_size, 1, sim_file) != 1                 ||
+        fwrite(sim->config, sizeof(sim->config), 1, sim_file) != 1         ||
+        fwrite(sim->idloc, sizeof(sim->idloc), 1, sim_file) != 1           ||
+        fwrite(sim->eeprom, sim->eeprom_size, 1, sim_file) != 1)
+    {
+        /* failed */
+        printf("Simulated target: failed to save to %s\n", sim->file_path);
+    }
+
+    /* done */
+    if (sim_file) fclose(sim_file);
+}
+
+/* create the simulated target */
+int lpp_trans_sim_open(struct lpp_context_t *context, const char *dev_name)
+{
+    struct lpp_trans_sim_t *sim;
+
+    /* allocate state */
+    sim = calloc(1, sizeof(struct lpp_trans_sim_t));
+    if (sim == NULL) goto err_alloc_state;
+
+    /* defaults: a PIC18F452 with datasheet timing */
+    sim->devid              = 0x2004;
+    sim->code_size          = 32 * 1024;
+    sim->eeprom_size        = 256;
+    sim->latch_size         = 8;
+    sim->erase_page_size    = 64;
+    sim->p9_us              = 1000;
+    sim->p11_us             = 5000;
+    sim->eeprom_write_us    = 4000;
+    sim->bit_ns             = 1000;
+
+    /* override from device name: [<backing file>][:<option>=<value>,...] */
+    lpp_transport_get_path(dev_name, sim->file_path, sizeof(sim->file_path));
+    lpp_transport_get_option(dev_name, "devid", &sim->devid);
+    lpp_transport_get_option(dev_name, "code_size", &sim->code_size);
+    lpp_transport_get_option(dev_name, "eeprom_size", &sim->eeprom_size);
+    lpp_transport_get_option(dev_name, "latch_size", &sim->latch_size);
+    lpp_transport_get_option(dev_name, "p9_us", &sim->p9_us);
+    lpp_transport_get_option(dev_name, "p11_us", &sim->p11_us);
+    lpp_transport_get_option(dev_name, "eeprom_write_us", &sim->eeprom_write_us);
+    lpp_transport_get_option(dev_name, "bit_ns", &sim->bit_ns);
+
+    /* sanity: geometry must be powers of two the latches can hold */
+    if (sim->latch_size == 0 || sim->latch_size > LPP_TRANS_SIM_MAX_LATCH_BYTES     || 
+        (sim->latch_size & (sim->latch_size - 1))                                   ||
+        sim->code_size < LPP_TRANS_SIM_MAX_PANELS * LPP_TRANS_SIM_BOOT_BLOCK_BYTES  ||
+        (sim->code_size & (sim->code_size - 1))                                     ||
+        sim->eeprom_size == 0)
+    {
+        /* bad config */
+        printf("Simulated target: invalid geometry\n");
+        goto err_geometry;
+    }
+
+    /* allocate memories */
+    sim->code = malloc(sim->code_size);
+    sim->eeprom = malloc(sim->eeprom_size);
+    if (sim->code == NULL || sim->eeprom == NULL) goto err_alloc_memories;
+
+    /* start off erased */
+    memset(sim->code, 0xFF, sim->code_size);
+    memset(sim->eeprom, 0xFF, sim->eeprom_size);
+    memset(sim->config, 0xFF, sizeof(sim->config));
+    memset(sim->idloc, 0xFF, sizeof(sim->idloc));
+    lpp_trans_sim_latch_reset(sim);
+
+    /* load previous state */
+    lpp_trans_sim_load(sim);
+
+    /* save state */
+    context->transport_data = sim;
+
+    /* success */
+    return 1;
+
+err_alloc_memories:
+    free(sim->code);
+    free(sim->eeprom);
+err_geometry:
+    free(sim);
+err_alloc_state:
+    return 0;
+}
+
+/* destroy the simulated target */
+int lpp_trans_sim_close(struct lpp_context_t *context)
+{
+    struct lpp_trans_sim_t *sim = lpp_trans_sim_get(context);
+
+    /* check if open */
+    if (sim)
+    {
+        /* print what happened */
+        printf("Simulated target: %u transfers, %llu.%03llums bus time", 
+               sim->xfer_count, sim->time_ns / 1000000, (sim->time_ns / 1000) % 1000);
+        if (sim->timing_violations) printf(", %u timing violations", sim->timing_violations);
+        if (sim->unknown_instructions) printf(", %u unknown instructions", sim->unknown_instructions);
+        printf("\n");
+
+        /* persist */
+        lpp_trans_sim_save(sim);
+
+        /* free everything */
+        free(sim->code);
+        free(sim->eeprom);
+        free(sim);
+        context->transport_data = NULL;
+    }
+
+    /* success */
+    return 1;
+}
+
+/* get the simulated bus time so far */
+int lpp_trans_sim_bus_time(struct lpp_context_t *context, unsigned long long *time_ns)
+{
+    /* it's all simulated */
+    *time_ns = lpp_trans_sim_get(context)->time_ns;
+
+    /* success */
+    return 1;
+}
+
+/* command and 16 bits of data */
+int lpp_trans_sim_tx(struct lpp_context_t *context, 
+                     const unsigned char command, 
+                     const unsigned short data)
+{
+    struct lpp_trans_sim_t *sim = lpp_trans_sim_get(context);
+    const unsigned int tblptr = lpp_trans_sim_tblptr_get(sim);
+
+    /* clock it in */
+    sim->xfer_count++;
+    lpp_trans_sim_advance(sim, (LPP_COMMAND_BIT_COUNT + LPP_TRANS_SIM_DATA_BIT_COUNT) * sim->bit_ns);
+
+    /* by command */
+    switch (command)
+    {
+        /* core instruction */
+        case LPP_ICSP_CMD_CORE_INST:
+            lpp_trans_sim_core_execute(sim, data);
+            break;
+
+        /* table write */
+        case LPP_ICSP_CMD_TBL_WR_POST_INC:
+            lpp_trans_sim_table_write(sim, tblptr, data, 0);
+            break;
+
+        /* table write, post increment by 2 */
+        case LPP_ICSP_CMD_TBL_WR_POST_INC_2:
+            lpp_trans_sim_table_write(sim, tblptr, data, 0);
+            lpp_trans_sim_tblptr_set(sim, tblptr + 2);
+            break;
+
+        /* table write, post increment by 2 and start programming */
+        case LPP_ICSP_CMD_TBL_WR_PROG_POST_INC_2:
+            lpp_trans_sim_table_write(sim, tblptr, data, 1);
+            lpp_trans_sim_tblptr_set(sim, tblptr + 2);
+            break;
+
+        /* table write, start programming */
+        case LPP_ICSP_CMD_TBL_WR_PROG:
+            lpp_trans_sim_table_write(sim, tblptr, data, 1);
+            break;
+    }
+
+    /* success */
+    return 1;
+}
+
+/* command and 8 bits of data out of the device */
+int lpp_trans_sim_rx(struct lpp_context_t *context, 
+                     const unsigned char command, 
+                     unsigned char *data)
+{
+    struct lpp_trans_sim_t *sim = lpp_trans_sim_get(context);
+    unsigned int tblptr = lpp_trans_sim_tblptr_get(sim);
+
+    /* clock it out */
+    sim->xfer_count++;
+    lpp_trans_sim_advance(sim, (LPP_COMMAND_BIT_COUNT + LPP_TRANS_SIM_DATA_BIT_COUNT) * sim->bit_ns);
+
+    /* by command - table reads go through TABLAT */
+    switch (command)
+    {
+        /* table read */
+        case LPP_ICSP_CMD_TBL_RD:
+            sim->regs[LPP_REG_TABLAT] = lpp_trans_sim_table_read(sim, tblptr);
+            break;
+
+        /* table read, post increment */
+        case LPP_ICSP_CMD_TBL_RD_POST_INC:
+            sim->regs[LPP_REG_TABLAT] = lpp_trans_sim_table_read(sim, tblptr);
+            lpp_trans_sim_tblptr_set(sim, tblptr + 1);
+            break;
+
+        /* table read, post decrement */
+        case LPP_ICSP_CMD_TBL_RD_POST_DEC:
+            sim->regs[LPP_REG_TABLAT] = lpp_trans_sim_table_read(sim, tblptr);
+            lpp_trans_sim_tblptr_set(sim, tblptr - 1);
+            break;
+
+        /* table read, pre increment */
+        case LPP_ICSP_CMD_TBL_RD_PRE_INC:
+            lpp_trans_sim_tblptr_set(sim, ++tblptr);
+            sim->regs[LPP_REG_TABLAT] = lpp_trans_sim_table_read(sim, tblptr);
+            break;
+    }
+
+    /* shift out TABLAT */
+    *data = sim->regs[LPP_REG_TABLAT];
+
+    /* success */
+    return 1;
+}
+
+/* a number of reads, as a single operation */
+int lpp_trans_sim_rx_block(struct lpp_context_t *context, 
+                           const unsigned char command, 
+                           unsigned char *data, 
+                           const unsigned int size)
+{
+    unsigned int byte_idx;
+
+    /* each read still takes its time on the bus */
+    for (byte_idx = 0; byte_idx < size; ++byte_idx)
+        lpp_trans_sim_rx(context, command, &data[byte_idx]);
+
+    /* success */
+    return 1;
+}
+
+/* command only, with programming hold */
+int lpp_trans_sim_cmd_only(struct lpp_context_t *context, 
+                           const struct mc_icsp_cmd_only_t *cmd_config)
+{
+    struct lpp_trans_sim_t *sim = lpp_trans_sim_get(context);
+    const unsigned int hold_us = cmd_config->mdelay * 1000 + cmd_config->udelay;
+
+    /* clock in the command and hold */
+    sim->xfer_count++;
+    lpp_trans_sim_advance(sim, LPP_COMMAND_BIT_COUNT * sim->bit_ns + hold_us * 1000ULL);
+
+    /* whatever was started completes now */
+    lpp_trans_sim_pending_op_complete(sim, hold_us);
+
+    /* success */
+    return 1;
+}
+
+/* 16 bits of data only */
+int lpp_trans_sim_data_only(struct lpp_context_t *context, 
+                            const unsigned int data)
+{
+    struct lpp_trans_sim_t *sim = lpp_trans_sim_get(context);
+
+    /* clock it in */
+    sim->xfer_count++;
+    lpp_trans_sim_advance(sim, LPP_TRANS_SIM_DATA_BIT_COUNT * sim->bit_ns);
+
+    /* success */
+    return 1;
+}
+
+/* delay, in virtual time only */
+int lpp_trans_sim_delay(struct lpp_context_t *context, 
+                        const unsigned int delay_us)
+{
+    /* advance time */
+    lpp_trans_sim_advance(lpp_trans_sim_get(context), delay_us * 1000ULL);
+
+    /* success */
+    return 1;
+}
+
+/* operations */
+struct lpp_transport_t lpp_transport_sim = 
+{
+    .name                       = "sim",
+    .open                       = lpp_trans_sim_open,
+    .close                      = lpp_trans_sim_close,
+    .tx                         = lpp_trans_sim_tx,
+    .rx                         = lpp_trans_sim_rx,
+    .cmd_only                   = lpp_trans_sim_cmd_only,
+    .data_only                  = lpp_trans_sim_data_only,
+    .delay                      = lpp_trans_sim_delay,
+    .rx_block                   = lpp_trans_sim_rx_block,
+    .bus_time                   = lpp_trans_sim_bus_time,
+};
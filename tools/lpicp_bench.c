@@ -0,0 +1,797 @@
+/*
+ * Linux PIC Programmer (lpicp)
+ * Benchmark, runs each operation on reference images and reports its cost
+ *
+ * Author: Eran Duchan <pavius@gmail.com>
+ *
+ * This program is free software; you can redistribute  it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ */
+
+#include <stdio.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lpicp.h"
+#include "lpicp_image.h"
+#include "lpicp_stats.h"
+#include "lpicp_transport.h"
+
+/* version of the results file */
+#define LPICP_BENCH_RESULTS_VERSION (1)
+
+/* the suite is run this many times by default, keeping the fastest of each operation */
+#define LPICP_BENCH_DEFAULT_RUNS (3)
+
+/* reference images */
+enum lpicp_bench_image_t
+{
+    LPICP_BENCH_IMAGE_DENSE,                    /* all of code memory */
+    LPICP_BENCH_IMAGE_SPARSE,                   /* a bootloader and an application, far apart */
+    LPICP_BENCH_IMAGE_TINY,                     /* a few words */
+    LPICP_BENCH_IMAGE_EEPROM,                   /* a little code, all of the eeprom */
+    LPICP_BENCH_IMAGE_COUNT
+};
+
+/* operations, in the order they're run on each image */
+enum lpicp_bench_op_t
+{
+    LPICP_BENCH_OP_DETECT,
+    LPICP_BENCH_OP_BULK_ERASE,
+    LPICP_BENCH_OP_PROGRAM,
+    LPICP_BENCH_OP_CONFIG,
+    LPICP_BENCH_OP_EEPROM,
+    LPICP_BENCH_OP_READBACK,
+    LPICP_BENCH_OP_VERIFY,
+    LPICP_BENCH_OP_NON_BULK_ERASE,
+    LPICP_BENCH_OP_COUNT
+};
+
+/* names, as reported and as saved in results */
+static const char *lpicp_bench_image_names[LPICP_BENCH_IMAGE_COUNT] =
+{
+    "dense", "sparse", "tiny", "eeprom"
+};
+
+static const char *lpicp_bench_op_names[LPICP_BENCH_OP_COUNT] =
+{
+    "detect", "bulk-erase", "program", "config", "eeprom", "readback", "verify", "non-bulk-erase"
+};
+
+/* the phase each operation is counted in */
+static const enum lpp_stats_phase_t lpicp_bench_op_phases[LPICP_BENCH_OP_COUNT] =
+{
+    LPP_STATS_PHASE_DETECT, LPP_STATS_PHASE_ERASE, LPP_STATS_PHASE_PROGRAM, LPP_STATS_PHASE_CONFIG,
+    LPP_STATS_PHASE_EEPROM, LPP_STATS_PHASE_READ, LPP_STATS_PHASE_VERIFY, LPP_STATS_PHASE_ERASE
+};
+
+/* what an operation cost */
+struct lpicp_bench_result_t
+{
+    int                 valid;                  /* operation was run */
+    unsigned long long  bytes;                  /* moved or affected by it */
+    unsigned long long  wall_ns;
+    unsigned long long  bus_ns;                 /* as modeled by the transport, 0 if it doesn't */
+    unsigned long long  cpu_ns;
+    unsigned int        transfers;
+    unsigned int        syscalls;
+};
+
+/* results of the whole suite */
+struct lpicp_bench_results_t
+{
+    struct lpicp_bench_result_t ops[LPICP_BENCH_IMAGE_COUNT][LPICP_BENCH_OP_COUNT];
+};
+
+/* running configuration */
+struct lpicp_bench_config_t
+{
+    enum lpp_transport_type_t transport;
+    char *dev_name;                             /* capture file prefix, when replaying */
+    char *capture_prefix;                       /* capture each image to <prefix>.<image>.cap */
+    unsigned int runs;
+    char *results_file_name;
+    char *baseline_file_name;
+};
+
+/* config bytes the images carry, over whatever the device implements */
+#define LPICP_BENCH_CONFIG_BYTE_IDX     (1)
+#define LPICP_BENCH_CONFIG_BYTE_VALUE   (0x22)
+
+/* reference images are filled with pseudo random words, the same ones each run */
+static unsigned int lpicp_bench_random(unsigned int *seed)
+{
+    /* xorshift */
+    *seed ^= (*seed << 13);
+    *seed ^= (*seed >> 17);
+    *seed ^= (*seed << 5);
+
+    /* done */
+    return *seed;
+}
+
+/* populate a range of an image with random contents */
+static int lpicp_bench_image_fill(struct lpp_context_t *context,
+                                  struct lpp_image_t *image,
+                                  const unsigned int start,
+                                  const unsigned int size,
+                                  unsigned int *seed)
+{
+    unsigned int address;
+
+    /* make room and mark it */
+    if (!lpp_image_reserve(context, image, start + size) ||
+        !lpp_image_extent_add(context, image, start, size)) return 0;
+
+    /* fill it */
+    for (address = start; address < start + size; ++address)
+        image->contents[address] = lpicp_bench_random(seed) & 0xFF;
+
+    /* grow the contents to cover it */
+    if (start + size > image->contents_size) image->contents_size = start + size;
+
+    /* success */
+    return 1;
+}
+
+/* generate a reference image for the device */
+static int lpicp_bench_image_generate(struct lpp_context_t *context,
+                                      const enum lpicp_bench_image_t image_type,
+                                      struct lpp_image_t *image)
+{
+    const unsigned int code_size = context->device.code_memory_size;
+    unsigned int seed = 0x1CB1C + image_type, byte_idx, ret;
+
+    /* init the image */
+    if (!lpp_image_init(context, image, code_size)) return 0;
+
+    /* by type */
+    switch (image_type)
+    {
+        /* every byte of code memory */
+        case LPICP_BENCH_IMAGE_DENSE:
+            ret = lpicp_bench_image_fill(context, image, 0, code_size, &seed);
+            break;
+
+        /* a 2KB bootloader at the reset vector, a 6KB application half way up */
+        case LPICP_BENCH_IMAGE_SPARSE:
+            ret = lpicp_bench_image_fill(context, image, 0, 2048, &seed) &&
+                  lpicp_bench_image_fill(context, image, code_size / 2, 6144, &seed);
+            break;
+
+        /* a reset vector and not much else */
+        case LPICP_BENCH_IMAGE_TINY:
+            ret = lpicp_bench_image_fill(context, image, 0, 64, &seed);
+            break;
+
+        /* a little code and all of the eeprom */
+        case LPICP_BENCH_IMAGE_EEPROM:
+        {
+            ret = lpicp_bench_image_fill(context, image, 0, 256, &seed);
+
+            /* fill the eeprom */
+            for (byte_idx = 0; byte_idx < context->device.eeprom_bytes && byte_idx < LPP_MAX_EEPROM_BYTES; ++byte_idx)
+            {
+                image->eeprom[byte_idx] = lpicp_bench_random(&seed) & 0xFF;
+                image->eeprom_valid[byte_idx >> 3] |= (1 << (byte_idx & 0x7));
+            }
+
+            /* that's how much there is */
+            image->eeprom_size = byte_idx;
+
+        } break;
+
+        /* unknown */
+        default:
+            ret = 0;
+    }
+
+    /* every image carries the config, erased but for one byte */
+    for (byte_idx = 0; byte_idx < context->device.config_bytes && byte_idx < LPP_MAX_CONFIG_BYTES; ++byte_idx)
+    {
+        image->config[byte_idx] = (byte_idx == LPICP_BENCH_CONFIG_BYTE_IDX) ? LPICP_BENCH_CONFIG_BYTE_VALUE : 0xFF;
+        if (context->device.config_mask) image->config[byte_idx] &= context->device.config_mask[byte_idx];
+        image->config_valid |= (1 << byte_idx);
+    }
+
+    /* done */
+    return ret;
+}
+
+/* count the populated bytes of an image */
+static unsigned int lpicp_bench_image_bytes(struct lpp_image_t *image)
+{
+    struct lpp_image_extent_t *extent;
+    unsigned int bytes = 0;
+
+    /* add up the extents */
+    lpp_image_for_each_extent(image, extent) bytes += (extent->end - extent->start);
+
+    /* done */
+    return bytes;
+}
+
+/* count the valid config bytes of an image */
+static unsigned int lpicp_bench_image_config_bytes(struct lpp_image_t *image)
+{
+    unsigned int byte_idx, bytes = 0;
+
+    /* count the valid bits */
+    for (byte_idx = 0; byte_idx < LPP_MAX_CONFIG_BYTES; ++byte_idx)
+        if (image->config_valid & (1 << byte_idx)) bytes++;
+
+    /* done */
+    return bytes;
+}
+
+/* take the counters of a phase, and the bus time if the transport models it */
+static void lpicp_bench_snapshot(struct lpp_context_t *context,
+                                 const enum lpp_stats_phase_t phase,
+                                 struct lpicp_bench_result_t *snapshot)
+{
+    struct lpp_stats_counters_t counters;
+
+    /* get counters */
+    lpp_stats_get(context, phase, &counters);
+
+    /* take what we report */
+    memset(snapshot, 0, sizeof(*snapshot));
+    snapshot->wall_ns = counters.wall_ns;
+    snapshot->cpu_ns = counters.cpu_ns;
+    snapshot->transfers = counters.transfers;
+    snapshot->syscalls = counters.syscalls;
+
+    /* bus time */
+    if (context->transport->bus_time) context->transport->bus_time(context, &snapshot->bus_ns);
+}
+
+/* run an operation on an image, measuring it */
+static int lpicp_bench_op_run(struct lpp_context_t *context,
+                              const enum lpicp_bench_op_t op,
+                              struct lpp_image_t *image,
+                              struct lpicp_bench_result_t *result)
+{
+    const enum lpp_stats_phase_t phase = lpicp_bench_op_phases[op];
+    struct lpicp_bench_result_t before, after;
+    struct lpp_verify_result_t verify_result;
+    struct lpp_image_t readback_image;
+    struct lpp_image_extent_t *extent;
+    unsigned int ret = 1;
+
+    /* not run, by default */
+    memset(result, 0, sizeof(*result));
+
+    /* count from here */
+    lpp_stats_phase_set(context, phase);
+    lpicp_bench_snapshot(context, phase, &before);
+
+    /* by operation */
+    switch (op)
+    {
+        /* erase it all */
+        case LPICP_BENCH_OP_BULK_ERASE:
+        {
+            ret = lpp_bulk_erase(context);
+            result->bytes = context->device.code_memory_size;
+
+        } break;
+
+        /* page by page, if the device can */
+        case LPICP_BENCH_OP_NON_BULK_ERASE:
+        {
+            if (context->device.group->non_bulk_erase == NULL) return 1;
+
+            ret = lpp_non_bulk_erase(context);
+            result->bytes = context->device.code_memory_size;
+
+        } break;
+
+        /* code */
+        case LPICP_BENCH_OP_PROGRAM:
+        {
+            ret = lpp_write_image_to_device_program(context, image);
+            result->bytes = lpicp_bench_image_bytes(image);
+
+        } break;
+
+        /* config, if the image has any */
+        case LPICP_BENCH_OP_CONFIG:
+        {
+            if (image->config_valid == 0) return 1;
+
+            ret = lpp_write_image_to_device_config(context, image);
+            result->bytes = lpicp_bench_image_config_bytes(image);
+
+        } break;
+
+        /* eeprom, if the image has any */
+        case LPICP_BENCH_OP_EEPROM:
+        {
+            if (image->eeprom_size == 0) return 1;
+
+            ret = lpp_read_image_to_device_eeprom(context, image);
+            result->bytes = image->eeprom_size;
+
+        } break;
+
+        /* read the populated code back to an image of its own */
+        case LPICP_BENCH_OP_READBACK:
+        {
+            if (!lpp_image_init(context, &readback_image, context->device.code_memory_size))
+            {
+                ret = 0;
+                break;
+            }
+
+            lpp_image_for_each_extent(image, extent)
+            {
+                ret = ret && lpp_read_device_program_to_image(context, extent->start,
+                                                              extent->end - extent->start, &readback_image);
+                result->bytes += (extent->end - extent->start);
+            }
+
+            lpp_image_destroy(context, &readback_image);
+
+        } break;
+
+        /* compare everything the image holds */
+        case LPICP_BENCH_OP_VERIFY:
+        {
+            ret = lpp_verify_image(context, image,
+                                   LPP_VERIFY_PROGRAM |
+                                        (image->config_valid ? LPP_VERIFY_CONFIG : 0) |
+                                        (image->eeprom_size ? LPP_VERIFY_EEPROM : 0),
+                                   0, &verify_result) &&
+                  verify_result.mismatch_count == 0;
+
+            result->bytes = verify_result.program_bytes + verify_result.config_bytes + verify_result.eeprom_bytes;
+
+        } break;
+
+        /* detect is measured when the context is created */
+        default:
+            return 0;
+    }
+
+    /* issue whatever's queued, still in the phase */
+    lpp_stats_phase_set(context, phase);
+    lpicp_bench_snapshot(context, phase, &after);
+
+    /* failed? */
+    if (!ret)
+    {
+        printf("%s failed\n", lpicp_bench_op_names[op]);
+        return 0;
+    }
+
+    /* take the difference */
+    result->valid = 1;
+    result->wall_ns = after.wall_ns - before.wall_ns;
+    result->bus_ns = after.bus_ns - before.bus_ns;
+    result->cpu_ns = after.cpu_ns - before.cpu_ns;
+    result->transfers = after.transfers - before.transfers;
+    result->syscalls = after.syscalls - before.syscalls;
+
+    /* success */
+    return 1;
+}
+
+/* run every operation on a reference image, on a fresh context */
+static int lpicp_bench_image_run(struct lpicp_bench_config_t *config,
+                                 const enum lpicp_bench_image_t image_type,
+                                 struct lpicp_bench_result_t *results)
+{
+    char dev_name[LPP_TRANSPORT_MAX_PATH], capture_file_name[LPP_TRANSPORT_MAX_PATH];
+    struct lpp_context_t context;
+    struct lpp_image_t image;
+    unsigned int op, ret;
+
+    /* replay each image from its own capture, anything else runs them all on the device */
+    if (config->transport == LPP_TRANSPORT_REPLAY)
+        snprintf(dev_name, sizeof(dev_name), "%s.%s.cap", config->dev_name, lpicp_bench_image_names[image_type]);
+    else
+        snprintf(dev_name, sizeof(dev_name), "%s", config->dev_name);
+
+    /* and capture each to its own, if asked to */
+    if (config->capture_prefix)
+        snprintf(capture_file_name, sizeof(capture_file_name), "%s.%s.cap", 
+                 config->capture_prefix, lpicp_bench_image_names[image_type]);
+
+    /* opening the context detects the device */
+    if (!lpp_context_init_session(&context, LPP_DEVICE_FAMILY_18F, config->transport, dev_name, NULL,
+                                  config->capture_prefix ? capture_file_name : NULL, 0))
+    {
+        /* failed */
+        printf("Failed to detect a device\n");
+        goto err_context_init;
+    }
+
+    /* that's the detect operation */
+    lpicp_bench_snapshot(&context, LPP_STATS_PHASE_DETECT, &results[LPICP_BENCH_OP_DETECT]);
+    results[LPICP_BENCH_OP_DETECT].valid = 1;
+    results[LPICP_BENCH_OP_DETECT].bytes = sizeof(context.device.id);
+
+    /* generate the image for this device */
+    if (!lpicp_bench_image_generate(&context, image_type, &image))
+    {
+        /* failed */
+        printf("Failed to generate the %s image\n", lpicp_bench_image_names[image_type]);
+        goto err_image_generate;
+    }
+
+    /* run the operations, in order */
+    for (ret = 1, op = LPICP_BENCH_OP_DETECT + 1; ret && op < LPICP_BENCH_OP_COUNT; ++op)
+        ret = lpicp_bench_op_run(&context, op, &image, &results[op]);
+
+    /* done */
+    lpp_image_destroy(&context, &image);
+    lpp_context_destroy(&context);
+    return ret;
+
+err_image_generate:
+    lpp_image_destroy(&context, &image);
+    lpp_context_destroy(&context);
+err_context_init:
+    return 0;
+}
+
+/* run the suite, keeping the fastest of each operation over the runs */
+static int lpicp_bench_run(struct lpicp_bench_config_t *config, struct lpicp_bench_results_t *results)
+{
+    struct lpicp_bench_result_t run_results[LPICP_BENCH_OP_COUNT];
+    unsigned int run, image_type, op;
+
+    /* nothing yet */
+    memset(results, 0, sizeof(*results));
+
+    /* each run, each image */
+    for (run = 0; run < config->runs; ++run)
+    {
+        for (image_type = 0; image_type < LPICP_BENCH_IMAGE_COUNT; ++image_type)
+        {
+            /* run it */
+            memset(run_results, 0, sizeof(run_results));
+            if (!lpicp_bench_image_run(config, image_type, run_results))
+            {
+                /* failed */
+                printf("Failed to benchmark the %s image\n", lpicp_bench_image_names[image_type]);
+                return 0;
+            }
+
+            /* counts are the same each run, only host time varies */
+            for (op = 0; op < LPICP_BENCH_OP_COUNT; ++op)
+            {
+                struct lpicp_bench_result_t *best = &results->ops[image_type][op];
+
+                /* first run or a faster one */
+                if (!best->valid) *best = run_results[op];
+                else if (run_results[op].valid)
+                {
+                    if (run_results[op].wall_ns < best->wall_ns) best->wall_ns = run_results[op].wall_ns;
+                    if (run_results[op].cpu_ns < best->cpu_ns) best->cpu_ns = run_results[op].cpu_ns;
+                }
+            }
+        }
+    }
+
+    /* success */
+    return 1;
+}
+
+/* the time throughput is measured over - the bus, if the transport models it, or the wall */
+#define lpicp_bench_result_time_ns(result)                                      \
+        ((result)->bus_ns ? (result)->bus_ns : (result)->wall_ns)
+
+/* per byte of an operation, 0 if it has none */
+#define lpicp_bench_result_per_byte(result, value)                              \
+        ((result)->bytes ? ((double)(value) / (result)->bytes) : 0.0)
+
+/* get the throughput of an operation, in bytes/s */
+static double lpicp_bench_result_throughput(const struct lpicp_bench_result_t *result)
+{
+    const unsigned long long time_ns = lpicp_bench_result_time_ns(result);
+
+    /* bytes over time */
+    return time_ns ? (result->bytes * 1000000000.0 / time_ns) : 0.0;
+}
+
+/* print the results as a table */
+static void lpicp_bench_print(struct lpicp_bench_results_t *results)
+{
+    unsigned int image_type, op;
+
+    /* header */
+    printf("%-8s %-15s %9s %12s %11s %13s %10s %10s\n",
+           "image", "operation", "bytes", "bytes/s", "xfers/byte", "syscalls/byte", "bus ms", "cpu ms");
+
+    /* each operation that was run */
+    for (image_type = 0; image_type < LPICP_BENCH_IMAGE_COUNT; ++image_type)
+    {
+        for (op = 0; op < LPICP_BENCH_OP_COUNT; ++op)
+        {
+            const struct lpicp_bench_result_t *result = &results->ops[image_type][op];
+
+            /* skip operations that weren't */
+            if (!result->valid) continue;
+
+            printf("%-8s %-15s %9llu %12.0f %11.3f %13.3f %10.3f %10.3f\n",
+                   lpicp_bench_image_names[image_type],
+                   lpicp_bench_op_names[op],
+                   result->bytes,
+                   lpicp_bench_result_throughput(result),
+                   lpicp_bench_result_per_byte(result, result->transfers),
+                   lpicp_bench_result_per_byte(result, result->syscalls),
+                   lpicp_bench_result_time_ns(result) / 1000000.0,
+                   result->cpu_ns / 1000000.0);
+        }
+    }
+}
+
+/* save the results, for later runs to be compared against */
+static int lpicp_bench_results_save(struct lpicp_bench_results_t *results, const char *file_name)
+{
+    unsigned int image_type, op;
+    FILE *results_file;
+
+    /* create it */
+    results_file = fopen(file_name, "w");
+    if (results_file == NULL)
+    {
+        /* failed */
+        printf("Failed to create %s\n", file_name);
+        return 0;
+    }
+
+    /* header */
+    fprintf(results_file, "# lpicp-bench results %d\n", LPICP_BENCH_RESULTS_VERSION);
+    fprintf(results_file, "# image operation bytes wall_ns bus_ns cpu_ns transfers syscalls\n");
+
+    /* a line per operation that was run */
+    for (image_type = 0; image_type < LPICP_BENCH_IMAGE_COUNT; ++image_type)
+    {
+        for (op = 0; op < LPICP_BENCH_OP_COUNT; ++op)
+        {
+            const struct lpicp_bench_result_t *result = &results->ops[image_type][op];
+
+            /* skip operations that weren't */
+            if (!result->valid) continue;
+
+            fprintf(results_file, "%s %s %llu %llu %llu %llu %u %u\n",
+                    lpicp_bench_image_names[image_type],
+                    lpicp_bench_op_names[op],
+                    result->bytes, result->wall_ns, result->bus_ns, result->cpu_ns,
+                    result->transfers, result->syscalls);
+        }
+    }
+
+    /* done */
+    return (fclose(results_file) == 0);
+}
+
+/* get the index of a name in a table, count if not there */
+static unsigned int lpicp_bench_name_find(const char **names, const unsigned int count, const char *name)
+{
+    unsigned int idx;
+
+    /* linear, they're short */
+    for (idx = 0; idx < count && strcmp(names[idx], name) != 0; ++idx);
+
+    /* done */
+    return idx;
+}
+
+/* load results saved by an earlier run */
+static int lpicp_bench_results_load(struct lpicp_bench_results_t *results, const char *file_name)
+{
+    char line[256], image_name[32], op_name[32];
+    struct lpicp_bench_result_t result;
+    unsigned int image_type, op;
+    int version;
+    FILE *results_file;
+
+    /* nothing yet */
+    memset(results, 0, sizeof(*results));
+
+    /* open it */
+    results_file = fopen(file_name, "r");
+    if (results_file == NULL)
+    {
+        /* failed */
+        printf("Failed to open %s\n", file_name);
+        goto err_open_file;
+    }
+
+    /* check the version */
+    if (fgets(line, sizeof(line), results_file) == NULL                             ||
+        sscanf(line, "# lpicp-bench results %d", &version) != 1                     ||
+        version != LPICP_BENCH_RESULTS_VERSION)
+    {
+        /* failed */
+        printf("%s is not an lpicp-bench results file\n", file_name);
+        goto err_read_header;
+    }
+
+    /* each line, skipping comments and anything we don't know */
+    while (fgets(line, sizeof(line), results_file) != NULL)
+    {
+        /* parse it */
+        memset(&result, 0, sizeof(result));
+        if (line[0] == '#' ||
+            sscanf(line, "%31s %31s %llu %llu %llu %llu %u %u",
+                   image_name, op_name, &result.bytes, &result.wall_ns, &result.bus_ns,
+                   &result.cpu_ns, &result.transfers, &result.syscalls) != 8) continue;
+
+        /* find where it goes */
+        image_type = lpicp_bench_name_find(lpicp_bench_image_names, LPICP_BENCH_IMAGE_COUNT, image_name);
+        op = lpicp_bench_name_find(lpicp_bench_op_names, LPICP_BENCH_OP_COUNT, op_name);
+        if (image_type == LPICP_BENCH_IMAGE_COUNT || op == LPICP_BENCH_OP_COUNT) continue;
+
+        /* save it */
+        result.valid = 1;
+        results->ops[image_type][op] = result;
+    }
+
+    /* done */
+    fclose(results_file);
+    return 1;
+
+err_read_header:
+    fclose(results_file);
+err_open_file:
+    return 0;
+}
+
+/* get the change from a baseline value, in percent */
+static double lpicp_bench_change(const double baseline, const double current)
+{
+    return baseline ? ((current - baseline) * 100.0 / baseline) : 0.0;
+}
+
+/* print how the results changed from a baseline */
+static void lpicp_bench_compare(struct lpicp_bench_results_t *baseline, struct lpicp_bench_results_t *results)
+{
+    unsigned int image_type, op;
+
+    /* header */
+    printf("\nChange from baseline:\n");
+    printf("%-8s %-15s %10s %11s %13s %10s\n",
+           "image", "operation", "bytes/s", "xfers/byte", "syscalls/byte", "cpu");
+
+    /* each operation run by both */
+    for (image_type = 0; image_type < LPICP_BENCH_IMAGE_COUNT; ++image_type)
+    {
+        for (op = 0; op < LPICP_BENCH_OP_COUNT; ++op)
+        {
+            const struct lpicp_bench_result_t *before = &baseline->ops[image_type][op];
+            const struct lpicp_bench_result_t *after = &results->ops[image_type][op];
+
+            /* skip operations that aren't in both */
+            if (!before->valid || !after->valid) continue;
+
+            printf("%-8s %-15s %+9.1f%% %+10.1f%% %+12.1f%% %+9.1f%%\n",
+                   lpicp_bench_image_names[image_type],
+                   lpicp_bench_op_names[op],
+                   lpicp_bench_change(lpicp_bench_result_throughput(before), lpicp_bench_result_throughput(after)),
+                   lpicp_bench_change(lpicp_bench_result_per_byte(before, before->transfers),
+                                      lpicp_bench_result_per_byte(after, after->transfers)),
+                   lpicp_bench_change(lpicp_bench_result_per_byte(before, before->syscalls),
+                                      lpicp_bench_result_per_byte(after, after->syscalls)),
+                   lpicp_bench_change(before->cpu_ns, after->cpu_ns));
+        }
+    }
+}
+
+/* print usage */
+static void lpicp_bench_usage(void)
+{
+    printf("Usage: lpicp-bench [options]\n");
+    printf("Runs detect, erase, program, config, eeprom, readback and verify on reference images\n");
+    printf("(dense, sparse, tiny and eeprom heavy) and reports what each operation cost\n\n");
+    printf("  -t, --transport <name>      icsp, gpio, sim, mmio or replay (sim)\n");
+    printf("  -d, --dev <name>            device name for the transport (an unbacked simulated target),\n");
+    printf("                              or the prefix of the captures to replay\n");
+    printf("  -n, --runs <count>          times to run the suite, the fastest of each is kept (%d)\n",
+           LPICP_BENCH_DEFAULT_RUNS);
+    printf("  -o, --output <file>         save the results\n");
+    printf("  -c, --compare <file>        compare the results against ones saved earlier\n");
+    printf("  -C, --capture <prefix>      capture each image's session to <prefix>.<image>.cap\n");
+    printf("  -h, --help                  print this\n");
+    printf("\nThe device is erased and programmed over and over - don't point this at anything you need\n");
+}
+
+/* entry */
+int main(int argc, char *argv[])
+{
+    struct lpicp_bench_results_t results, baseline;
+    struct lpicp_bench_config_t config;
+    int current_option;
+
+    static struct option long_options[] =
+    {
+        {"transport",   required_argument,  0, 't'},
+        {"dev",         required_argument,  0, 'd'},
+        {"runs",        required_argument,  0, 'n'},
+        {"output",      required_argument,  0, 'o'},
+        {"compare",     required_argument,  0, 'c'},
+        {"capture",     required_argument,  0, 'C'},
+        {"help",        no_argument,        0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    /* defaults: an unbacked simulated target */
+    memset(&config, 0, sizeof(config));
+    config.transport = LPP_TRANSPORT_SIM;
+    config.dev_name = "";
+    config.runs = LPICP_BENCH_DEFAULT_RUNS;
+
+    /* parse options */
+    while ((current_option = getopt_long(argc, argv, "t:d:n:o:c:C:h", long_options, NULL)) != -1)
+    {
+        switch (current_option)
+        {
+            /* transport */
+            case 't':
+            {
+                if (strcmp(optarg, "icsp") == 0)        config.transport = LPP_TRANSPORT_ICSP_DRIVER;
+                else if (strcmp(optarg, "gpio") == 0)   config.transport = LPP_TRANSPORT_GPIO;
+                else if (strcmp(optarg, "sim") == 0)    config.transport = LPP_TRANSPORT_SIM;
+                else if (strcmp(optarg, "mmio") == 0)   config.transport = LPP_TRANSPORT_MMIO;
+                else if (strcmp(optarg, "replay") == 0) config.transport = LPP_TRANSPORT_REPLAY;
+                else
+                {
+                    printf("Unknown transport %s\n", optarg);
+                    return 1;
+                }
+
+            } break;
+
+            /* device name */
+            case 'd': config.dev_name = optarg; break;
+
+            /* runs */
+            case 'n':
+            {
+                config.runs = strtoul(optarg, NULL, 0);
+                if (config.runs == 0)
+                {
+                    printf("Runs must be at least 1\n");
+                    return 1;
+                }
+
+            } break;
+
+            /* results */
+            case 'o': config.results_file_name = optarg; break;
+            case 'c': config.baseline_file_name = optarg; break;
+
+            /* capture */
+            case 'C': config.capture_prefix = optarg; break;
+
+            /* help, or anything we don't know */
+            default:
+                lpicp_bench_usage();
+                return (current_option == 'h') ? 0 : 1;
+        }
+    }
+
+    /* load the baseline first, no use running if it's not there */
+    if (config.baseline_file_name && !lpicp_bench_results_load(&baseline, config.baseline_file_name)) return 1;
+
+    /* run the suite */
+    if (!lpicp_bench_run(&config, &results)) return 1;
+
+    /* report */
+    printf("\n");
+    lpicp_bench_print(&results);
+
+    /* compare */
+    if (config.baseline_file_name) lpicp_bench_compare(&baseline, &results);
+
+    /* save */
+    if (config.results_file_name && !lpicp_bench_results_save(&results, config.results_file_name)) return 1;
+
+    /* success */
+    return 0;
+}
@@ -0,0 +1,101 @@
+/* 
+ * Linux PIC Programmer (lpicp)
+ * Transfer log decoder, for logs dumped with lpicp --trace
+ *
+ * Author: Eran Duchan <pavius@gmail.com>
+ *
+ * This program is free software; you can redistribute  it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "lpicp.h"
+#include "lpicp_log.h"
+
+/* decode a log file to stdout */
+int lpicp_trace_decode(const char *file_name)
+{
+    struct lpp_log_file_header_t header;
+    struct lpp_log_record_t record;
+    struct lpp_log_decoder_t decoder;
+    unsigned int record_idx, failed_count;
+    char line[160];
+    FILE *log_file;
+
+    /* open the file */
+    log_file = fopen(file_name, "rb");
+    if (log_file == NULL)
+    {
+        /* failed */
+        printf("Failed to open %s\n", file_name);
+        goto err_open_file;
+    }
+
+    /* read and check the header */
+    if (fread(&header, sizeof(header), 1, log_file) != 1                     || 
+        memcmp(header.magic, LPP_LOG_FILE_MAGIC, sizeof(header.magic)) != 0  ||
+        header.version != LPP_LOG_FILE_VERSION                               ||
+        header.record_size != sizeof(struct lpp_log_record_t))
+    {
+        /* failed */
+        printf("%s is not an lpicp transfer log\n", file_name);
+        goto err_read_header;
+    }
+
+    /* say what's in it */
+    printf("%d transfers", header.record_count);
+    if (header.total_record_count > header.record_count) 
+        printf(", the last of %llu logged", header.total_record_count);
+    printf("\n");
+
+    /* decode records as they're read */
+    lpp_log_decoder_init(&decoder);
+    for (record_idx = failed_count = 0; 
+         record_idx < header.record_count && fread(&record, sizeof(record), 1, log_file) == 1; 
+         ++record_idx)
+    {
+        /* decode it */
+        lpp_log_decode(&decoder, &record, line, sizeof(line));
+        if (!record.result) failed_count++;
+
+        /* print it */
+        printf("%s\n", line);
+    }
+
+    /* truncated? */
+    if (record_idx != header.record_count)
+        printf("Log truncated after %d transfers\n", record_idx);
+
+    /* summary */
+    if (failed_count) printf("%d transfers failed\n", failed_count);
+
+    /* done */
+    fclose(log_file);
+    return (record_idx == header.record_count);
+
+err_read_header:
+    fclose(log_file);
+err_open_file:
+    return 0;
+}
+
+/* entry */
+int main(int argc, char *argv[])
+{
+    /* need a file */
+    if (argc != 2)
+    {
+        /* print usage */
+        printf("Usage: lpicp-trace <log file>\n");
+        printf("Decodes a transfer log dumped by lpicp --trace\n");
+
+        /* error */
+        return 1;
+    }
+
+    /* decode it */
+    return lpicp_trace_decode(argv[1]) ? 0 : 1;
+}